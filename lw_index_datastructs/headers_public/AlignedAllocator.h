@@ -0,0 +1,84 @@
+/** @file
+* @brief Allocator for STL containers which places elements into memory with specified alignment
+* @author konstantin.burlachenko@kaust.edu.sa
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+
+#if defined(_WIN32)
+    #include <malloc.h>
+#endif
+
+namespace lw_index_datastructs
+{
+    /** Allocate aligned memory
+    * @param bytes size of memory in bytes
+    * @param alignment required alignment. Should be power of two and multiple of sizeof(void*).
+    * @return pointer to memory or nullptr
+    */
+    inline void* alignedMalloc(size_t bytes, size_t alignment)
+    {
+#if defined(_WIN32)
+        return _aligned_malloc(bytes, alignment);
+#else
+        void* memory = nullptr;
+        if (posix_memalign(&memory, alignment, bytes) != 0)
+            return nullptr;
+        return memory;
+#endif
+    }
+
+    /** Free memory obtained by alignedMalloc()
+    */
+    inline void alignedFree(void* memory)
+    {
+#if defined(_WIN32)
+        _aligned_free(memory);
+#else
+        free(memory);
+#endif
+    }
+
+    template <class T, size_t Alignment = 64>
+    struct AlignedAllocator
+    {
+        typedef T value_type;
+
+        template <class U>
+        struct rebind
+        {
+            typedef AlignedAllocator<U, Alignment> other;
+        };
+
+        AlignedAllocator() {}
+
+        template <class U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment>& /*rhs*/) {}
+
+        T* allocate(size_t n)
+        {
+            void* memory = alignedMalloc(n * sizeof(T) > 0 ? n * sizeof(T) : 1, Alignment);
+            if (!memory)
+                throw std::bad_alloc();
+            return static_cast<T*>(memory);
+        }
+
+        void deallocate(T* memory, size_t /*n*/) {
+            alignedFree(memory);
+        }
+
+        template <class U>
+        bool operator == (const AlignedAllocator<U, Alignment>& /*rhs*/) const {
+            return true;
+        }
+
+        template <class U>
+        bool operator != (const AlignedAllocator<U, Alignment>& /*rhs*/) const {
+            return false;
+        }
+    };
+}
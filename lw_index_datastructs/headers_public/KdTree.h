@@ -27,10 +27,20 @@
 #pragma once
 
 #include "Comparators.h"
+#include "WorkStealingTaskPool.h"
+#include "KdTreeNodeAllocators.h"
+#include "KdTreeMetrics.h"
+#include "AlignedAllocator.h"
+#include "SmallStack.h"
 #include <assert.h>
+#include <math.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <vector>
 #include <limits>
+#include <algorithm>
+#include <utility>
+#include <new>
 
 namespace lw_index_datastructs
 {
@@ -44,27 +54,78 @@ namespace lw_index_datastructs
         eDontKnow             ///< Test algorithm can not say anything about current situation
     };
 
+    /** Way in which KD-tree is constructed from the batch of points
+    */
+    enum class KdTreeBuildMode
+    {
+        eIncrementalInsertion, ///< Push points one by one in order of container. Shape of the tree depends on the order of points.
+        eBalancedMedianSplit   ///< Bulk build with median split on each level. Height of the tree is ~log2(N).
+    };
+
+    /** Rule for selecting split axis of the node during bulk build
+    */
+    enum class KdTreeSplitRule
+    {
+        eRoundRobin, ///< Axis is depth of the node modulo Dimension
+        eMaxSpread   ///< Axis along which points of the subtree have the biggest spread (max - min). Build is slower by ~Dimension*N*lg(N), but cells are closer to cubes for skewed data.
+    };
+
+    /** Place where coordinates of points are stored
+    */
+    enum class KdTreeStorageMode
+    {
+        eExternalPoints,  ///< Tree keeps raw pointers to coordinates of the user. Memory of the user should be alive while the tree is used.
+        eOwnedCoordinates ///< Tree copies coordinates into own 64 bytes aligned buffers in preorder of nodes. Queries still return pointers to coordinates of the user.
+    };
+
+    /** Result of K nearest neighbours search
+    */
+    template <class TCoord, class TNorm>
+    struct KdTreeNeighbour
+    {
+        const TCoord* point; ///< pointer to coordinates of found point which has been used to construct the tree
+        TNorm distanceSqr;   ///< squared distance from request point to found point. For other metrics then L2 it's reduced distance of the metric, see KdTreeMetrics.h.
+    };
+
+    /** Graph of K nearest neighbours of all points in compressed sparse row (CSR) format
+    */
+    template <class TCoord, class TNorm>
+    struct KdTreeKnnGraph
+    {
+        std::vector<const TCoord*> vertices; ///< pointer to coordinates of point for each vertex
+        std::vector<size_t> rowOffsets;      ///< neighbours of vertex i are stored in [rowOffsets[i], rowOffsets[i + 1]). Size is number of vertices + 1.
+        std::vector<size_t> neighbours;      ///< indices of neighbour vertices. Neighbours of each vertex are sorted by increasing distance.
+        std::vector<TNorm> distancesSqr;     ///< squared distances to neighbours
+
+        /** Get number of vertices
+        */
+        size_t size() const {
+            return vertices.size();
+        }
+    };
+
+    template <class TCoord, size_t Dimension, class TNorm, typename Cmp>
+    class FrozenKDtree;
+
     template <class TCoord,                                   ///< Used type for coordinate
               size_t Dimension = 2,                           ///< Used number of dimensions
               class TNorm = TCoord,                           ///< Used type for store norm of the vector
-              typename Cmp = Comparator<TCoord> > ///< Used type to perform compare between coordinates
+              typename Cmp = Comparator<TCoord>,                 ///< Used type to perform compare between coordinates
+              class NodeAllocator = KdTreeArenaNodeAllocator,    ///< Used policy to allocate memory for nodes. See KdTreeNodeAllocators.h
+              class Metric = KdTreeL2Metric<TCoord, Dimension, TNorm>> ///< Used policy of distance metric. See KdTreeMetrics.h
     class KDtree
     {
+        static_assert(Dimension > 0 && Dimension <= 0xFFFF, "Split axis is stored in 16 bits");
+
     public:
         typedef const TCoord* TPointerToTCoordinates;         ///< Typedef for pointer to constand coordinates
         const static size_t kDimension = Dimension;           ///< Size of dimension where KD tree is building
+        const static size_t kDefaultParallelBuildGrainSize = 16 * 1024; ///< Subtrees with less number of points are built by parallel build serially in one task
+        const static size_t kOwnedPointsChunkSize = 4 * 1024;          ///< Number of points in chunk of owned coordinates for points appended by pushInTree()
+        const static size_t kDefaultBatchGrainSize = 256;              ///< Number of queries of the batch processed by one task
+        const static size_t kDefaultKnnGraphGroupSize = 32;            ///< Maximum number of points in the group of queries which share pruning bound in buildKnearestNeighboursGraph()
+        const static size_t kDefaultJoinGroupSize = 16;                ///< Maximum number of points in the group of queries which share pruning bound in joinNearest()
     protected:
-        static TCoord L2NormSqr(const TCoord* a, const TCoord* b)
-        {
-            TCoord distance = TCoord();
-            for (size_t i = 0; i < Dimension; ++i)
-            {
-                TNorm tmp = a[i] - b[i];
-                distance += tmp*tmp;
-            }
-            return distance;
-        }
-
         /** Get coordinate from pointCoordinates with index
         */
         static const TCoord& getCoord(const TCoord* pointCoordinates, size_t index)
@@ -82,6 +143,8 @@ namespace lw_index_datastructs
             : left(nullptr)
             , right(nullptr)
             , pointCoordinates(nullptr)
+            , splitValue()
+            , splitAxis(0)
             , enable(true)
             {}
 
@@ -106,12 +169,69 @@ namespace lw_index_datastructs
                 return KDtree::getCoord(pointCoordinates, index);
             }
 
-            KDtreeNode* left;               ///< points for which point[depth-of-node % Dimension] is less then in the node (what less means was defined by the depth of the node)
-            KDtreeNode* right;              ///< points for which point[depth-of-node % Dimension] is greater or equal then in the node (what less means was defined by the depth of the node)
+            /** Make node split space by plane orthogonal to axis and passing through the point of the node
+            * @param axis index of coordinate
+            */
+            void setSplit(size_t axis)
+            {
+                splitAxis = uint16_t(axis);
+                splitValue = pointCoordinates[axis];
+            }
+
+            KDtreeNode* left;               ///< points for which point[splitAxis] is less then splitValue
+            KDtreeNode* right;              ///< points for which point[splitAxis] is greater or equal then splitValue
             const TCoord* pointCoordinates; ///< raw pointer to array of coordinates for point
+            TCoord splitValue;              ///< copy of pointCoordinates[splitAxis]. Descent does not touch memory of the points.
+            uint16_t splitAxis;             ///< index of coordinate used to split space in this node
             bool enable;                    ///< marker that point is enable for futher evaluations
         };
 
+        /** Subtree which is postponed during search together with lower bound of squared distance from request point to it
+        */
+        struct NodeWithBound
+        {
+            KDtreeNode* node; ///< root of subtree
+            TNorm bound;      ///< squared distance to the split plane of the parent
+        };
+
+        /** Subtree which is postponed during depth-first search together with squared distance from request point to its cell.
+        * Cell of the far child differs from the cell of the parent only by one side, so only one term of the distance is changed.
+        */
+        struct CellWithBound
+        {
+            KDtreeNode* node;   ///< root of subtree
+            TNorm bound;        ///< lower bound of squared distance to the cell which is used for pruning, see cellPruneBound()
+            TNorm cellDistance; ///< squared distance to the cell evaluated incrementally
+            TNorm axisTerm;     ///< term of the distance by split axis of the parent
+            size_t axis;        ///< split axis of the parent
+            size_t undoSize;    ///< size of the undo log of axis terms when subtree was postponed
+        };
+
+        /** Previous value of term of distance to the cell by one axis
+        */
+        struct AxisTerm
+        {
+            size_t axis; ///< index of the axis
+            TNorm term;  ///< value of the term
+        };
+
+        /** Copy of the point in storage of the tree. Coordinates are the first member, so pointer to coordinates is a pointer to the whole record.
+        */
+        struct OwnedPoint
+        {
+            TCoord coordinates[Dimension]; ///< copy of coordinates
+            const TCoord* original;        ///< pointer to coordinates of the user
+        };
+
+        /** Block of memory with copies of points
+        */
+        struct OwnedPointsChunk
+        {
+            OwnedPoint* points; ///< start of the block. Aligned by 64 bytes.
+            size_t capacity;    ///< maximum number of points in the block
+            size_t used;        ///< number of used points in the block
+        };
+
     public:
         /** Get number of dimensions for points.
         * @return dimension for KD-tree
@@ -123,15 +243,27 @@ namespace lw_index_datastructs
         /** Construct KD-tree from points. Only raw pointers are copying inside the tree.
         * @param ctr container with points
         * @param num number of points in container.
+        * @param mode way in which tree is constructed. By default tree is built balanced.
+        * @param splitRule rule for selecting split axis for balanced build. Incremental insertion always uses round robin.
+        * @param storageMode place where coordinates of points are stored
         */
         template <class Container>
-        KDtree(Container& ctr, size_t num)
+        KDtree(const Container& ctr, size_t num, KdTreeBuildMode mode = KdTreeBuildMode::eBalancedMedianSplit, KdTreeSplitRule splitRule = KdTreeSplitRule::eRoundRobin,
+               KdTreeStorageMode storageMode = KdTreeStorageMode::eExternalPoints)
         : top(nullptr)
         , numPoints(0)
         , numDisablePoints(0)
+        , storage(storageMode)
         {
-            for (size_t i = 0; ctr.size(); ++i)
-                pushInTree(ctr[i]);
+            if (mode == KdTreeBuildMode::eBalancedMedianSplit)
+            {
+                buildBalanced(ctr, num, splitRule);
+            }
+            else
+            {
+                for (size_t i = 0; i < num; ++i)
+                    pushInTree(ctr[i]);
+            }
         }
 
         /** Default ctor
@@ -140,25 +272,57 @@ namespace lw_index_datastructs
         : top(nullptr)
         , numPoints(0)
         , numDisablePoints(0)
+        , storage(KdTreeStorageMode::eExternalPoints)
+        {}
+
+        /** Ctor for empty tree with configured allocator of nodes
+        * @param nodeAllocator allocator which is copied into the tree
+        */
+        explicit KDtree(const NodeAllocator& nodeAllocator)
+        : top(nullptr)
+        , numPoints(0)
+        , numDisablePoints(0)
+        , allocator(nodeAllocator)
+        , storage(KdTreeStorageMode::eExternalPoints)
         {}
 
-        /** Copy ctor
+        /** Copy ctor. Allocator of nodes copies only configuration from rhs. Owned coordinates are copied into own storage of the new tree.
         */
         KDtree(const KDtree& rhs)
         : top(nullptr)
         , numPoints(rhs.numPoints)
         , numDisablePoints(rhs.numDisablePoints)
+        , metric(rhs.metric)
+        , allocator(rhs.allocator)
+        , storage(rhs.storage)
         {
             auto visitFunction = [&](KDtreeNode* leftSubtree, KDtreeNode* rightSubtree, KDtreeNode* x) -> KDtreeNode*
                                  {
-                                     KDtreeNode* res = new KDtreeNode();
+                                     KDtreeNode* res = createNode();
                                      res->left = leftSubtree;
                                      res->right = rightSubtree;
-                                     res->pointCoordinates = x->pointCoordinates;
+                                     res->pointCoordinates = rhs.originalPoint(x);
+                                     res->splitValue = x->splitValue;
+                                     res->splitAxis = x->splitAxis;
+                                     res->enable = x->enable;
                                      return res;
                                  };
             // postorder garantees that 'leftSubtree' and 'rightSubtree' have already been constructed
             top = postOrderNodesTraverse(rhs.top, visitFunction);
+            if (storage == KdTreeStorageMode::eOwnedCoordinates)
+                copyPointsIntoTree();
+        }
+
+        /** Move ctor. Nodes and owned coordinates are transferred from rhs in constant time, rhs becomes empty.
+        */
+        KDtree(KDtree&& rhs) noexcept
+        : top(nullptr)
+        , numPoints(0)
+        , numDisablePoints(0)
+        , allocator(rhs.allocator)
+        , storage(rhs.storage)
+        {
+            swap(rhs);
         }
 
         /** Dtor
@@ -167,39 +331,118 @@ namespace lw_index_datastructs
             removeAll();
         }
 
-        /** Assignment operator
+        /** Assignment operator. Time is ~N.
         */
         KDtree& operator = (const KDtree& rhs)
         {
-            removeAll();
-            auto visitFunction = [&](KDtreeNode* leftSubtree, KDtreeNode* rightSubtree, KDtreeNode* x) -> KDtreeNode*
+            if (this != &rhs)
             {
-                KDtreeNode* res = new KDtreeNode();
-                res->left = leftSubtree;
-                res->right = rightSubtree;
+                KDtree copy(rhs);
+                swap(copy);
+            }
+            return *this;
+        }
 
-                res->point = x->point;
-                res->enable = x->enable;
-                return res;
-            };
-            // postorder guarantees that 'leftSubtree' and 'rightSubtree' have already been constructed
-            top = postOrderNodesTraverse(rhs.top, visitFunction);
+        /** Move assignment operator. Previous content is freed, content of rhs is transferred in constant time.
+        */
+        KDtree& operator = (KDtree&& rhs) noexcept
+        {
+            if (this != &rhs)
+            {
+                KDtree moved(std::move(rhs));
+                swap(moved);
+            }
+            return *this;
+        }
+
+        /** Exchange content of two trees in constant time
+        */
+        void swap(KDtree& rhs) noexcept
+        {
+            std::swap(top, rhs.top);
+            std::swap(numPoints, rhs.numPoints);
+            std::swap(numDisablePoints, rhs.numDisablePoints);
+            std::swap(cmp, rhs.cmp);
+            std::swap(metric, rhs.metric);
+            allocator.swap(rhs.allocator);
+            std::swap(storage, rhs.storage);
+            ownedChunks.swap(rhs.ownedChunks);
         }
 
         /** Remove all, i.e. clean all KD-tree
+        * @remark if allocator of nodes frees memory at once time is ~number of memory chunks, otherwise it's ~N
         */
         void removeAll()
         {
-            auto visitFunction = [&](const KDtreeNode* /*leftSubtree*/, const KDtreeNode* /*rightSubtree*/, const KDtreeNode* x) -> KDtreeNode*
+            releaseOwnedPoints();
+            if (NodeAllocator::kReleaseAllAtOnce)
             {
-                delete x;
-                return nullptr;
-            };
-            top = postOrderNodesTraverse(top, visitFunction);            
+                allocator.releaseAll();
+                top = nullptr;
+            }
+            else
+            {
+                auto visitFunction = [&](const KDtreeNode* /*leftSubtree*/, const KDtreeNode* /*rightSubtree*/, KDtreeNode* x) -> KDtreeNode*
+                {
+                    destroyNode(x);
+                    return nullptr;
+                };
+                top = postOrderNodesTraverse(top, visitFunction);
+            }
             numPoints = 0;
             numDisablePoints = 0;
         }
 
+        /** Get place where coordinates of points are stored
+        */
+        KdTreeStorageMode storageMode() const {
+            return storage;
+        }
+
+        /** Change place where coordinates of points are stored. Time is ~N.
+        * @param storageMode new storage mode. For eOwnedCoordinates coordinates of all points are copied into the tree in preorder of nodes.
+        * @remark pointers returned by queries are pointers to coordinates of the user in both modes
+        */
+        void setStorageMode(KdTreeStorageMode storageMode)
+        {
+            if (storageMode == storage)
+                return;
+
+            if (storageMode == KdTreeStorageMode::eOwnedCoordinates)
+            {
+                storage = storageMode;
+                copyPointsIntoTree();
+            }
+            else
+            {
+                postOrderNodesTraverse(top, [&](const KDtreeNode* /*leftSubtree*/, const KDtreeNode* /*rightSubtree*/, KDtreeNode* x) -> KDtreeNode*
+                                            {
+                                                x->pointCoordinates = originalPoint(x);
+                                                return x;
+                                            });
+                releaseOwnedPoints();
+                storage = storageMode;
+            }
+        }
+
+        /** Get allocator of nodes
+        */
+        const NodeAllocator& nodeAllocator() const {
+            return allocator;
+        }
+
+        /** Get distance metric which is used by all searches
+        */
+        const Metric& distanceMetric() const {
+            return metric;
+        }
+
+        /** Set distance metric, e.g. weights of coordinates. Structure of the tree does not depend on metric, so it's not rebuilt.
+        */
+        void setDistanceMetric(const Metric& distanceMetric) {
+            metric = distanceMetric;
+        }
+
         /** Get number of points inside KD-tree
         */
         size_t size() const {
@@ -258,7 +501,7 @@ namespace lw_index_datastructs
         */
         template<class AreaRelativeToPlane, class IsPointInsideArea, class TContainer = std::vector<const TCoord*>>
         void rangeSearchWithPredicats(TContainer& outContainer, const AreaRelativeToPlane& areaRelativeToPlane, const IsPointInsideArea& isPointInsideArea) {
-            rangeSearchInternal(outContainer, top, areaRelativeToPlane, isPointInsideArea, 0);
+            rangeSearchInternal(outContainer, top, areaRelativeToPlane, isPointInsideArea);
         }
 
         /** Search all point which lie inside [minPoint, maxPoint]
@@ -293,14 +536,135 @@ namespace lw_index_datastructs
             return rangeSearchWithPredicats(outContainer, areaRelativeToPlanePredicate, isPointInsidePredicate);
         }
 
+        /** Search all enable points which lie inside the ball with center in pointCoordinates. Pruning uses squared distances, so square roots are not computed.
+        * @param outContainer container to which found points are appended together with squared distances to them. Should support push_back() and random access iterators.
+        * @param pointCoordinates center of the ball
+        * @param radius radius of the ball. Points with distance equal to radius are included.
+        * @param sortByDistance sort appended points by increasing distance
+        * @param maxResults maximum number of appended points. If it's reached and sortByDistance is false search stops and arbitrary points from the ball are returned, with sortByDistance it's maxResults closest points from the ball.
+        * @return number of appended points
+        */
+        template<class TContainer = std::vector<KdTreeNeighbour<TCoord, TNorm>>>
+        size_t rangeSearchWithRadius(TContainer& outContainer, const TCoord* pointCoordinates, TNorm radius,
+                                     bool sortByDistance = false, size_t maxResults = std::numeric_limits<size_t>::max()) const
+        {
+            if (!top || maxResults == 0)
+                return 0;
+
+            TNorm radiusSqr = metric.fromDistance(radius);
+            size_t start = outContainer.size();
+
+            if (sortByDistance && maxResults < numPoints)
+            {
+                std::vector<KdTreeNeighbour<TCoord, TNorm>> closest(maxResults);
+                WithinRadiusCollector<KnearestCollector<KdTreeNeighbour<TCoord, TNorm>>> collector(radiusSqr, closest.data(), maxResults);
+                searchInternal(pointCoordinates, collector);
+                size_t found = collector.finish();
+                for (size_t i = 0; i < found; ++i)
+                {
+                    closest[i].point = originalPointOf(closest[i].point);
+                    outContainer.push_back(closest[i]);
+                }
+                return found;
+            }
+
+            RadiusCollector<TContainer> collector(*this, outContainer, radiusSqr, maxResults);
+            searchInternal(pointCoordinates, collector);
+            if (sortByDistance)
+                std::sort(outContainer.begin() + start, outContainer.end(), KnearestCollector<KdTreeNeighbour<TCoord, TNorm>>::isCloser);
+            return collector.count;
+        }
+
+        /** Remove all points from the KD-tree and build it again from points with median split on each level. Time is ~N*lg(N).
+        * @param ctr container with points. Only raw pointers are copying inside the tree.
+        * @param num number of points in container
+        * @param splitRule rule for selecting split axis of the nodes
+        * @remark height of the tree is floor(lg(N)) + 1 if points have distinct coordinates. Points with coordinate equal to the split by comparator of the tree go to the right subtree as in pushInTree().
+        */
+        template <class Container>
+        void buildBalanced(const Container& ctr, size_t num, KdTreeSplitRule splitRule = KdTreeSplitRule::eRoundRobin)
+        {
+            removeAll();
+            if (num == 0)
+                return;
+
+            std::vector<const TCoord*> points(num);
+            for (size_t i = 0; i < num; ++i)
+                points[i] = ctr[i];
+
+            const TCoord** base = points.data();
+            top = buildBalancedInternal(base, base + num, 0, base, allocateNodesForBuild(num), splitRule);
+            numPoints = num;
+            if (storage == KdTreeStorageMode::eOwnedCoordinates)
+                copyPointsIntoTree();
+        }
+
+        /** Remove all points from the KD-tree and build it again with median split on each level. Independent subtrees are built in parallel.
+        * @param ctr container with points. Only raw pointers are copying inside the tree.
+        * @param num number of points in container
+        * @param pool pool of threads which is used to build subtrees
+        * @param grainSize subtrees with at most such number of points are built serially inside one task
+        * @param splitRule rule for selecting split axis of the nodes
+        * @remark constructed tree is exactly the same as the one constructed by buildBalanced() regardless of number of threads
+        */
+        template <class Container>
+        void buildBalancedParallel(const Container& ctr, size_t num, WorkStealingTaskPool& pool, size_t grainSize = kDefaultParallelBuildGrainSize, KdTreeSplitRule splitRule = KdTreeSplitRule::eRoundRobin)
+        {
+            removeAll();
+            if (num == 0)
+                return;
+
+            std::vector<const TCoord*> points(num);
+            for (size_t i = 0; i < num; ++i)
+                points[i] = ctr[i];
+
+            if (grainSize == 0)
+                grainSize = 1;
+
+            const TCoord** base = points.data();
+            KDtreeNode* nodesBlock = allocateNodesForBuild(num);
+            TaskGroup group(pool);
+            top = buildBalancedParallelInternal(base, base + num, 0, base, nodesBlock, group, grainSize, splitRule);
+            group.wait();
+            numPoints = num;
+            if (storage == KdTreeStorageMode::eOwnedCoordinates)
+                copyPointsIntoTree();
+        }
+
+        /** Remove all points from the KD-tree and build it again with median split on each level. Independent subtrees are built in parallel.
+        * @param ctr container with points. Only raw pointers are copying inside the tree.
+        * @param num number of points in container
+        * @param threadsCount number of threads used for build. Zero means to use number of hardware threads.
+        * @param grainSize subtrees with at most such number of points are built serially inside one task
+        * @param splitRule rule for selecting split axis of the nodes
+        * @remark constructed tree is exactly the same as the one constructed by buildBalanced() regardless of number of threads
+        */
+        template <class Container>
+        void buildBalancedParallel(const Container& ctr, size_t num, size_t threadsCount, size_t grainSize = kDefaultParallelBuildGrainSize, KdTreeSplitRule splitRule = KdTreeSplitRule::eRoundRobin)
+        {
+            WorkStealingTaskPool pool(threadsCount);
+            buildBalancedParallel(ctr, num, pool, grainSize, splitRule);
+        }
+
+        /** Check that two trees have the same shape and the same points in corresponding nodes.
+        * @param rhs tree to compare with
+        * @return true if trees are identical
+        */
+        bool isSameStructure(const KDtree& rhs) const {
+            return isSameStructureInternal(top, rhs, rhs.top);
+        }
+
         /** Append point to the KD-tree. Difference sequence of insertions leads to different trees.
         * @param point appended point
         * @remark just to have some guarantees about bad constructed tree you can append points in some shuffle order        
         */
         void pushInTree(const TCoord* pointCoordinates)
         {
-            KDtreeNode* node = new KDtreeNode();
-            node->pointCoordinates = pointCoordinates;
+            KDtreeNode* node = createNode();
+            if (storage == KdTreeStorageMode::eOwnedCoordinates)
+                node->pointCoordinates = copyPointIntoTree(pointCoordinates);
+            else
+                node->pointCoordinates = pointCoordinates;
             top = pushInTreeInternal(top, node, 0);
             numPoints++;
         }
@@ -311,13 +675,25 @@ namespace lw_index_datastructs
         * @return coord of closest point and zero if the tree is empty
         */
         const TCoord* nearestPointInEuclidianMetric(const TCoord* pointCoordinates, bool leavePointsAsEnable = true)
+        {
+            return nearestPointInEuclidianMetricWithBound(pointCoordinates, std::numeric_limits<TNorm>::max(), leavePointsAsEnable);
+        }
+
+        /** Find nearest point to query point by Euclidean (L2) metric among points which are closer then specified bound
+        * @param pointCoordinates requested point
+        * @param distanceSqrBound upper bound on squared distance. Only points with squared distance strictly less then it are considered.
+        * @param leavePointsAsEnable special flag which can be used in scenario when after search you want temporary disable found other points which are enable in KDTree
+        * @return coord of closest point and zero if there are no enable points closer then bound
+        * @remark bound is used for pruning from the start, so subtrees which are farther then bound are never visited and search which finds nothing finishes after descent to the leaf
+        */
+        const TCoord* nearestPointInEuclidianMetricWithBound(const TCoord* pointCoordinates, TNorm distanceSqrBound, bool leavePointsAsEnable = true)
         {
             if (!top)
                 return nullptr;
 
-            TNorm bestNorm = std::numeric_limits<TNorm>::max();
-            KDtreeNode* bestNode = nullptr;
-            nearestPointInternal(top, bestNorm, &bestNode, pointCoordinates, 0);
+            NearestCollector collector(distanceSqrBound);
+            searchInternal(pointCoordinates, collector);
+            KDtreeNode* bestNode = collector.bestNode;
             if (!bestNode)
                 return nullptr;
 
@@ -334,166 +710,1717 @@ namespace lw_index_datastructs
                     numDisablePoints++;
                 }
             }
-            return bestNode->pointCoordinates;
+            return originalPoint(bestNode);
         }
-        
-        /** Find nearest point to query point by Euclidian (L2) metric
+
+        /** State which is kept between nearest point searches for close request points. It remembers path from the root to the previous result.
+        * @remark hint is valid only while the tree is not modified. After modification call reset().
+        */
+        class NearestSearchHint
+        {
+        public:
+            /** Forget previous result
+            */
+            void reset() {
+                path.clear();
+            }
+
+            /** Check that hint does not contain previous result
+            */
+            bool empty() const {
+                return path.empty();
+            }
+
+        private:
+            friend class KDtree;
+            std::vector<KDtreeNode*> path; ///< nodes from the root to the previous result
+        };
+
+        /** Find nearest point to query point by Euclidean (L2) metric starting from the previous result. Is useful for sequence of close request points, for example for tracking.
         * @param pointCoordinates requested point
-        * @param K upper bound on number of nearest points in which you're interesting in
-        * @return array with coordinates to closest point and zero if the tree is empty
-        * @param leavePointsAsEnable special flag which can be used in scenario when after search you want temporary disable found other points which are enable in KDTree
-        * @remark naive implementation
+        * @param hint result of the previous search. It's updated by found point.
+        * @return coord of closest point and zero if the tree does not contain enable points
+        * @remark distance to the previous result gives initial bound. Search starts from the deepest node on the path to previous result which cell contains request point and goes up by the path,
+        * far subtree of node on the path is visited only if its split plane is closer then current bound. If request point moves a little only few nodes around previous result are visited. Result is exact.
         */
-        template <class Point, class TContainer = std::vector<const TCoord*>>
-        void findKnearestPointInEuclidianMetric(TContainer& outContainer, const TCoord* pointCoordinates, size_t K, bool leavePointsAsEnable = true)
+        const TCoord* nearestPointInEuclidianMetricWithHint(const TCoord* pointCoordinates, NearestSearchHint& hint) const
         {
             if (!top)
+            {
+                hint.reset();
                 return nullptr;
+            }
 
-            std::vector<KDtreeNode*> nodes;
-            for (;;)
+            NearestCollector collector;
+            KDtreeNode* hintNode = hint.path.empty() ? nullptr : hint.path.back();
+            size_t keepLevel = 0; // result lies in subtree of hint.path[keepLevel]
+            if (!hintNode || !hintNode->enable)
+            {
+                hint.reset();
+                searchInternal(pointCoordinates, collector);
+            }
+            else
             {
-                TNorm bestNorm = std::numeric_limits<TNorm>::max();
-                KDtreeNode* bestNode = nullptr;
-                nearestPointInternal(top, bestNorm, &bestNode, pointCoordinates, 0);
-                if (!bestNode)
+                collector.offer(hintNode, metric.distance(pointCoordinates, hintNode->pointCoordinates));
+
+                // deepest node of the path which cell contains request point
+                size_t level = 0;
+                for (; level + 1 < hint.path.size(); ++level)
                 {
-                    break;
+                    KDtreeNode* node = hint.path[level];
+                    bool goesLeft = CmpHelper::IsLess(cmp(KDtree::getCoord(pointCoordinates, node->splitAxis), node->splitValue));
+                    if (goesLeft != (hint.path[level + 1] == node->left))
+                        break;
                 }
-                else
+                searchInternal(hint.path[level], pointCoordinates, collector);
+                keepLevel = level;
+
+                // go up: points of the ancestor and of its far subtree are not closer then its split plane
+                for (size_t i = level; i-- > 0; )
                 {
-                    bestNode->enable = false;
-                    nodes.push_back(bestNode);
+                    KDtreeNode* node = hint.path[i];
+                    TNorm tmpDistanceToSeparatePlane = TNorm(node->splitValue) - TNorm(KDtree::getCoord(pointCoordinates, node->splitAxis));
+                    if (!(metric.axisDistance(tmpDistanceToSeparatePlane, node->splitAxis) < collector.pruneBound()))
+                        continue;
+
+                    if (node->enable)
+                        collector.offer(node, kdTreeBoundedDistance(metric, pointCoordinates, node->pointCoordinates, collector.acceptBound()));
+
+                    KDtreeNode* farSubtree = (hint.path[i + 1] == node->left) ? node->right : node->left;
+                    KDtreeNode* bestBefore = collector.bestNode;
+                    if (farSubtree)
+                        searchInternal(farSubtree, pointCoordinates, collector);
+                    if (collector.bestNode != bestBefore || collector.bestNode == node)
+                        keepLevel = i;
                 }
             }
 
-            size_t sz = nodes.size();
-            for (size_t i = 0; i < sz; ++i)
+            KDtreeNode* bestNode = collector.bestNode;
+            if (!bestNode)
             {
-                outContainer.push_back(nodes[i].pointCoordinates);
-                if (nodes[i].enable != leavePointsAsEnable)
-                {
-                    if (leavePointsAsEnable)
-                    {
-                        nodes[i].enable = true;
-                        numDisablePoints--;
-                    }
-                    else
-                    {
-                        nodes[i].enable = false;
-                        numDisablePoints++;
-                    }
-                }
+                hint.reset();
+                return nullptr;
+            }
+
+            if (bestNode != hintNode)
+            {
+                KDtreeNode* from = hint.path.empty() ? top : hint.path[keepLevel];
+                hint.path.resize(hint.path.empty() ? 0 : keepLevel);
+                if (!appendPathToNode(hint.path, from, bestNode))
+                    hint.reset();
             }
+            return originalPoint(bestNode);
         }
 
-    protected:
-        /** Find nearest point with pruning
+        /** Find approximate nearest point to query point by Euclidean (L2) metric. Disabled points are skipped.
+        * @param pointCoordinates requested point
+        * @param eps allowed relative error. Distance to returned point is at most (1+eps) times bigger then distance to the true nearest point. Zero means exact search.
+        * @return coord of found point and zero if the tree does not contain enable points
+        * @remark subtree on the far side of split plane is visited only if (1+eps) * distance to the plane is less then current best distance, so bigger eps leads to less visited nodes
         */
-        void nearestPointInternal(KDtreeNode* root, TNorm& bestNormSquare, KDtreeNode** bestNode, const TCoord* requestPoint, size_t depth)
+        const TCoord* approximateNearestPointInEuclidianMetric(const TCoord* pointCoordinates, double eps) const
         {
-            if (!root)
-                return;
+            if (!top)
+                return nullptr;
 
-            size_t curCoord = depth % Dimension;
-            size_t nextDepth = depth + 1;
+            ApproximateCollector<NearestCollector> collector(approximationBoundScale(eps));
+            searchInternal(pointCoordinates, collector);
+            return collector.bestNode ? originalPoint(collector.bestNode) : nullptr;
+        }
 
-            // Possible update norm square. Only in case when node is enable.
-            if (root->enable)
-            {
-                TNorm newNormSquare = KDtree::L2NormSqr(requestPoint, root->pointCoordinates);
-                if (newNormSquare < bestNormSquare)
-                {
-                    bestNormSquare = newNormSquare;
-                    (*bestNode) = root;
-                }
-            }
+        /** Find K nearest points to query point by Euclidean (L2) metric in one traversal of the tree. Disabled points are skipped.
+        * @param pointCoordinates requested point
+        * @param K number of requested neighbours
+        * @param outNeighbours buffer for at least K items. It's filled by found neighbours sorted by increasing distance.
+        * @param eps allowed relative error. Distance to i-th found neighbour is at most (1+eps) times bigger then distance to the true i-th nearest point. Zero means exact search.
+        * @return number of found neighbours. It's less then K only if the tree contains less then K enable points.
+        * @remark does not allocate memory if height of the tree is not too big. Can be called concurrently from several threads.
+        */
+        size_t findKnearestPoints(const TCoord* pointCoordinates, size_t K, KdTreeNeighbour<TCoord, TNorm>* outNeighbours, double eps = 0.0) const
+        {
+            if (!top || K == 0)
+                return 0;
 
-            // Recursive calls. Even root is disabled it can be used as anchor in which part it's better to search
-            if (CmpHelper::IsLess(cmp(KDtree::getCoord(requestPoint, curCoord), root->getCoord(curCoord))))
+            size_t found = 0;
+            if (eps > 0.0)
             {
-                // request point is from the left relative to current root - goto left first, maybe it we will decrease best norm
-                nearestPointInternal(root->left, bestNormSquare, bestNode, requestPoint, nextDepth);
-                TNorm tmpDistanceToSeparatePlane = root->getCoord(curCoord) - KDtree::getCoord(requestPoint, curCoord);
-                TNorm tmpDistanceToSeparatePlaneSqr = tmpDistanceToSeparatePlane*tmpDistanceToSeparatePlane;
-
-                if (tmpDistanceToSeparatePlaneSqr < bestNormSquare)                                      // check that now bestNorm is big enough to check points from other half space
-                    nearestPointInternal(root->right, bestNormSquare, bestNode, requestPoint, nextDepth); // need go to right because also possible we will decrease norm
+                ApproximateCollector<KnearestCollector<KdTreeNeighbour<TCoord, TNorm>>> collector(approximationBoundScale(eps), outNeighbours, K);
+                searchInternal(pointCoordinates, collector);
+                found = collector.finish();
             }
             else
             {
-                // request point is from the right relative to current root - goto right first, maybe we will decrease norm square
-                nearestPointInternal(root->right, bestNormSquare, bestNode, requestPoint, nextDepth);
-                TNorm tmpDistanceToSeparatePlane = root->getCoord(curCoord) - KDtree::getCoord(requestPoint, curCoord);
-                TNorm tmpDistanceToSeparatePlaneSqr = tmpDistanceToSeparatePlane*tmpDistanceToSeparatePlane;
-                if (tmpDistanceToSeparatePlaneSqr < bestNormSquare)                                      // check that now bestNorm is big enough to check points from other half-space
-                    nearestPointInternal(root->left, bestNormSquare, bestNode, requestPoint, nextDepth); // need go to right because also possible we will decrease norm
+                KnearestCollector<KdTreeNeighbour<TCoord, TNorm>> collector(outNeighbours, K);
+                searchInternal(pointCoordinates, collector);
+                found = collector.finish();
             }
+            for (size_t i = 0; i < found; ++i)
+                outNeighbours[i].point = originalPointOf(outNeighbours[i].point);
+            return found;
         }
 
-        /** Typical case complexity ~R + lg(N), worst case ~R+sqrt(N)
-        * @param out container in which founded points will be collected
-        * @param root root of the tree
-        * @param areaRelativeToPlane function 
-        * @param isPointInsideArea test that point is inside user defined area
+        /** Find approximate nearest point to query point by Euclidean (L2) metric with bounded time. Disabled points are skipped.
+        * @param pointCoordinates requested point
+        * @param maxChecks maximum number of visited nodes, i.e. number of computed distances to points of the tree
+        * @return coord of found point and zero if the tree does not contain enable points
+        * @remark best-bin-first search (Beis, Lowe). Postponed subtrees are visited in order of increasing distance to their cells instead of order of backtracking, so the closest bins are checked before the budget is exhausted.
+        * If budget is enough to finish the search result is exact. Is useful for high dimensions where exact search checks the most of points.
         */
-        template<class AreaRelativeToPlane, class IsPointInsideArea, class TContainer>
-        static void rangeSearchInternal(TContainer& out,  KDtreeNode* root, const AreaRelativeToPlane& areaRelativeToPlane,  const IsPointInsideArea& isPointInsideArea, size_t depth)
+        const TCoord* bestBinFirstNearestPointInEuclidianMetric(const TCoord* pointCoordinates, size_t maxChecks) const
         {
-            if (root == nullptr)
-                return;
-            {
-                size_t coord = depth % Dimension;
+            if (!top)
+                return nullptr;
 
-                switch (areaRelativeToPlane(root->pointCoordinates, coord))
-                {
-                case KdTreepPlaneIntersectTest::eAreaInLeft:
-                    rangeSearchInternal(out, root->left, areaRelativeToPlane, isPointInsideArea, depth + 1);
-                    break;
-                case KdTreepPlaneIntersectTest::eAreaInRight:
-                    rangeSearchInternal(out, root->right, areaRelativeToPlane, isPointInsideArea, depth + 1);
-                    break;
-                case KdTreepPlaneIntersectTest::eDontKnow:
-                case KdTreepPlaneIntersectTest::eAreaIntersectsPlane:
-                    if (root->enable && isPointInsideArea(root->pointCoordinates))
-                        out.push_back(root->pointCoordinates);
-                    rangeSearchInternal(out, root->left, areaRelativeToPlane, isPointInsideArea, depth + 1);
-                    rangeSearchInternal(out, root->right, areaRelativeToPlane, isPointInsideArea, depth + 1);
-                    break;
-                }
-            }
+            NearestCollector collector;
+            bestBinFirstSearchInternal(pointCoordinates, maxChecks, collector);
+            return collector.bestNode ? originalPoint(collector.bestNode) : nullptr;
         }
 
-        /**
-        * @param root root of the tree
-        * @param toAppend item you want to append
+        /** Find approximate K nearest points to query point by Euclidean (L2) metric with bounded time. Disabled points are skipped.
+        * @param pointCoordinates requested point
+        * @param K number of requested neighbours
+        * @param outNeighbours buffer for at least K items. It's filled by found neighbours sorted by increasing distance.
+        * @param maxChecks maximum number of visited nodes, i.e. number of computed distances to points of the tree
+        * @return number of found neighbours. It can be less then K if budget is smaller then K.
+        * @sa bestBinFirstNearestPointInEuclidianMetric
         */
-        KDtreeNode* pushInTreeInternal(KDtreeNode* root, KDtreeNode* toAppend, size_t depth)
+        size_t findKnearestPointsBestBinFirst(const TCoord* pointCoordinates, size_t K, KdTreeNeighbour<TCoord, TNorm>* outNeighbours, size_t maxChecks) const
         {
-            if (root == nullptr)  {
-                return toAppend;
-            }
-
-            // Select which coordinate use to do comparision
-            size_t coord = depth % Dimension;
-            int cmpRes = cmp(toAppend->getCoord(coord), root->getCoord(coord));
-
-            if (CmpHelper::IsLess(cmpRes))
-                root->left = pushInTreeInternal(root->left, toAppend, depth + 1);
-            else
-                root->right = pushInTreeInternal(root->right, toAppend, depth + 1);
+            if (!top || K == 0)
+                return 0;
 
-            return root;
+            KnearestCollector<KdTreeNeighbour<TCoord, TNorm>> collector(outNeighbours, K);
+            bestBinFirstSearchInternal(pointCoordinates, maxChecks, collector);
+            size_t found = collector.finish();
+            for (size_t i = 0; i < found; ++i)
+                outNeighbours[i].point = originalPointOf(outNeighbours[i].point);
+            return found;
         }
 
-        template<class F>
-        static KDtreeNode* postOrderNodesTraverse(KDtreeNode* x, const F& f)
-        {
-            if (x == nullptr)
+        /** Find K nearest points to query point by Euclidian (L2) metric
+        * @param outContainer container to which coordinates of found points are appended in order of increasing distance
+        * @param pointCoordinates requested point
+        * @param K upper bound on number of nearest points in which you're interesting in
+        * @param leavePointsAsEnable special flag which can be used in scenario when after search you want temporary disable found other points which are enable in KDTree
+        * @sa findKnearestPoints
+        */
+        template <class TContainer = std::vector<const TCoord*>>
+        void findKnearestPointInEuclidianMetric(TContainer& outContainer, const TCoord* pointCoordinates, size_t K, bool leavePointsAsEnable = true)
+        {
+            if (!top || K == 0)
+                return;
+
+            std::vector<NodeNeighbour> neighbours(K);
+            KnearestCollector<NodeNeighbour> collector(neighbours.data(), K);
+            searchInternal(pointCoordinates, collector);
+            size_t found = collector.finish();
+
+            for (size_t i = 0; i < found; ++i)
+            {
+                KDtreeNode* node = neighbours[i].node;
+                outContainer.push_back(originalPoint(node));
+                if (!leavePointsAsEnable)
+                {
+                    // only enable points are found
+                    node->enable = false;
+                    numDisablePoints++;
+                }
+            }
+        }
+
+        /** Find nearest point for each query of the batch. Queries are processed in parallel by the pool, the tree should not be modified meanwhile.
+        * @param queries matrix of request points of size numQueries x Dimension stored by rows
+        * @param numQueries number of request points
+        * @param outNeighbours array of size numQueries. For each query it's filled by the nearest point and squared distance to it or by {nullptr, max} if there are no enable points.
+        * @param pool pool of threads which processes queries
+        * @param grainSize number of queries processed by one task
+        */
+        void findNearestPointsBatch(const TCoord* queries, size_t numQueries, KdTreeNeighbour<TCoord, TNorm>* outNeighbours,
+                                    WorkStealingTaskPool& pool, size_t grainSize = kDefaultBatchGrainSize) const
+        {
+            forEachQueryRangeInParallel(numQueries, pool, grainSize, [this, queries, outNeighbours](size_t begin, size_t end)
+                                        {
+                                            for (size_t q = begin; q < end; ++q)
+                                            {
+                                                NearestCollector collector;
+                                                if (top)
+                                                    searchInternal(queries + q * Dimension, collector);
+                                                outNeighbours[q].point = collector.bestNode ? originalPoint(collector.bestNode) : nullptr;
+                                                outNeighbours[q].distanceSqr = collector.bestNormSquare;
+                                            }
+                                        });
+        }
+
+        /** Find nearest point for each query of the batch in parallel
+        * @param queries matrix of request points of size numQueries x Dimension stored by rows
+        * @param numQueries number of request points
+        * @param outNeighbours array of size numQueries
+        * @param threadsCount number of threads. Zero means to use number of hardware threads.
+        * @param grainSize number of queries processed by one task
+        * @sa findNearestPointsBatch
+        */
+        void findNearestPointsBatch(const TCoord* queries, size_t numQueries, KdTreeNeighbour<TCoord, TNorm>* outNeighbours,
+                                    size_t threadsCount, size_t grainSize = kDefaultBatchGrainSize) const
+        {
+            WorkStealingTaskPool pool(threadsCount);
+            findNearestPointsBatch(queries, numQueries, outNeighbours, pool, grainSize);
+        }
+
+        /** Find K nearest points for each query of the batch. Queries are processed in parallel by the pool, the tree should not be modified meanwhile.
+        * @param queries matrix of request points of size numQueries x Dimension stored by rows
+        * @param numQueries number of request points
+        * @param K number of requested neighbours
+        * @param outNeighbours matrix of size numQueries x K stored by rows. Each row is sorted by increasing distance. If tree has less then K enable points the tail of the row is filled by {nullptr, max}.
+        * @param pool pool of threads which processes queries
+        * @param grainSize number of queries processed by one task
+        */
+        void findKnearestPointsBatch(const TCoord* queries, size_t numQueries, size_t K, KdTreeNeighbour<TCoord, TNorm>* outNeighbours,
+                                     WorkStealingTaskPool& pool, size_t grainSize = kDefaultBatchGrainSize) const
+        {
+            if (K == 0)
+                return;
+
+            forEachQueryRangeInParallel(numQueries, pool, grainSize, [this, queries, K, outNeighbours](size_t begin, size_t end)
+                                        {
+                                            for (size_t q = begin; q < end; ++q)
+                                            {
+                                                KdTreeNeighbour<TCoord, TNorm>* row = outNeighbours + q * K;
+                                                for (size_t i = findKnearestPoints(queries + q * Dimension, K, row); i < K; ++i)
+                                                {
+                                                    row[i].point = nullptr;
+                                                    row[i].distanceSqr = std::numeric_limits<TNorm>::max();
+                                                }
+                                            }
+                                        });
+        }
+
+        /** Find K nearest points for each query of the batch in parallel
+        * @param queries matrix of request points of size numQueries x Dimension stored by rows
+        * @param numQueries number of request points
+        * @param K number of requested neighbours
+        * @param outNeighbours matrix of size numQueries x K stored by rows
+        * @param threadsCount number of threads. Zero means to use number of hardware threads.
+        * @param grainSize number of queries processed by one task
+        * @sa findKnearestPointsBatch
+        */
+        void findKnearestPointsBatch(const TCoord* queries, size_t numQueries, size_t K, KdTreeNeighbour<TCoord, TNorm>* outNeighbours,
+                                     size_t threadsCount, size_t grainSize = kDefaultBatchGrainSize) const
+        {
+            WorkStealingTaskPool pool(threadsCount);
+            findKnearestPointsBatch(queries, numQueries, K, outNeighbours, pool, grainSize);
+        }
+
+        /** Build graph of K nearest neighbours for all enable points of the tree. Point is not a neighbour of itself. The tree should not be modified meanwhile.
+        * @param K number of neighbours of each point. Vertex has less neighbours only if the tree contains less then K + 1 enable points.
+        * @param outGraph result. Vertices are enable points of the tree in preorder of nodes.
+        * @param pool pool of threads which processes groups of queries
+        * @param groupSize maximum number of points in the group of queries
+        * @remark Dual-tree traversal (Gray, Moore) in which query side is cut into subtrees of at most groupSize points. Each group walks the tree once, reference subtree is skipped
+        * if distance between bounding boxes of the group and of the subtree is not less then the largest K-th distance in the group.
+        */
+        void buildKnearestNeighboursGraph(size_t K, KdTreeKnnGraph<TCoord, TNorm>& outGraph, WorkStealingTaskPool& pool, size_t groupSize = kDefaultKnnGraphGroupSize) const
+        {
+            outGraph.vertices.clear();
+            outGraph.rowOffsets.assign(1, size_t(0));
+            outGraph.neighbours.clear();
+            outGraph.distancesSqr.clear();
+            if (!top)
+                return;
+
+            FlattenedTree flat;
+            flattenTree(flat);
+            size_t numNodes = flat.nodes.size();
+
+            std::vector<size_t> vertexOfNode(numNodes, size_t(kNoNode));
+            for (size_t i = 0; i < numNodes; ++i)
+            {
+                if (flat.nodes[i]->enable)
+                {
+                    vertexOfNode[i] = outGraph.vertices.size();
+                    outGraph.vertices.push_back(originalPoint(flat.nodes[i]));
+                }
+            }
+
+            if (K == 0)
+            {
+                outGraph.rowOffsets.assign(outGraph.vertices.size() + 1, size_t(0));
+                return;
+            }
+
+            std::vector<std::pair<size_t, size_t>> groups;
+            splitIntoQueryGroups(flat, groupSize, groups);
+
+            std::vector<IndexNeighbour> heaps(numNodes * K);
+            std::vector<size_t> heapSizes(numNodes, size_t(0));
+            size_t groupsPerTask = std::max(size_t(1), kDefaultBatchGrainSize / groupSize);
+
+            forEachQueryRangeInParallel(groups.size(), pool, groupsPerTask, [this, &flat, &groups, &heaps, &heapSizes, K](size_t begin, size_t end)
+                                        {
+                                            for (size_t g = begin; g < end; ++g)
+                                                knearestForQueryGroup(flat, groups[g].first, groups[g].second, flat, true, K, heaps.data(), heapSizes.data());
+                                        });
+
+            outGraph.rowOffsets.reserve(outGraph.vertices.size() + 1);
+            for (size_t i = 0; i < numNodes; ++i)
+            {
+                if (vertexOfNode[i] == kNoNode)
+                    continue;
+
+                IndexNeighbour* heap = &heaps[i * K];
+                std::sort_heap(heap, heap + heapSizes[i], isCloserIndexNeighbour);
+                for (size_t j = 0; j < heapSizes[i]; ++j)
+                {
+                    outGraph.neighbours.push_back(vertexOfNode[heap[j].index]);
+                    outGraph.distancesSqr.push_back(heap[j].distanceSqr);
+                }
+                outGraph.rowOffsets.push_back(outGraph.neighbours.size());
+            }
+        }
+
+        /** Build graph of K nearest neighbours for all enable points of the tree in parallel
+        * @param K number of neighbours of each point
+        * @param outGraph result
+        * @param threadsCount number of threads. Zero means to use number of hardware threads.
+        * @param groupSize maximum number of points in the group of queries
+        * @sa buildKnearestNeighboursGraph
+        */
+        void buildKnearestNeighboursGraph(size_t K, KdTreeKnnGraph<TCoord, TNorm>& outGraph, size_t threadsCount, size_t groupSize = kDefaultKnnGraphGroupSize) const
+        {
+            WorkStealingTaskPool pool(threadsCount);
+            buildKnearestNeighboursGraph(K, outGraph, pool, groupSize);
+        }
+
+        /** Find all pairs of enable points from this tree and other tree with distance not bigger then radius. Both trees are traversed at once and pair of subtrees is skipped if distance between their bounding boxes is bigger then radius.
+        * @param other second tree. Can be the same as this tree, then each pair of different points is reported twice and each point is reported with itself.
+        * @param radius maximum distance between points of the pair
+        * @param callback function which is called as callback(const TCoord* pointOfThis, const TCoord* pointOfOther, TNorm distanceSqr) for each found pair
+        */
+        template <class Callback>
+        void joinWithinRadius(const KDtree& other, TNorm radius, const Callback& callback) const
+        {
+            if (!top || !other.top)
+                return;
+
+            FlattenedTree a;
+            FlattenedTree b;
+            flattenTree(a);
+            other.flattenTree(b);
+            TNorm radiusSqr = metric.fromDistance(radius);
+
+            // pairs of subtrees (i, j) for which all pairs of points from A[i] x B[j] should be checked
+            SmallStack<std::pair<size_t, size_t>> pending;
+            pending.push(std::make_pair(size_t(0), size_t(0)));
+            while (!pending.empty())
+            {
+                std::pair<size_t, size_t> item = pending.pop();
+                size_t i = item.first;
+                size_t j = item.second;
+                if (boxesDistance(&a.boxMin[i * Dimension], &a.boxMax[i * Dimension], &b.boxMin[j * Dimension], &b.boxMax[j * Dimension]) > radiusSqr)
+                    continue;
+
+                // A[i] x B[j] = (a x b) + (a x children of B[j]) + (children of A[i] x b) + (children of A[i] x children of B[j])
+                KDtreeNode* pointA = a.nodes[i];
+                KDtreeNode* pointB = b.nodes[j];
+                size_t childrenA[] = {a.leftChild[i], a.rightChild[i]};
+                size_t childrenB[] = {b.leftChild[j], b.rightChild[j]};
+
+                if (pointA->enable && pointB->enable)
+                {
+                    TNorm distanceSqr = metric.distance(pointA->pointCoordinates, pointB->pointCoordinates);
+                    if (distanceSqr <= radiusSqr)
+                        callback(originalPoint(pointA), other.originalPoint(pointB), distanceSqr);
+                }
+
+                for (size_t k = 0; k < 2; ++k)
+                {
+                    if (pointA->enable && childrenB[k] != kNoNode)
+                    {
+                        const TCoord* originalA = originalPoint(pointA);
+                        forEachNodeInBall(b, childrenB[k], pointA->pointCoordinates, radiusSqr,
+                                          [&](KDtreeNode* node, TNorm distanceSqr) { callback(originalA, other.originalPoint(node), distanceSqr); });
+                    }
+
+                    if (pointB->enable && childrenA[k] != kNoNode)
+                    {
+                        const TCoord* originalB = other.originalPoint(pointB);
+                        forEachNodeInBall(a, childrenA[k], pointB->pointCoordinates, radiusSqr,
+                                          [&](KDtreeNode* node, TNorm distanceSqr) { callback(originalPoint(node), originalB, distanceSqr); });
+                    }
+                }
+
+                for (size_t ka = 0; ka < 2; ++ka)
+                {
+                    for (size_t kb = 0; kb < 2; ++kb)
+                    {
+                        if (childrenA[ka] != kNoNode && childrenB[kb] != kNoNode)
+                            pending.push(std::make_pair(childrenA[ka], childrenB[kb]));
+                    }
+                }
+            }
+        }
+
+        /** Find for each enable point of this tree the nearest enable point of other tree. Points of this tree are processed by groups of nearby points which traverse other tree once with shared pruning bound.
+        * @param other tree in which nearest points are searched
+        * @param callback function which is called as callback(const TCoord* pointOfThis, const TCoord* nearestPointOfOther, TNorm distanceSqr) for each enable point of this tree in preorder of nodes.
+        * If other tree does not contain enable points it's called with nullptr and maximum value of TNorm.
+        * @param groupSize maximum number of points in the group of queries
+        */
+        template <class Callback>
+        void joinNearest(const KDtree& other, const Callback& callback, size_t groupSize = kDefaultJoinGroupSize) const
+        {
+            if (!top)
+                return;
+
+            FlattenedTree queries;
+            FlattenedTree references;
+            flattenTree(queries);
+            other.flattenTree(references);
+
+            size_t numQueries = queries.nodes.size();
+            std::vector<IndexNeighbour> nearest(numQueries);
+            std::vector<size_t> found(numQueries, size_t(0));
+            if (!references.nodes.empty())
+            {
+                std::vector<std::pair<size_t, size_t>> groups;
+                splitIntoQueryGroups(queries, groupSize, groups);
+                for (size_t g = 0; g < groups.size(); ++g)
+                    knearestForQueryGroup(queries, groups[g].first, groups[g].second, references, false, 1, nearest.data(), found.data());
+            }
+
+            for (size_t i = 0; i < numQueries; ++i)
+            {
+                if (!queries.nodes[i]->enable)
+                    continue;
+                if (found[i])
+                    callback(originalPoint(queries.nodes[i]), other.originalPoint(references.nodes[nearest[i].index]), nearest[i].distanceSqr);
+                else
+                    callback(originalPoint(queries.nodes[i]), static_cast<const TCoord*>(nullptr), std::numeric_limits<TNorm>::max());
+            }
+        }
+
+        /** Generator of enable points of the tree in order of increasing distance to the request point (Hjaltason, Samet).
+        * Subtrees and points are kept in one priority queue by lower bound of distance, so the next point is produced only when it's requested.
+        * Tree is not modified by the search, but it should not be modified while the object is used.
+        */
+        class IncrementalNearestSearch
+        {
+        public:
+            /** Ctor. Search does not start until the first call of next().
+            * @param kdTree tree in which search is carried out
+            * @param pointCoordinates requested point. Coordinates are copied.
+            */
+            IncrementalNearestSearch(const KDtree& kdTree, const TCoord* pointCoordinates)
+            : tree(&kdTree)
+            {
+                for (size_t i = 0; i < Dimension; ++i)
+                    request[i] = pointCoordinates[i];
+
+                if (tree->top)
+                {
+                    QueueItem root = {tree->top, TNorm(), false};
+                    queue.push_back(root);
+                }
+            }
+
+            /** Get the next nearest point
+            * @param outNeighbour next point and squared distance to it. Distances of produced points are not decreasing.
+            * @return false if all enable points have been produced
+            * @remark amortized time of one call is ~lg(N) for uniformly distributed points
+            */
+            bool next(KdTreeNeighbour<TCoord, TNorm>& outNeighbour)
+            {
+                while (!queue.empty())
+                {
+                    std::pop_heap(queue.begin(), queue.end(), isFartherItem);
+                    QueueItem item = queue.back();
+                    queue.pop_back();
+
+                    if (item.isPoint)
+                    {
+                        outNeighbour.point = tree->originalPoint(item.node);
+                        outNeighbour.distanceSqr = item.bound;
+                        return true;
+                    }
+
+                    // descend to the closer child directly, it has the same bound as the subtree
+                    for (KDtreeNode* node = item.node; node; )
+                    {
+                        if (node->enable)
+                            push(node, tree->metric.distance(request, node->pointCoordinates), true);
+
+                        size_t curCoord = node->splitAxis;
+                        TNorm tmpDistanceToSeparatePlane = TNorm(node->splitValue) - TNorm(request[curCoord]);
+                        TNorm farBound = std::max(item.bound, tree->metric.axisDistance(tmpDistanceToSeparatePlane, curCoord));
+
+                        KDtreeNode* farSubtree = nullptr;
+                        if (CmpHelper::IsLess(tree->cmp(request[curCoord], node->splitValue)))
+                        {
+                            farSubtree = node->right;
+                            node = node->left;
+                        }
+                        else
+                        {
+                            farSubtree = node->left;
+                            node = node->right;
+                        }
+
+                        if (farSubtree)
+                            push(farSubtree, farBound, false);
+                    }
+                }
+                return false;
+            }
+
+        private:
+            /** Postponed subtree or found point
+            */
+            struct QueueItem
+            {
+                KDtreeNode* node; ///< root of subtree or node with point
+                TNorm bound;      ///< lower bound of distance to points of subtree or exact squared distance to point
+                bool isPoint;     ///< item is a point
+            };
+
+            /** Order for min-heap. Point goes before subtree with the same bound.
+            */
+            static bool isFartherItem(const QueueItem& a, const QueueItem& b) {
+                return a.bound > b.bound || (a.bound == b.bound && !a.isPoint && b.isPoint);
+            }
+
+            void push(KDtreeNode* node, TNorm bound, bool isPoint)
+            {
+                QueueItem item = {node, bound, isPoint};
+                queue.push_back(item);
+                std::push_heap(queue.begin(), queue.end(), isFartherItem);
+            }
+
+            const KDtree* tree;            ///< tree in which search is carried out
+            TCoord request[Dimension];     ///< requested point
+            std::vector<QueueItem> queue;  ///< min-heap of postponed subtrees and points
+        };
+
+        /** Start incremental search of nearest points
+        * @param pointCoordinates requested point
+        * @return generator of points in order of increasing distance
+        * @sa IncrementalNearestSearch
+        */
+        IncrementalNearestSearch incrementalNearestSearch(const TCoord* pointCoordinates) const {
+            return IncrementalNearestSearch(*this, pointCoordinates);
+        }
+
+    protected:
+        /** Node of the tree together with squared distance to it
+        */
+        struct NodeNeighbour
+        {
+            KDtreeNode* node; ///< found node
+            TNorm distanceSqr; ///< squared distance from request point
+        };
+
+        /** Keep the closest node. Interface of collector for searchInternal():
+        * 1. "TNorm pruneBound() const" - subtrees for which squared distance to request point is not less then this value are skipped. Value should never grow during the search.
+        * 2. "void offer(KDtreeNode* node, TNorm distanceSqr)" - visit enable node.
+        * 3. "TNorm acceptBound() const" - offer() ignores nodes for which squared distance is not less then this value, so evaluation of distance can be stopped when it reaches the bound. See boundedDistance in KdTreeMetrics.h.
+        */
+        struct NearestCollector
+        {
+            /** Ctor
+            * @param distanceSqrBound only nodes with squared distance less then it are accepted
+            */
+            explicit NearestCollector(TNorm distanceSqrBound = std::numeric_limits<TNorm>::max())
+            : bestNode(nullptr)
+            , bestNormSquare(distanceSqrBound)
+            {}
+
+            TNorm pruneBound() const {
+                return bestNormSquare;
+            }
+
+            TNorm acceptBound() const {
+                return bestNormSquare;
+            }
+
+            void offer(KDtreeNode* node, TNorm distanceSqr)
+            {
+                if (distanceSqr < bestNormSquare)
+                {
+                    bestNormSquare = distanceSqr;
+                    bestNode = node;
+                }
+            }
+
+            KDtreeNode* bestNode;  ///< closest node or nullptr
+            TNorm bestNormSquare;  ///< squared distance to the closest node
+        };
+
+        /** Keep K closest nodes in max-heap with the farthest node on top
+        */
+        template <class Neighbour>
+        struct KnearestCollector
+        {
+            KnearestCollector(Neighbour* heapBuffer, size_t K)
+            : heap(heapBuffer)
+            , capacity(K)
+            , count(0)
+            {}
+
+            TNorm pruneBound() const {
+                return count < capacity ? std::numeric_limits<TNorm>::max() : heap[0].distanceSqr;
+            }
+
+            TNorm acceptBound() const {
+                return pruneBound();
+            }
+
+            void offer(KDtreeNode* node, TNorm distanceSqr)
+            {
+                if (count < capacity)
+                {
+                    assign(heap[count], node, distanceSqr);
+                    count++;
+                    std::push_heap(heap, heap + count, isCloser);
+                }
+                else if (distanceSqr < heap[0].distanceSqr)
+                {
+                    std::pop_heap(heap, heap + count, isCloser);
+                    assign(heap[count - 1], node, distanceSqr);
+                    std::push_heap(heap, heap + count, isCloser);
+                }
+            }
+
+            /** Sort found neighbours by increasing distance
+            * @return number of found neighbours
+            */
+            size_t finish()
+            {
+                std::sort_heap(heap, heap + count, isCloser);
+                return count;
+            }
+
+            static bool isCloser(const Neighbour& a, const Neighbour& b) {
+                return a.distanceSqr < b.distanceSqr;
+            }
+
+            static void assign(NodeNeighbour& out, KDtreeNode* node, TNorm distanceSqr)
+            {
+                out.node = node;
+                out.distanceSqr = distanceSqr;
+            }
+
+            static void assign(KdTreeNeighbour<TCoord, TNorm>& out, KDtreeNode* node, TNorm distanceSqr)
+            {
+                out.point = node->pointCoordinates;
+                out.distanceSqr = distanceSqr;
+            }
+
+            Neighbour* heap;  ///< buffer of the caller
+            size_t capacity;  ///< K
+            size_t count;     ///< number of items in the heap
+        };
+
+        /** Get factor by which bound for pruning is multiplied in approximate search
+        * @param eps allowed relative error of the distance
+        * @return 1/(1+eps)^2 for L2 metric and in general inverse of reduced distance for true distance 1+eps
+        */
+        double approximationBoundScale(double eps) const {
+            return 1.0 / metric.fromDistance(1.0 + eps);
+        }
+
+        /** Shrink bound for pruning of the base collector. Subtree is skipped if it's farther then current bound divided by (1+eps), so found distances are at most (1+eps) times bigger then the exact ones.
+        * Bound for acceptance of visited nodes is not scaled.
+        */
+        template <class BaseCollector>
+        struct ApproximateCollector : public BaseCollector
+        {
+            /** Ctor
+            * @param scale factor for the bound of base collector. See approximationBoundScale().
+            * @param args arguments for ctor of base collector
+            */
+            template <class... Args>
+            explicit ApproximateCollector(double scale, Args&&... args)
+            : BaseCollector(std::forward<Args>(args)...)
+            , boundScale(scale)
+            {}
+
+            TNorm pruneBound() const
+            {
+                TNorm bound = BaseCollector::pruneBound();
+                if (bound == std::numeric_limits<TNorm>::max())
+                    return bound;
+                // for integer norms rounding up keeps exactly the same set of visited subtrees as comparison in real numbers
+                double scaled = double(bound) * boundScale;
+                return std::numeric_limits<TNorm>::is_integer ? TNorm(ceil(scaled)) : TNorm(scaled);
+            }
+
+            double boundScale; ///< 1/(1+eps)^2 for L2 metric
+        };
+
+        /** Get the smallest value of the norm which is bigger then value. Subtrees with bound less then it can contain points at distance equal to value.
+        */
+        static TNorm nextNormAbove(TNorm value)
+        {
+            if (value == std::numeric_limits<TNorm>::max())
+                return value;
+            return std::numeric_limits<TNorm>::is_integer ? TNorm(value + 1) : TNorm(nextafter(value, std::numeric_limits<TNorm>::max()));
+        }
+
+        /** Append all enable points inside the ball to the container of the caller
+        */
+        template <class TContainer>
+        struct RadiusCollector
+        {
+            RadiusCollector(const KDtree& kdTree, TContainer& outContainer, TNorm radiusSqr, size_t maxResults)
+            : tree(kdTree)
+            , out(outContainer)
+            , radiusSquare(radiusSqr)
+            , visitBound(nextNormAbove(radiusSqr))
+            , capacity(maxResults)
+            , count(0)
+            {}
+
+            TNorm pruneBound() const {
+                return count < capacity ? visitBound : TNorm();
+            }
+
+            TNorm acceptBound() const {
+                return pruneBound();
+            }
+
+            void offer(KDtreeNode* node, TNorm distanceSqr)
+            {
+                if (distanceSqr <= radiusSquare && count < capacity)
+                {
+                    KdTreeNeighbour<TCoord, TNorm> neighbour;
+                    neighbour.point = tree.originalPoint(node);
+                    neighbour.distanceSqr = distanceSqr;
+                    out.push_back(neighbour);
+                    count++;
+                }
+            }
+
+            const KDtree& tree;  ///< tree in which search is carried out
+            TContainer& out;     ///< container of the caller
+            TNorm radiusSquare;  ///< squared radius of the ball
+            TNorm visitBound;    ///< subtrees with bound less then it intersect the ball
+            size_t capacity;     ///< maximum number of appended points
+            size_t count;        ///< number of appended points
+        };
+
+        /** Offer to the base collector only nodes inside the ball and do not visit subtrees which are farther then radius
+        */
+        template <class BaseCollector>
+        struct WithinRadiusCollector : public BaseCollector
+        {
+            template <class... Args>
+            explicit WithinRadiusCollector(TNorm radiusSqr, Args&&... args)
+            : BaseCollector(std::forward<Args>(args)...)
+            , radiusSquare(radiusSqr)
+            , visitBound(nextNormAbove(radiusSqr))
+            {}
+
+            TNorm pruneBound() const {
+                return std::min(BaseCollector::pruneBound(), visitBound);
+            }
+
+            TNorm acceptBound() const {
+                return std::min(BaseCollector::acceptBound(), visitBound);
+            }
+
+            void offer(KDtreeNode* node, TNorm distanceSqr)
+            {
+                if (distanceSqr <= radiusSquare)
+                    BaseCollector::offer(node, distanceSqr);
+            }
+
+            TNorm radiusSquare; ///< squared radius of the ball
+            TNorm visitBound;   ///< subtrees with bound less then it intersect the ball
+        };
+
+        /** Split range of queries [0, numQueries) into pieces of grainSize and process them by tasks of the pool
+        * @param f function which is called as f(begin, end) for each piece
+        * @remark returns when all pieces are processed
+        */
+        template <class F>
+        static void forEachQueryRangeInParallel(size_t numQueries, WorkStealingTaskPool& pool, size_t grainSize, const F& f)
+        {
+            if (grainSize == 0)
+                grainSize = 1;
+
+            if (numQueries <= grainSize)
+            {
+                f(size_t(0), numQueries);
+                return;
+            }
+
+            TaskGroup group(pool);
+            for (size_t begin = 0; begin < numQueries; begin += grainSize)
+            {
+                size_t end = std::min(numQueries, begin + grainSize);
+                group.run([&f, begin, end]() { f(begin, end); });
+            }
+            group.wait();
+        }
+
+        /** Visit nodes of the tree in order of going to the request point with pruning. Subtrees which are postponed for later visit are kept in explicit stack together with squared distance to their cells.
+        * @param requestPoint requested point
+        * @param collector object which accumulates result of the search and defines bound for pruning
+        */
+        template <class Collector>
+        void searchInternal(const TCoord* requestPoint, Collector& collector) const {
+            searchInternal(top, requestPoint, collector);
+        }
+
+        /** Relative error of squared distance to the cell which is evaluated incrementally in floating point.
+        * Each update changes the distance by non negative value which is not bigger then the new distance, so it adds at most 2*epsilon relative error and this value covers millions of updates along the path.
+        */
+        static TNorm cellDistanceRelativeError() {
+            return std::numeric_limits<TNorm>::is_integer ? TNorm() : TNorm(sqrt(double(std::numeric_limits<TNorm>::epsilon())));
+        }
+
+        /** Lower bound of squared distance to the cell which is safe against rounding of incremental updates of the distance
+        * @param cellDistance squared distance to the cell evaluated incrementally
+        * @param axisTerm squared distance to the split plane which bounds the cell
+        */
+        static TNorm cellPruneBound(TNorm cellDistance, TNorm axisTerm)
+        {
+            if (std::numeric_limits<TNorm>::is_integer)
+                return cellDistance;
+            return std::max(axisTerm, TNorm(cellDistance - cellDistance * cellDistanceRelativeError()));
+        }
+
+        /** Visit nodes of subtree in order of going to the request point with pruning.
+        * Distance from request point to the cell of subtree is maintained incrementally (Arya and Mount): per axis term of the distance is kept in array and moving into the far child replaces only the term by its split axis.
+        * Changes of terms are recorded in undo log, so when postponed subtree is taken from the stack the terms of its cell are restored in O(1) amortized time.
+        * @param root root of subtree from which search starts. Its cell is considered as the whole space.
+        * @param requestPoint requested point
+        * @param collector object which accumulates result of the search and defines bound for pruning
+        */
+        template <class Collector>
+        void searchInternal(KDtreeNode* root, const TCoord* requestPoint, Collector& collector) const
+        {
+            SmallStack<CellWithBound> pending;
+            SmallStack<AxisTerm> undoLog;
+            TNorm axisTerms[Dimension] = {}; // terms of distance to the current cell by each axis
+            TNorm cellDistance = TNorm();    // distance to the current cell
+            KDtreeNode* node = root;
+
+            for (;;)
+            {
+                while (node)
+                {
+                    // Only enable nodes are offered
+                    if (node->enable)
+                        collector.offer(node, kdTreeBoundedDistance(metric, requestPoint, node->pointCoordinates, collector.acceptBound()));
+
+                    // Even node is disabled it can be used as anchor in which part it's better to search
+                    size_t curCoord = node->splitAxis;
+                    TNorm tmpDistanceToSeparatePlane = TNorm(node->splitValue) - TNorm(KDtree::getCoord(requestPoint, curCoord));
+                    CellWithBound farSubtree;
+                    farSubtree.axis = curCoord;
+                    farSubtree.axisTerm = metric.axisDistance(tmpDistanceToSeparatePlane, curCoord);
+
+                    if (CmpHelper::IsLess(cmp(KDtree::getCoord(requestPoint, curCoord), node->splitValue)))
+                    {
+                        // request point is from the left relative to current node - goto left first, maybe it we will decrease best norm
+                        farSubtree.node = node->right;
+                        node = node->left;
+                    }
+                    else
+                    {
+                        // request point is from the right relative to current node - goto right first, maybe we will decrease norm square
+                        farSubtree.node = node->left;
+                        node = node->right;
+                    }
+
+                    // cell of the near child has the same distance, bound of collector never grows, so subtree which can not be visited later is not postponed
+                    if (farSubtree.node)
+                    {
+                        farSubtree.cellDistance = kdTreeReplaceAxisDistance(metric, cellDistance, axisTerms[curCoord], farSubtree.axisTerm);
+                        farSubtree.bound = cellPruneBound(farSubtree.cellDistance, farSubtree.axisTerm);
+                        if (farSubtree.bound < collector.pruneBound())
+                        {
+                            farSubtree.undoSize = undoLog.size();
+                            pending.push(farSubtree);
+                        }
+                    }
+                }
+
+                // check that now bound is big enough to check points from other half space
+                do
+                {
+                    if (pending.empty())
+                        return;
+                    CellWithBound next = pending.pop();
+                    if (next.bound < collector.pruneBound())
+                    {
+                        // restore terms of the cell of the parent and move its side by the split axis
+                        while (undoLog.size() > next.undoSize)
+                        {
+                            AxisTerm previous = undoLog.pop();
+                            axisTerms[previous.axis] = previous.term;
+                        }
+                        AxisTerm previous;
+                        previous.axis = next.axis;
+                        previous.term = axisTerms[next.axis];
+                        undoLog.push(previous);
+                        axisTerms[next.axis] = next.axisTerm;
+                        cellDistance = next.cellDistance;
+                        node = next.node;
+                    }
+                } while (!node);
+            }
+        }
+
+        /** Order for min-heap of postponed subtrees: subtree with the smallest bound is on top
+        */
+        static bool isFartherSubtree(const NodeWithBound& a, const NodeWithBound& b) {
+            return a.bound > b.bound;
+        }
+
+        /** Visit nodes of the tree with best-bin-first strategy. Descend from the closest postponed subtree to the leaf, far children on the path are postponed in priority queue.
+        * @param requestPoint requested point
+        * @param maxChecks maximum number of visited nodes
+        * @param collector object which accumulates result of the search and defines bound for pruning
+        * @return number of visited nodes
+        * @remark bound of subtree is max of bound of the parent cell and squared distance to the split plane. It's lower bound for distance to any point of the subtree.
+        */
+        template <class Collector>
+        size_t bestBinFirstSearchInternal(const TCoord* requestPoint, size_t maxChecks, Collector& collector) const
+        {
+            std::vector<NodeWithBound> pending;
+            pending.reserve(std::min(maxChecks, numPoints) + 1);
+
+            NodeWithBound root;
+            root.node = top;
+            root.bound = TNorm();
+            pending.push_back(root);
+
+            size_t checks = 0;
+            while (!pending.empty() && checks < maxChecks)
+            {
+                std::pop_heap(pending.begin(), pending.end(), isFartherSubtree);
+                NodeWithBound closest = pending.back();
+                pending.pop_back();
+
+                // all remaining subtrees are not closer
+                if (!(closest.bound < collector.pruneBound()))
+                    break;
+
+                for (KDtreeNode* node = closest.node; node && checks < maxChecks; )
+                {
+                    checks++;
+                    if (node->enable)
+                        collector.offer(node, kdTreeBoundedDistance(metric, requestPoint, node->pointCoordinates, collector.acceptBound()));
+
+                    size_t curCoord = node->splitAxis;
+                    TNorm tmpDistanceToSeparatePlane = TNorm(node->splitValue) - TNorm(KDtree::getCoord(requestPoint, curCoord));
+                    NodeWithBound farSubtree;
+                    farSubtree.bound = std::max(closest.bound, metric.axisDistance(tmpDistanceToSeparatePlane, curCoord));
+
+                    if (CmpHelper::IsLess(cmp(KDtree::getCoord(requestPoint, curCoord), node->splitValue)))
+                    {
+                        farSubtree.node = node->right;
+                        node = node->left;
+                    }
+                    else
+                    {
+                        farSubtree.node = node->left;
+                        node = node->right;
+                    }
+
+                    if (farSubtree.node && farSubtree.bound < collector.pruneBound())
+                    {
+                        pending.push_back(farSubtree);
+                        std::push_heap(pending.begin(), pending.end(), isFartherSubtree);
+                    }
+                }
+            }
+
+            return checks;
+        }
+
+        static const size_t kNoNode = size_t(-1); ///< Marker of absent node in FlattenedTree
+
+        /** Copy of the tree structure in arrays in preorder of nodes. Subtree of node i occupies [i, subtreeEnd[i]).
+        */
+        struct FlattenedTree
+        {
+            std::vector<KDtreeNode*> nodes;   ///< nodes in preorder
+            std::vector<size_t> leftChild;    ///< index of the left child or kNoNode
+            std::vector<size_t> rightChild;   ///< index of the right child or kNoNode
+            std::vector<size_t> subtreeEnd;   ///< index after the last node of the subtree
+            std::vector<TCoord> boxMin;       ///< minimum coordinates of points of the subtree, Dimension items per node
+            std::vector<TCoord> boxMax;       ///< maximum coordinates of points of the subtree, Dimension items per node
+        };
+
+        /** Neighbour which is referenced by index of node in FlattenedTree
+        */
+        struct IndexNeighbour
+        {
+            size_t index;      ///< index of the node
+            TNorm distanceSqr; ///< squared distance from request point
+        };
+
+        static bool isCloserIndexNeighbour(const IndexNeighbour& a, const IndexNeighbour& b) {
+            return a.distanceSqr < b.distanceSqr;
+        }
+
+        /** Fill arrays of FlattenedTree and compute bounding boxes of all subtrees. Time is ~N*Dimension.
+        */
+        void flattenTree(FlattenedTree& flat) const
+        {
+            flat.nodes.clear();
+            flat.leftChild.clear();
+            flat.rightChild.clear();
+            if (!top)
+                return;
+
+            flat.nodes.reserve(numPoints);
+            flat.leftChild.reserve(numPoints);
+            flat.rightChild.reserve(numPoints);
+
+            struct PendingNode
+            {
+                KDtreeNode* node;  ///< node without index
+                size_t parent;     ///< index of the parent or kNoNode for root
+                bool isRightChild; ///< node is the right child of the parent
+            };
+
+            SmallStack<PendingNode> pending;
+            PendingNode root = {top, kNoNode, false};
+            pending.push(root);
+            while (!pending.empty())
+            {
+                PendingNode item = pending.pop();
+                size_t index = flat.nodes.size();
+                flat.nodes.push_back(item.node);
+                flat.leftChild.push_back(size_t(kNoNode));
+                flat.rightChild.push_back(size_t(kNoNode));
+                if (item.parent != kNoNode)
+                    (item.isRightChild ? flat.rightChild : flat.leftChild)[item.parent] = index;
+
+                if (item.node->right)
+                {
+                    PendingNode right = {item.node->right, index, true};
+                    pending.push(right);
+                }
+                if (item.node->left)
+                {
+                    PendingNode left = {item.node->left, index, false};
+                    pending.push(left);
+                }
+            }
+
+            // children have bigger indices then parent
+            size_t numNodes = flat.nodes.size();
+            flat.subtreeEnd.resize(numNodes);
+            flat.boxMin.resize(numNodes * Dimension);
+            flat.boxMax.resize(numNodes * Dimension);
+            for (size_t i = numNodes; i-- > 0; )
+            {
+                TCoord* lo = &flat.boxMin[i * Dimension];
+                TCoord* hi = &flat.boxMax[i * Dimension];
+                const TCoord* p = flat.nodes[i]->pointCoordinates;
+                for (size_t c = 0; c < Dimension; ++c)
+                    lo[c] = hi[c] = p[c];
+
+                size_t children[] = {flat.leftChild[i], flat.rightChild[i]};
+                flat.subtreeEnd[i] = i + 1;
+                for (size_t k = 0; k < 2; ++k)
+                {
+                    size_t child = children[k];
+                    if (child == kNoNode)
+                        continue;
+                    flat.subtreeEnd[i] = flat.subtreeEnd[child];
+                    for (size_t c = 0; c < Dimension; ++c)
+                    {
+                        lo[c] = std::min(lo[c], flat.boxMin[child * Dimension + c]);
+                        hi[c] = std::max(hi[c], flat.boxMax[child * Dimension + c]);
+                    }
+                }
+            }
+        }
+
+        /** Get reduced distance of the metric between two axis aligned boxes
+        */
+        TNorm boxesDistance(const TCoord* aMin, const TCoord* aMax, const TCoord* bMin, const TCoord* bMax) const
+        {
+            TNorm distance = TNorm();
+            for (size_t c = 0; c < Dimension; ++c)
+            {
+                TNorm gap = TNorm();
+                if (bMin[c] > aMax[c])
+                    gap = TNorm(bMin[c]) - TNorm(aMax[c]);
+                else if (aMin[c] > bMax[c])
+                    gap = TNorm(aMin[c]) - TNorm(bMax[c]);
+                distance = metric.accumulate(distance, metric.axisDistance(gap, c));
+            }
+            return distance;
+        }
+
+        /** Split flattened tree into groups of queries. Groups are whole subtrees of at most groupSize nodes, nodes above them form groups from one node.
+        * @param groups ranges of indices [first, second) of nodes in groups
+        */
+        static void splitIntoQueryGroups(const FlattenedTree& flat, size_t groupSize, std::vector<std::pair<size_t, size_t>>& groups)
+        {
+            groups.clear();
+            if (flat.nodes.empty())
+                return;
+            if (groupSize == 0)
+                groupSize = 1;
+
+            SmallStack<size_t> pending;
+            pending.push(0);
+            while (!pending.empty())
+            {
+                size_t i = pending.pop();
+                if (flat.subtreeEnd[i] - i <= groupSize)
+                {
+                    groups.push_back(std::make_pair(i, flat.subtreeEnd[i]));
+                    continue;
+                }
+                groups.push_back(std::make_pair(i, i + 1));
+                if (flat.rightChild[i] != kNoNode)
+                    pending.push(flat.rightChild[i]);
+                if (flat.leftChild[i] != kNoNode)
+                    pending.push(flat.leftChild[i]);
+            }
+        }
+
+        /** Get reduced distance of the metric from point to axis aligned box
+        */
+        TNorm pointBoxDistance(const TCoord* point, const TCoord* boxMin, const TCoord* boxMax) const
+        {
+            return boxesDistance(point, point, boxMin, boxMax);
+        }
+
+        /** Visit enable nodes of subtree of flattened tree which lie inside the ball. Subtrees are skipped by their bounding boxes.
+        * @param f function which is called as f(KDtreeNode* node, TNorm distanceSqr)
+        */
+        template <class F>
+        void forEachNodeInBall(const FlattenedTree& flat, size_t root, const TCoord* center, TNorm radiusSqr, const F& f) const
+        {
+            SmallStack<size_t> pending;
+            pending.push(root);
+            while (!pending.empty())
+            {
+                size_t i = pending.pop();
+                if (pointBoxDistance(center, &flat.boxMin[i * Dimension], &flat.boxMax[i * Dimension]) > radiusSqr)
+                    continue;
+
+                KDtreeNode* node = flat.nodes[i];
+                if (node->enable)
+                {
+                    TNorm distanceSqr = metric.distance(center, node->pointCoordinates);
+                    if (distanceSqr <= radiusSqr)
+                        f(node, distanceSqr);
+                }
+
+                if (flat.rightChild[i] != kNoNode)
+                    pending.push(flat.rightChild[i]);
+                if (flat.leftChild[i] != kNoNode)
+                    pending.push(flat.leftChild[i]);
+            }
+        }
+
+        /** Find K nearest neighbours for enable nodes [queryBegin, queryEnd) of the flattened tree in one traversal of the reference tree
+        * @param queries flattened tree with queries
+        * @param references flattened tree in which neighbours are searched. Should not be empty.
+        * @param excludeSameIndex node is not a neighbour of itself. Is used when queries and references are the same tree.
+        * @param heaps max-heaps of neighbours, K items per query node
+        * @param heapSizes number of items in heap of each query node
+        */
+        void knearestForQueryGroup(const FlattenedTree& queries, size_t queryBegin, size_t queryEnd, const FlattenedTree& references, bool excludeSameIndex,
+                                   size_t K, IndexNeighbour* heaps, size_t* heapSizes) const
+        {
+            bool hasEnableQueries = false;
+            for (size_t q = queryBegin; q < queryEnd && !hasEnableQueries; ++q)
+                hasEnableQueries = queries.nodes[q]->enable;
+            if (!hasEnableQueries)
+                return;
+
+            TCoord queryMin[Dimension];
+            TCoord queryMax[Dimension];
+            for (size_t c = 0; c < Dimension; ++c)
+            {
+                queryMin[c] = queries.nodes[queryBegin]->pointCoordinates[c];
+                queryMax[c] = queryMin[c];
+            }
+            for (size_t q = queryBegin + 1; q < queryEnd; ++q)
+            {
+                for (size_t c = 0; c < Dimension; ++c)
+                {
+                    queryMin[c] = std::min(queryMin[c], queries.nodes[q]->pointCoordinates[c]);
+                    queryMax[c] = std::max(queryMax[c], queries.nodes[q]->pointCoordinates[c]);
+                }
+            }
+
+            // the largest K-th distance in the group
+            TNorm groupBound = std::numeric_limits<TNorm>::max();
+
+            struct IndexWithBound
+            {
+                size_t index; ///< index of the root of reference subtree
+                TNorm bound;  ///< squared distance between bounding boxes of queries and of the subtree
+            };
+
+            SmallStack<IndexWithBound> pending;
+            IndexWithBound root = {0, boxesDistance(queryMin, queryMax, &references.boxMin[0], &references.boxMax[0])};
+            pending.push(root);
+
+            while (!pending.empty())
+            {
+                IndexWithBound item = pending.pop();
+                if (!(item.bound < groupBound))
+                    continue;
+
+                size_t r = item.index;
+                KDtreeNode* reference = references.nodes[r];
+                if (reference->enable)
+                {
+                    TNorm newGroupBound = TNorm();
+                    for (size_t q = queryBegin; q < queryEnd; ++q)
+                    {
+                        KDtreeNode* query = queries.nodes[q];
+                        if (!query->enable)
+                            continue;
+
+                        IndexNeighbour* heap = heaps + q * K;
+                        size_t& count = heapSizes[q];
+                        if (!excludeSameIndex || q != r)
+                        {
+                            TNorm distanceSqr = metric.distance(query->pointCoordinates, reference->pointCoordinates);
+                            IndexNeighbour candidate = {r, distanceSqr};
+                            if (count < K)
+                            {
+                                heap[count] = candidate;
+                                count++;
+                                std::push_heap(heap, heap + count, isCloserIndexNeighbour);
+                            }
+                            else if (distanceSqr < heap[0].distanceSqr)
+                            {
+                                std::pop_heap(heap, heap + count, isCloserIndexNeighbour);
+                                heap[count - 1] = candidate;
+                                std::push_heap(heap, heap + count, isCloserIndexNeighbour);
+                            }
+                        }
+                        newGroupBound = std::max(newGroupBound, count < K ? std::numeric_limits<TNorm>::max() : heap[0].distanceSqr);
+                    }
+                    groupBound = newGroupBound;
+                }
+
+                // closer child is pushed last to be visited first
+                IndexWithBound children[2];
+                size_t numChildren = 0;
+                size_t childIndices[] = {references.leftChild[r], references.rightChild[r]};
+                for (size_t k = 0; k < 2; ++k)
+                {
+                    size_t child = childIndices[k];
+                    if (child == kNoNode)
+                        continue;
+                    TNorm bound = boxesDistance(queryMin, queryMax, &references.boxMin[child * Dimension], &references.boxMax[child * Dimension]);
+                    if (bound < groupBound)
+                    {
+                        IndexWithBound childWithBound = {child, bound};
+                        children[numChildren++] = childWithBound;
+                    }
+                }
+                if (numChildren == 2 && children[0].bound < children[1].bound)
+                    std::swap(children[0], children[1]);
+                for (size_t k = 0; k < numChildren; ++k)
+                    pending.push(children[k]);
+            }
+        }
+
+        /** Append to the path nodes on the way from node "from" to node "target". Descent goes in the same way as in pushInTree().
+        * @return true if target has been reached
+        */
+        bool appendPathToNode(std::vector<KDtreeNode*>& path, KDtreeNode* from, const KDtreeNode* target) const
+        {
+            for (KDtreeNode* node = from; node; )
+            {
+                path.push_back(node);
+                if (node == target)
+                    return true;
+
+                if (CmpHelper::IsLess(cmp(KDtree::getCoord(target->pointCoordinates, node->splitAxis), node->splitValue)))
+                    node = node->left;
+                else
+                    node = node->right;
+            }
+            return false;
+        }
+
+        /** Typical case complexity ~R + lg(N), worst case ~R+sqrt(N)
+        * @param out container in which founded points will be collected
+        * @param root root of the tree
+        * @param areaRelativeToPlane function 
+        * @param isPointInsideArea test that point is inside user defined area
+        */
+        template<class AreaRelativeToPlane, class IsPointInsideArea, class TContainer>
+        void rangeSearchInternal(TContainer& out,  KDtreeNode* root, const AreaRelativeToPlane& areaRelativeToPlane,  const IsPointInsideArea& isPointInsideArea) const
+        {
+            SmallStack<KDtreeNode*> pending;
+            if (root)
+                pending.push(root);
+
+            while (!pending.empty())
+            {
+                KDtreeNode* node = pending.pop();
+                size_t coord = node->splitAxis;
+
+                switch (areaRelativeToPlane(node->pointCoordinates, coord))
+                {
+                case KdTreepPlaneIntersectTest::eAreaInLeft:
+                    if (node->left)
+                        pending.push(node->left);
+                    break;
+                case KdTreepPlaneIntersectTest::eAreaInRight:
+                    if (node->right)
+                        pending.push(node->right);
+                    break;
+                case KdTreepPlaneIntersectTest::eDontKnow:
+                case KdTreepPlaneIntersectTest::eAreaIntersectsPlane:
+                    if (node->enable && isPointInsideArea(node->pointCoordinates))
+                        out.push_back(originalPoint(node));
+                    // right is pushed first to visit nodes in preorder
+                    if (node->right)
+                        pending.push(node->right);
+                    if (node->left)
+                        pending.push(node->left);
+                    break;
+                }
+            }
+        }
+
+        /**
+        * @param root root of the tree
+        * @param toAppend item you want to append
+        * @param depth depth of the root
+        * @return new root of the tree
+        */
+        KDtreeNode* pushInTreeInternal(KDtreeNode* root, KDtreeNode* toAppend, size_t depth)
+        {
+            KDtreeNode** link = &root;
+            while (*link != nullptr)
+            {
+                KDtreeNode* node = *link;
+                int cmpRes = cmp(toAppend->getCoord(node->splitAxis), node->splitValue);
+
+                if (CmpHelper::IsLess(cmpRes))
+                    link = &node->left;
+                else
+                    link = &node->right;
+                depth++;
+            }
+
+            // Select which coordinate use to do comparision
+            toAppend->setSplit(depth % Dimension);
+            *link = toAppend;
+            return root;
+        }
+
+        /** Rearrange points in [begin, end) such that the returned element is a median by coordinate "coord", all points before it are less by comparator of the tree and all points after it are greater or equal.
+        * @param begin first point of the range
+        * @param end point after last point of the range. Range should not be empty.
+        * @param coord index of coordinate used for split
+        * @param cmp comparator which is used for descent in the tree
+        * @return position of split point
+        * @remark median is selected by operator "<" because comparator with tolerance is not a strict weak ordering, but split itself is done by comparator as descent in pushInTree() does
+        */
+        static const TCoord** partitionByMedian(const TCoord** begin, const TCoord** end, size_t coord, const Cmp& cmp)
+        {
+            const TCoord** median = begin + (end - begin) / 2;
+            std::nth_element(begin, median, end, [coord](const TCoord* a, const TCoord* b) { return a[coord] < b[coord]; });
+
+            // move points equal to the median by comparator into the right part as pushInTree() does
+            const TCoord* medianPoint = *median;
+            const TCoord** firstEqual = std::partition(begin, median, [&](const TCoord* p) { return CmpHelper::IsLess(cmp(KDtree::getCoord(p, coord), KDtree::getCoord(medianPoint, coord))); });
+            std::iter_swap(firstEqual, median);
+            return firstEqual;
+        }
+
+        /** Select split axis for the node which is built from points in [begin, end)
+        * @param begin first point of the range
+        * @param end point after last point of the range. Range should not be empty.
+        * @param depth depth of the node
+        * @param splitRule rule for selecting split axis
+        * @return index of coordinate
+        */
+        static size_t selectSplitAxis(const TCoord* const* begin, const TCoord* const* end, size_t depth, KdTreeSplitRule splitRule)
+        {
+            if (splitRule == KdTreeSplitRule::eRoundRobin || Dimension == 1)
+                return depth % Dimension;
+
+            TCoord minValues[Dimension];
+            TCoord maxValues[Dimension];
+            for (size_t c = 0; c < Dimension; ++c)
+                minValues[c] = maxValues[c] = (*begin)[c];
+
+            for (const TCoord* const* p = begin + 1; p != end; ++p)
+            {
+                for (size_t c = 0; c < Dimension; ++c)
+                {
+                    if ((*p)[c] < minValues[c])
+                        minValues[c] = (*p)[c];
+                    else if (maxValues[c] < (*p)[c])
+                        maxValues[c] = (*p)[c];
+                }
+            }
+
+            size_t bestAxis = 0;
+            TNorm bestSpread = TNorm(maxValues[0]) - TNorm(minValues[0]);
+            for (size_t c = 1; c < Dimension; ++c)
+            {
+                TNorm spread = TNorm(maxValues[c]) - TNorm(minValues[c]);
+                if (bestSpread < spread)
+                {
+                    bestSpread = spread;
+                    bestAxis = c;
+                }
+            }
+            return bestAxis;
+        }
+
+        /** Allocate and construct node via allocator
+        */
+        KDtreeNode* createNode() {
+            return new (allocator.allocate(sizeof(KDtreeNode), alignof(KDtreeNode))) KDtreeNode();
+        }
+
+        /** Destruct node and return memory to allocator
+        */
+        void destroyNode(KDtreeNode* node)
+        {
+            node->~KDtreeNode();
+            allocator.deallocate(node, sizeof(KDtreeNode));
+        }
+
+        /** Allocate contiguous memory for all nodes of bulk build if allocator frees memory at once
+        * @param num number of nodes
+        * @return pointer to memory for nodes or nullptr if nodes should be allocated one by one
+        */
+        KDtreeNode* allocateNodesForBuild(size_t num)
+        {
+            if (!NodeAllocator::kReleaseAllAtOnce)
+                return nullptr;
+            return static_cast<KDtreeNode*>(allocator.allocate(num * sizeof(KDtreeNode), alignof(KDtreeNode)));
+        }
+
+        /** Construct node for the split point during bulk build
+        * @param nodesBlock memory for nodes from allocateNodesForBuild()
+        * @param slot index of split point in array of points. Each point has own slot so building of different subtrees does not require synchronization.
+        */
+        KDtreeNode* createNodeForBuild(KDtreeNode* nodesBlock, size_t slot)
+        {
+            if (nodesBlock)
+                return new (nodesBlock + slot) KDtreeNode();
+            else
+                return createNode();
+        }
+
+        /** Build balanced subtree from the points in [begin, end)
+        * @param begin first point of the range
+        * @param end point after last point of the range
+        * @param depth depth of the root of subtree
+        * @param base start of the whole array of points
+        * @param nodesBlock memory for nodes from allocateNodesForBuild()
+        * @param splitRule rule for selecting split axis
+        * @return root of constructed subtree
+        */
+        KDtreeNode* buildBalancedInternal(const TCoord** begin, const TCoord** end, size_t depth, const TCoord** base, KDtreeNode* nodesBlock, KdTreeSplitRule splitRule)
+        {
+            if (begin == end)
+                return nullptr;
+
+            size_t axis = selectSplitAxis(begin, end, depth, splitRule);
+            const TCoord** split = partitionByMedian(begin, end, axis, cmp);
+            KDtreeNode* node = createNodeForBuild(nodesBlock, split - base);
+            node->pointCoordinates = *split;
+            node->setSplit(axis);
+            node->left = buildBalancedInternal(begin, split, depth + 1, base, nodesBlock, splitRule);
+            node->right = buildBalancedInternal(split + 1, end, depth + 1, base, nodesBlock, splitRule);
+            return node;
+        }
+
+        /** Build balanced subtree from the points in [begin, end) by spawning building of left subtrees as tasks
+        * @param begin first point of the range
+        * @param end point after last point of the range
+        * @param depth depth of the root of subtree
+        * @param base start of the whole array of points
+        * @param nodesBlock memory for nodes from allocateNodesForBuild()
+        * @param group group in which tasks for building subtrees are spawned
+        * @param grainSize subtrees with at most such number of points are built serially
+        * @param splitRule rule for selecting split axis
+        * @return root of constructed subtree. Subtrees of returned node are completely constructed only after group completion.
+        */
+        KDtreeNode* buildBalancedParallelInternal(const TCoord** begin, const TCoord** end, size_t depth, const TCoord** base, KDtreeNode* nodesBlock, TaskGroup& group, size_t grainSize, KdTreeSplitRule splitRule)
+        {
+            if (size_t(end - begin) <= grainSize)
+                return buildBalancedInternal(begin, end, depth, base, nodesBlock, splitRule);
+
+            size_t axis = selectSplitAxis(begin, end, depth, splitRule);
+            const TCoord** split = partitionByMedian(begin, end, axis, cmp);
+            KDtreeNode* node = createNodeForBuild(nodesBlock, split - base);
+            node->pointCoordinates = *split;
+            node->setSplit(axis);
+            group.run([this, node, begin, split, depth, base, nodesBlock, &group, grainSize, splitRule]()
+                      {
+                          node->left = buildBalancedParallelInternal(begin, split, depth + 1, base, nodesBlock, group, grainSize, splitRule);
+                      });
+            node->right = buildBalancedParallelInternal(split + 1, end, depth + 1, base, nodesBlock, group, grainSize, splitRule);
+            return node;
+        }
+
+        /** Compare shape and points of two subtrees
+        * @param a subtree of this tree
+        * @param rhsTree tree to which "b" belongs
+        * @param b subtree of rhsTree
+        */
+        bool isSameStructureInternal(const KDtreeNode* a, const KDtree& rhsTree, const KDtreeNode* b) const
+        {
+            SmallStack<std::pair<const KDtreeNode*, const KDtreeNode*>> pending;
+            pending.push(std::make_pair(a, b));
+
+            while (!pending.empty())
+            {
+                std::pair<const KDtreeNode*, const KDtreeNode*> nodes = pending.pop();
+                if (nodes.first == nullptr || nodes.second == nullptr)
+                {
+                    if (nodes.first != nodes.second)
+                        return false;
+                    continue;
+                }
+                if (originalPoint(nodes.first) != rhsTree.originalPoint(nodes.second) || nodes.first->splitAxis != nodes.second->splitAxis)
+                    return false;
+
+                pending.push(std::make_pair(nodes.first->right, nodes.second->right));
+                pending.push(std::make_pair(nodes.first->left, nodes.second->left));
+            }
+            return true;
+        }
+
+        /** Get pointer to coordinates of the user for point of the node
+        */
+        const TCoord* originalPoint(const KDtreeNode* node) const {
+            return originalPointOf(node->pointCoordinates);
+        }
+
+        /** Get pointer to coordinates of the user for coordinates which are stored in the node
+        */
+        const TCoord* originalPointOf(const TCoord* storedCoordinates) const
+        {
+            if (storage == KdTreeStorageMode::eOwnedCoordinates)
+                return reinterpret_cast<const OwnedPoint*>(storedCoordinates)->original;
+            else
+                return storedCoordinates;
+        }
+
+        /** Allocate new chunk for owned points
+        * @param capacity number of points in chunk
+        */
+        void allocateOwnedPointsChunk(size_t capacity)
+        {
+            OwnedPointsChunk chunk;
+            chunk.points = static_cast<OwnedPoint*>(alignedMalloc(capacity * sizeof(OwnedPoint), 64));
+            if (!chunk.points)
+                throw std::bad_alloc();
+            chunk.capacity = capacity;
+            chunk.used = 0;
+            ownedChunks.push_back(chunk);
+        }
+
+        /** Copy point into the last chunk of owned points
+        * @param pointCoordinates coordinates of the user
+        * @return pointer to the copy of coordinates
+        */
+        const TCoord* copyPointIntoTree(const TCoord* pointCoordinates)
+        {
+            if (ownedChunks.empty() || ownedChunks.back().used == ownedChunks.back().capacity)
+                allocateOwnedPointsChunk(kOwnedPointsChunkSize);
+
+            OwnedPointsChunk& chunk = ownedChunks.back();
+            OwnedPoint& dst = chunk.points[chunk.used++];
+            for (size_t c = 0; c < Dimension; ++c)
+                dst.coordinates[c] = pointCoordinates[c];
+            dst.original = pointCoordinates;
+            return dst.coordinates;
+        }
+
+        /** Copy coordinates of all nodes into one new chunk in preorder, so descent from the root goes forward in memory
+        * @remark nodes should point to coordinates of the user
+        */
+        void copyPointsIntoTree()
+        {
+            if (!top)
+                return;
+
+            allocateOwnedPointsChunk(numPoints);
+            std::vector<KDtreeNode*> pending(1, top);
+            while (!pending.empty())
+            {
+                KDtreeNode* node = pending.back();
+                pending.pop_back();
+                node->pointCoordinates = copyPointIntoTree(node->pointCoordinates);
+
+                if (node->right)
+                    pending.push_back(node->right);
+                if (node->left)
+                    pending.push_back(node->left);
+            }
+        }
+
+        /** Free all chunks with owned points
+        */
+        void releaseOwnedPoints()
+        {
+            for (size_t i = 0; i < ownedChunks.size(); ++i)
+                alignedFree(ownedChunks[i].points);
+            ownedChunks.clear();
+        }
+
+        /** Visit all nodes in postorder
+        * @param x root of the subtree
+        * @param f function which is called as f(leftCompletion, rightCompletion, node), where completions are results of calls for children (nullptr for absent child). Node can be destroyed inside f.
+        * @return result of call of f for x or nullptr if x is nullptr
+        */
+        template<class F>
+        static KDtreeNode* postOrderNodesTraverse(KDtreeNode* x, const F& f)
+        {
+            if (x == nullptr)
                 return nullptr;
-            KDtreeNode* leftCompletion = postOrderNodesTraverse(x->left, f);
-            KDtreeNode* rightCompletion = postOrderNodesTraverse(x->right, f);
-            return f(leftCompletion, rightCompletion, x);
+
+            // node and flag that it's children have already been visited
+            SmallStack<std::pair<KDtreeNode*, bool>> pending;
+            SmallStack<KDtreeNode*> completions;
+            pending.push(std::make_pair(x, false));
+
+            while (!pending.empty())
+            {
+                std::pair<KDtreeNode*, bool> item = pending.pop();
+                KDtreeNode* node = item.first;
+
+                if (item.second)
+                {
+                    KDtreeNode* rightCompletion = completions.pop();
+                    KDtreeNode* leftCompletion = completions.pop();
+                    completions.push(f(leftCompletion, rightCompletion, node));
+                }
+                else if (node == nullptr)
+                {
+                    completions.push(nullptr);
+                }
+                else
+                {
+                    // left subtree is completed first, so it's completion lies below completion of right subtree
+                    pending.push(std::make_pair(node, true));
+                    pending.push(std::make_pair(node->right, false));
+                    pending.push(std::make_pair(node->left, false));
+                }
+            }
+
+            assert(completions.size() == 1);
+            return completions.pop();
         }
 
 #if 0
@@ -511,18 +2438,44 @@ namespace lw_index_datastructs
         template<class F>
         static void inorderLeafsTraverseWithDepth(KDtreeNode* x, const F& f, size_t depth)
         {
-            if (x->left == nullptr && x->right == nullptr)
-                f(x, depth);
-            else if (x->left)
-                inorderLeafsTraverseWithDepth(x->left, f, depth + 1);
-            else if (x->right)
-                inorderLeafsTraverseWithDepth(x->right, f, depth + 1);
+            SmallStack<std::pair<KDtreeNode*, size_t>> pending;
+            pending.push(std::make_pair(x, depth));
+
+            while (!pending.empty())
+            {
+                std::pair<KDtreeNode*, size_t> item = pending.pop();
+                KDtreeNode* node = item.first;
+                if (node->left == nullptr && node->right == nullptr)
+                {
+                    f(node, item.second);
+                    continue;
+                }
+                if (node->right)
+                    pending.push(std::make_pair(node->right, item.second + 1));
+                if (node->left)
+                    pending.push(std::make_pair(node->left, item.second + 1));
+            }
         }
 
     private:
-        KDtreeNode* top;         ///< Pointer to the root of the tree (depth 0)
-        size_t numPoints;        ///< Number of points in data structure
-        size_t numDisablePoints; ///< Number of points temporary disabled in data structure
-        Cmp cmp;                 ///< Used comparator
+        template <class TCoordF, size_t DimensionF, class TNormF, typename CmpF>
+        friend class FrozenKDtree;
+
+        KDtreeNode* top;                           ///< Pointer to the root of the tree (depth 0)
+        size_t numPoints;                          ///< Number of points in data structure
+        size_t numDisablePoints;                   ///< Number of points temporary disabled in data structure
+        Cmp cmp;                                   ///< Used comparator
+        Metric metric;                             ///< Used distance metric
+        NodeAllocator allocator;                   ///< Allocator of memory for nodes
+        KdTreeStorageMode storage;                 ///< Place where coordinates of points are stored
+        std::vector<OwnedPointsChunk> ownedChunks; ///< Copies of points for KdTreeStorageMode::eOwnedCoordinates
     };
+
+    /** Exchange content of two trees in constant time
+    */
+    template <class TCoord, size_t Dimension, class TNorm, typename Cmp, class NodeAllocator, class Metric>
+    inline void swap(KDtree<TCoord, Dimension, TNorm, Cmp, NodeAllocator, Metric>& a, KDtree<TCoord, Dimension, TNorm, Cmp, NodeAllocator, Metric>& b) noexcept
+    {
+        a.swap(b);
+    }
 }
@@ -0,0 +1,762 @@
+/** @file
+* @brief Read-only compact version of KD-tree
+* @author konstantin.burlachenko@kaust.edu.sa
+*
+* Frozen KD-tree is a snapshot of KDtree which can not be modified after construction, but it's more friendly to the cache:
+* 1. All nodes are stored in one contiguous array. Order of nodes in the array is selected by KdTreeFrozenLayout.
+* 2. Children are referenced by 32-bit indices instead of 64-bit pointers.
+* 3. Coordinates of points are copied inside the nodes, so visiting a node does not lead to access into memory of the user.
+* 4. Optionally subtrees with at most "leafSize" points are collapsed into leaf buckets. Coordinates of points in the bucket are stored
+*    in contiguous block in structure-of-arrays form: first coordinate of all points, then second coordinate of all points, etc.
+*    Distances to all points of the bucket are evaluated by one loop over the block. For float and double the loop uses the best instruction set of the CPU (see KdTreeSimd.h).
+*
+* Original pointers to coordinates are kept in a separate array, which is touched only to return the result of the query.
+*/
+
+#pragma once
+
+#include "KdTree.h"
+#include "KdTreeSimd.h"
+#include "AlignedAllocator.h"
+#include "SmallStack.h"
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+namespace lw_index_datastructs
+{
+    /** Order of nodes in memory for frozen KD-tree
+    */
+    enum class KdTreeFrozenLayout
+    {
+        ePreorder,    ///< Depth-first order. Left child follows the parent. Good when the whole tree fits into cache.
+        eVanEmdeBoas, ///< Cache-oblivious recursive order. Path from the root to the leaf touches O(log_B(N)) blocks for any size of block B.
+        eBlocked      ///< Subtrees which fit into memory page are stored contiguously, inside the page subtrees which fit into cache line are stored contiguously
+    };
+
+    template <class TCoord,                                   ///< Used type for coordinate
+              size_t Dimension = 2,                           ///< Used number of dimensions
+              class TNorm = TCoord,                           ///< Used type for store norm of the vector
+              typename Cmp = Comparator<TCoord> >             ///< Used type to perform compare between coordinates
+    class FrozenKDtree
+    {
+    public:
+        typedef uint32_t TNodeIndex;                                                ///< Type for index of the node
+        const static TNodeIndex kNullNode = std::numeric_limits<TNodeIndex>::max(); ///< Index which means absence of the node
+        const static size_t kDimension = Dimension;                                 ///< Size of dimension where KD tree is building
+        const static size_t kMaxLeafSize = 256;                                     ///< Maximum number of points in the leaf bucket
+        const static size_t kBucketLanes = sizeof(TCoord) >= 32 ? 1 : 32 / sizeof(TCoord); ///< Rows of bucket are padded to multiple of this number of coordinates
+        const static size_t kCacheLineSize = 64;                                    ///< Size of cache line in bytes used by KdTreeFrozenLayout::eBlocked
+        const static size_t kPageSize = 4096;                                       ///< Size of memory page in bytes used by KdTreeFrozenLayout::eBlocked
+
+        /** Construct empty tree
+        */
+        FrozenKDtree()
+        : numPoints(0)
+        , maxLeafSize(1)
+        , nodesLayout(KdTreeFrozenLayout::ePreorder)
+        {}
+
+        /** Construct frozen copy of the KD-tree
+        * @param tree source tree
+        * @param leafSize maximum number of points in leaf bucket. If it's 1 then shape of the source tree is preserved, otherwise tree is rebuilt balanced from points of the source tree. Values above kMaxLeafSize are clamped to it.
+        * @param layout order of nodes in memory
+        * @param splitRule rule for selecting split axis if tree is rebuilt
+        * @remark all points of source tree are available for queries regardless of their enable flags
+        * @remark frozen tree always searches by Euclidean metric, so source tree should use one of Euclidean metric policies (see KdTreeIsL2Metric)
+        */
+        template <class NodeAllocator, class Metric>
+        explicit FrozenKDtree(const KDtree<TCoord, Dimension, TNorm, Cmp, NodeAllocator, Metric>& tree, size_t leafSize = 1, KdTreeFrozenLayout layout = KdTreeFrozenLayout::ePreorder,
+                              KdTreeSplitRule splitRule = KdTreeSplitRule::eRoundRobin)
+        : numPoints(0)
+        , maxLeafSize(1)
+        , nodesLayout(KdTreeFrozenLayout::ePreorder)
+        {
+            static_assert(KdTreeIsL2Metric<Metric>::value, "FrozenKDtree searches only by Euclidean metric");
+
+            if (leafSize <= 1)
+            {
+                freeze(tree);
+            }
+            else
+            {
+                std::vector<const TCoord*> points;
+                points.reserve(tree.size());
+                tree.postOrderNodesTraverse(tree.top, [&](typename KDtree<TCoord, Dimension, TNorm, Cmp, NodeAllocator, Metric>::KDtreeNode* /*leftSubtree*/,
+                                                          typename KDtree<TCoord, Dimension, TNorm, Cmp, NodeAllocator, Metric>::KDtreeNode* /*rightSubtree*/,
+                                                          typename KDtree<TCoord, Dimension, TNorm, Cmp, NodeAllocator, Metric>::KDtreeNode* x)
+                                                      {
+                                                          points.push_back(tree.originalPoint(x));
+                                                          return x;
+                                                      });
+                buildBalanced(points, leafSize, splitRule);
+            }
+            applyLayout(layout);
+        }
+
+        /** Construct balanced frozen tree from points
+        * @param ctr container with points. Coordinates are copied inside the tree.
+        * @param num number of points in container
+        * @param leafSize maximum number of points in leaf bucket. Typical values are 8-64. Value 1 means that there are no buckets. Values above kMaxLeafSize are clamped to it.
+        * @param layout order of nodes in memory
+        * @param splitRule rule for selecting split axis of the nodes
+        */
+        template <class Container>
+        FrozenKDtree(const Container& ctr, size_t num, size_t leafSize = 1, KdTreeFrozenLayout layout = KdTreeFrozenLayout::ePreorder,
+                     KdTreeSplitRule splitRule = KdTreeSplitRule::eRoundRobin)
+        : numPoints(0)
+        , maxLeafSize(1)
+        , nodesLayout(KdTreeFrozenLayout::ePreorder)
+        {
+            std::vector<const TCoord*> points(num);
+            for (size_t i = 0; i < num; ++i)
+                points[i] = ctr[i];
+            buildBalanced(points, leafSize, splitRule);
+            applyLayout(layout);
+        }
+
+        /** Get number of dimensions for points.
+        * @return dimension for KD-tree
+        */
+        static size_t kDimensions() {
+            return Dimension;
+        }
+
+        /** Get number of points inside KD-tree
+        */
+        size_t size() const {
+            return numPoints;
+        }
+
+        /** Get maximum number of points in the leaf bucket
+        */
+        size_t leafSize() const {
+            return maxLeafSize;
+        }
+
+        /** Get order of nodes in memory
+        */
+        KdTreeFrozenLayout layout() const {
+            return nodesLayout;
+        }
+
+        /** Calculate height of the tree. Time is ~N
+        * @return height of the tree. Leaf bucket is counted as one level.
+        */
+        size_t height() const
+        {
+            if (nodes.empty())
+                return 0;
+
+            size_t h = 0;
+            std::vector<std::pair<TNodeIndex, size_t>> pending(1, std::make_pair(TNodeIndex(0), size_t(1)));
+            while (!pending.empty())
+            {
+                TNodeIndex index = pending.back().first;
+                size_t depth = pending.back().second;
+                pending.pop_back();
+
+                if (depth > h)
+                    h = depth;
+                if (nodes[index].left != kNullNode)
+                    pending.push_back(std::make_pair(nodes[index].left, depth + 1));
+                if (nodes[index].right != kNullNode)
+                    pending.push_back(std::make_pair(nodes[index].right, depth + 1));
+            }
+            return h;
+        }
+
+        /** Find nearest point to query point by Euclidean (L2) metric
+        * @param pointCoordinates requested point
+        * @return pointer to coordinates of closest point which has been used to construct the tree and zero if the tree is empty
+        */
+        const TCoord* nearestPointInEuclidianMetric(const TCoord* pointCoordinates) const
+        {
+            if (nodes.empty())
+                return nullptr;
+
+            TNorm bestNorm = std::numeric_limits<TNorm>::max();
+            const TCoord* bestPoint = nullptr;
+            nearestPointInternal(0, bestNorm, bestPoint, pointCoordinates);
+            return bestPoint;
+        }
+
+        /** Search all point which lie inside [minPoint, maxPoint]
+        * @param outContainer container with pointers to coordinates which have been used to construct the tree
+        * @param minPoint point which element wise store minimum coordinate for Axis Aligned Bounding Box
+        * @param maxPoint point which element wise store maximum coordinate for Axis Aligned Bounding Box
+        */
+        template<class Point, class TContainer = std::vector<const TCoord*>>
+        void rangeSearchWithBoundingBox(TContainer& outContainer, const Point& minPoint, const Point& maxPoint) const
+        {
+            if (nodes.empty())
+                return;
+            rangeSearchInternal(outContainer, 0, minPoint, maxPoint);
+        }
+
+    protected:
+        struct FrozenNode
+        {
+            TCoord point[Dimension]; ///< copy of coordinates of the point. Not used for leaf bucket.
+            TNodeIndex left;         ///< index of left child or kNullNode
+            TNodeIndex right;        ///< index of right child or kNullNode
+            TNodeIndex bucketBegin;  ///< for leaf bucket index of the first slot in bucketCoordinates and bucketOriginalPoints
+            uint16_t bucketSize;     ///< number of points in leaf bucket or zero if node is not a leaf bucket
+            uint16_t splitAxis;      ///< index of coordinate used to split space in this node. Split value is point[splitAxis].
+        };
+
+        /** Get length of the row in the block of coordinates for the leaf bucket
+        */
+        static size_t bucketStride(size_t bucketSize) {
+            return (bucketSize + kBucketLanes - 1) / kBucketLanes * kBucketLanes;
+        }
+
+        /** Evaluate squared distances from request point to all points of the leaf bucket
+        * @param block coordinates of points in structure-of-arrays form
+        * @param stride length of the row in the block
+        * @param requestPoint request point
+        * @param distances output distances. Should have place for "stride" items.
+        * @remark float and double buckets are evaluated by kernels with instruction set selected in runtime, they give the same result as the generic loop.
+        * Integer coordinates with at most 32 bits are accumulated in 64-bit integers, they give the same result as integerDistanceSqrTwoWords().
+        */
+        template <class BlockCoord, class BlockNorm>
+        static void bucketDistancesSqr(const BlockCoord* block, size_t stride, const BlockCoord* requestPoint, BlockNorm* distances) {
+            bucketDistancesSqr(block, stride, requestPoint, distances, KdTreeHasWideIntegerDistance<BlockCoord, BlockNorm>());
+        }
+
+        template <class BlockCoord, class BlockNorm>
+        static void bucketDistancesSqr(const BlockCoord* block, size_t stride, const BlockCoord* requestPoint, BlockNorm* distances, std::true_type /*wideIntegerDistance*/)
+        {
+            uint64_t wideDistances[kMaxLeafSize];
+            uint64_t carries[kMaxLeafSize];
+            for (size_t j = 0; j < stride; ++j)
+            {
+                wideDistances[j] = 0;
+                carries[j] = 0;
+            }
+
+            for (size_t c = 0; c < Dimension; ++c)
+            {
+                const int64_t requestCoord = int64_t(requestPoint[c]);
+                const BlockCoord* row = block + c * stride;
+                for (size_t j = 0; j < stride; ++j)
+                {
+                    // the same arithmetic as in integerDistanceSqrTwoWords()
+                    uint64_t tmp = uint64_t(int64_t(row[j]) - requestCoord);
+                    uint64_t square = tmp * tmp;
+                    wideDistances[j] += square;
+                    if (sizeof(BlockCoord) == 4)
+                        carries[j] += wideDistances[j] < square;
+                }
+            }
+
+            for (size_t j = 0; j < stride; ++j)
+                distances[j] = integerDistanceToNorm<BlockNorm>(wideDistances[j], carries[j]);
+        }
+
+        template <class BlockCoord, class BlockNorm>
+        static void bucketDistancesSqr(const BlockCoord* block, size_t stride, const BlockCoord* requestPoint, BlockNorm* distances, std::false_type /*wideIntegerDistance*/)
+        {
+            for (size_t j = 0; j < stride; ++j)
+                distances[j] = BlockNorm();
+
+            for (size_t c = 0; c < Dimension; ++c)
+            {
+                const BlockNorm requestCoord = BlockNorm(requestPoint[c]);
+                const BlockCoord* row = block + c * stride;
+                for (size_t j = 0; j < stride; ++j)
+                {
+                    BlockNorm tmp = BlockNorm(row[j]) - requestCoord;
+                    distances[j] += tmp*tmp;
+                }
+            }
+        }
+
+        static void bucketDistancesSqr(const float* block, size_t stride, const float* requestPoint, float* distances) {
+            simdBucketDistancesSqr(block, stride, Dimension, requestPoint, distances);
+        }
+
+        static void bucketDistancesSqr(const double* block, size_t stride, const double* requestPoint, double* distances) {
+            simdBucketDistancesSqr(block, stride, Dimension, requestPoint, distances);
+        }
+
+        static TNorm L2NormSqr(const TCoord* a, const TCoord* b) {
+            return L2NormSqr(a, b, KdTreeHasWideIntegerDistance<TCoord, TNorm>());
+        }
+
+        static TNorm L2NormSqr(const TCoord* a, const TCoord* b, std::true_type /*wideIntegerDistance*/)
+        {
+            uint64_t high = 0;
+            uint64_t low = integerDistanceSqrTwoWords<Dimension>(a, b, high);
+            return integerDistanceToNorm<TNorm>(low, high);
+        }
+
+        static TNorm L2NormSqr(const TCoord* a, const TCoord* b, std::false_type /*wideIntegerDistance*/)
+        {
+            TNorm distance = TNorm();
+            for (size_t i = 0; i < Dimension; ++i)
+            {
+                TNorm tmp = TNorm(a[i]) - TNorm(b[i]);
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        /** Copy nodes of the tree into contiguous array in preorder
+        */
+        template <class SourceTree>
+        void freeze(const SourceTree& tree)
+        {
+            typedef typename SourceTree::KDtreeNode SourceNode;
+
+            assert(tree.size() < size_t(kNullNode));
+            clear();
+            nodes.reserve(tree.size());
+            originalPoints.reserve(tree.size());
+            numPoints = tree.size();
+
+            if (!tree.top)
+                return;
+
+            // node of the source tree and place for index of it's copy inside parent
+            std::vector<std::pair<const SourceNode*, size_t>> pending;
+            pending.push_back(std::make_pair(tree.top, size_t(-1)));
+            while (!pending.empty())
+            {
+                const SourceNode* src = pending.back().first;
+                size_t linkToUpdate = pending.back().second;
+                pending.pop_back();
+
+                TNodeIndex index = TNodeIndex(nodes.size());
+                if (linkToUpdate != size_t(-1))
+                {
+                    FrozenNode& parent = nodes[linkToUpdate / 2];
+                    if (linkToUpdate % 2 == 0)
+                        parent.left = index;
+                    else
+                        parent.right = index;
+                }
+
+                FrozenNode node;
+                for (size_t c = 0; c < Dimension; ++c)
+                    node.point[c] = src->pointCoordinates[c];
+                node.left = kNullNode;
+                node.right = kNullNode;
+                node.bucketBegin = 0;
+                node.bucketSize = 0;
+                node.splitAxis = src->splitAxis;
+                nodes.push_back(node);
+                originalPoints.push_back(tree.originalPoint(src));
+
+                // right is pushed first to process left subtree next and place left child right after the parent
+                if (src->right)
+                    pending.push_back(std::make_pair(src->right, size_t(index) * 2 + 1));
+                if (src->left)
+                    pending.push_back(std::make_pair(src->left, size_t(index) * 2 + 0));
+            }
+        }
+
+        /** Remove all nodes and points
+        */
+        void clear()
+        {
+            nodes.clear();
+            originalPoints.clear();
+            bucketCoordinates.clear();
+            bucketOriginalPoints.clear();
+            numPoints = 0;
+            maxLeafSize = 1;
+            nodesLayout = KdTreeFrozenLayout::ePreorder;
+        }
+
+        /** Get height of subtree which fits into block of memory of specified size
+        */
+        static size_t subtreeHeightInBlock(size_t blockBytes)
+        {
+            size_t nodesInBlock = blockBytes / sizeof(FrozenNode);
+            size_t h = 0;
+            while ((size_t(2) << h) - 1 <= nodesInBlock)
+                h++;
+            return h == 0 ? 1 : h;
+        }
+
+        /** Append to "out" roots of subtrees which lie exactly on "limitDepth" inside subtree of "root" in left to right order
+        */
+        void collectSubtreesAtDepth(TNodeIndex root, size_t rootDepth, size_t limitDepth, std::vector<TNodeIndex>& out) const
+        {
+            std::vector<std::pair<TNodeIndex, size_t>> pending(1, std::make_pair(root, rootDepth));
+            while (!pending.empty())
+            {
+                TNodeIndex index = pending.back().first;
+                size_t depth = pending.back().second;
+                pending.pop_back();
+
+                if (depth == limitDepth)
+                {
+                    out.push_back(index);
+                    continue;
+                }
+                if (nodes[index].right != kNullNode)
+                    pending.push_back(std::make_pair(nodes[index].right, depth + 1));
+                if (nodes[index].left != kNullNode)
+                    pending.push_back(std::make_pair(nodes[index].left, depth + 1));
+            }
+        }
+
+        /** Append to "order" nodes of subtree of "root" with depth less then rootDepth + height in van Emde Boas order
+        */
+        void vanEmdeBoasOrder(TNodeIndex root, size_t rootDepth, size_t height, std::vector<TNodeIndex>& order) const
+        {
+            if (height == 1)
+            {
+                order.push_back(root);
+                return;
+            }
+
+            size_t topHeight = height / 2;
+            vanEmdeBoasOrder(root, rootDepth, topHeight, order);
+
+            std::vector<TNodeIndex> bottomRoots;
+            collectSubtreesAtDepth(root, rootDepth, rootDepth + topHeight, bottomRoots);
+            for (size_t i = 0; i < bottomRoots.size(); ++i)
+                vanEmdeBoasOrder(bottomRoots[i], rootDepth + topHeight, height - topHeight, order);
+        }
+
+        /** Append to "order" nodes of subtree of "root" with depth less then limitDepth. Subtrees with height blockHeights[level] are stored contiguously.
+        */
+        void blockedOrder(TNodeIndex root, size_t rootDepth, size_t limitDepth, const size_t* blockHeights, size_t levels, std::vector<TNodeIndex>& order) const
+        {
+            std::vector<std::pair<TNodeIndex, size_t>> blockRoots(1, std::make_pair(root, rootDepth));
+            for (size_t b = 0; b < blockRoots.size(); ++b)
+            {
+                TNodeIndex blockRoot = blockRoots[b].first;
+                size_t blockDepth = blockRoots[b].second;
+                size_t blockLimit = std::min(limitDepth, blockDepth + blockHeights[0]);
+
+                if (levels > 1)
+                {
+                    blockedOrder(blockRoot, blockDepth, blockLimit, blockHeights + 1, levels - 1, order);
+                }
+                else
+                {
+                    // breadth-first order inside the smallest block
+                    size_t levelBegin = order.size();
+                    order.push_back(blockRoot);
+                    for (size_t depth = blockDepth + 1; depth < blockLimit; ++depth)
+                    {
+                        size_t levelEnd = order.size();
+                        for (size_t i = levelBegin; i < levelEnd; ++i)
+                        {
+                            const FrozenNode& node = nodes[order[i]];
+                            if (node.left != kNullNode)
+                                order.push_back(node.left);
+                            if (node.right != kNullNode)
+                                order.push_back(node.right);
+                        }
+                        if (levelEnd == order.size())
+                            break;
+                        levelBegin = levelEnd;
+                    }
+                }
+
+                if (blockLimit < limitDepth)
+                {
+                    std::vector<TNodeIndex> nextRoots;
+                    collectSubtreesAtDepth(blockRoot, blockDepth, blockLimit, nextRoots);
+                    for (size_t i = 0; i < nextRoots.size(); ++i)
+                        blockRoots.push_back(std::make_pair(nextRoots[i], blockLimit));
+                }
+            }
+        }
+
+        /** Reorder nodes in memory
+        */
+        void applyLayout(KdTreeFrozenLayout layout)
+        {
+            if (layout == KdTreeFrozenLayout::ePreorder || nodes.empty())
+            {
+                nodesLayout = layout;
+                return;
+            }
+
+            std::vector<TNodeIndex> order;
+            order.reserve(nodes.size());
+            if (layout == KdTreeFrozenLayout::eVanEmdeBoas)
+            {
+                vanEmdeBoasOrder(0, 0, height(), order);
+            }
+            else
+            {
+                size_t blockHeights[] = { subtreeHeightInBlock(kPageSize), subtreeHeightInBlock(kCacheLineSize) };
+                size_t levels = blockHeights[1] < blockHeights[0] ? 2 : 1;
+                blockedOrder(0, 0, std::numeric_limits<size_t>::max(), blockHeights, levels, order);
+            }
+            assert(order.size() == nodes.size());
+
+            std::vector<TNodeIndex> newIndex(nodes.size());
+            for (size_t i = 0; i < order.size(); ++i)
+                newIndex[order[i]] = TNodeIndex(i);
+
+            std::vector<FrozenNode> newNodes(nodes.size());
+            std::vector<const TCoord*> newOriginalPoints(nodes.size());
+            std::vector<TCoord, AlignedAllocator<TCoord, 64>> newBucketCoordinates;
+            std::vector<const TCoord*> newBucketOriginalPoints;
+            newBucketCoordinates.reserve(bucketCoordinates.size());
+            newBucketOriginalPoints.reserve(bucketOriginalPoints.size());
+
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                FrozenNode node = nodes[order[i]];
+                if (node.left != kNullNode)
+                    node.left = newIndex[node.left];
+                if (node.right != kNullNode)
+                    node.right = newIndex[node.right];
+
+                if (node.bucketSize != 0)
+                {
+                    // buckets follow the order of leaves
+                    size_t stride = bucketStride(node.bucketSize);
+                    size_t oldSlot = node.bucketBegin;
+                    node.bucketBegin = TNodeIndex(newBucketOriginalPoints.size());
+                    newBucketOriginalPoints.insert(newBucketOriginalPoints.end(), bucketOriginalPoints.begin() + oldSlot, bucketOriginalPoints.begin() + oldSlot + stride);
+                    newBucketCoordinates.insert(newBucketCoordinates.end(), bucketCoordinates.begin() + oldSlot * Dimension, bucketCoordinates.begin() + (oldSlot + stride) * Dimension);
+                }
+
+                newNodes[i] = node;
+                newOriginalPoints[i] = originalPoints[order[i]];
+            }
+
+            nodes.swap(newNodes);
+            originalPoints.swap(newOriginalPoints);
+            bucketCoordinates.swap(newBucketCoordinates);
+            bucketOriginalPoints.swap(newBucketOriginalPoints);
+            assert(newIndex[0] == 0 && "root should stay the first node");
+            nodesLayout = layout;
+        }
+
+        /** Build balanced tree with leaf buckets from points
+        * @param points pointers to coordinates of points. Array is reordered.
+        * @param leafSize maximum number of points in leaf bucket. Value is clamped to [1, kMaxLeafSize].
+        * @param splitRule rule for selecting split axis of the nodes
+        */
+        void buildBalanced(std::vector<const TCoord*>& points, size_t leafSize, KdTreeSplitRule splitRule)
+        {
+            assert(points.size() < size_t(kNullNode));
+
+            clear();
+            maxLeafSize = leafSize < 1 ? 1 : (leafSize > kMaxLeafSize ? kMaxLeafSize : leafSize);
+            numPoints = points.size();
+            nodes.reserve(maxLeafSize > 1 ? 2 * (numPoints / maxLeafSize + 1) : numPoints);
+            if (maxLeafSize > 1)
+                bucketCoordinates.reserve((numPoints + numPoints / 2 + kBucketLanes) * Dimension);
+
+            if (!points.empty())
+                buildBalancedInternal(points.data(), points.data() + points.size(), 0, splitRule);
+        }
+
+        /** Build balanced subtree from points in [begin, end) and append it's nodes in preorder
+        * @return index of root of subtree
+        */
+        TNodeIndex buildBalancedInternal(const TCoord** begin, const TCoord** end, size_t depth, KdTreeSplitRule splitRule)
+        {
+            if (begin == end)
+                return kNullNode;
+
+            TNodeIndex index = TNodeIndex(nodes.size());
+            nodes.push_back(FrozenNode());
+            nodes[index].left = kNullNode;
+            nodes[index].right = kNullNode;
+            nodes[index].bucketBegin = 0;
+            nodes[index].bucketSize = 0;
+            nodes[index].splitAxis = 0;
+
+            size_t count = size_t(end - begin);
+            if (maxLeafSize > 1 && count <= maxLeafSize)
+            {
+                appendBucket(nodes[index], begin, count);
+                originalPoints.push_back(nullptr);
+                return index;
+            }
+
+            size_t axis = KDtree<TCoord, Dimension, TNorm, Cmp>::selectSplitAxis(begin, end, depth, splitRule);
+            const TCoord** split = KDtree<TCoord, Dimension, TNorm, Cmp>::partitionByMedian(begin, end, axis, cmp);
+            for (size_t c = 0; c < Dimension; ++c)
+                nodes[index].point[c] = (*split)[c];
+            nodes[index].splitAxis = uint16_t(axis);
+            originalPoints.push_back(*split);
+
+            TNodeIndex left = buildBalancedInternal(begin, split, depth + 1, splitRule);
+            nodes[index].left = left;
+            TNodeIndex right = buildBalancedInternal(split + 1, end, depth + 1, splitRule);
+            nodes[index].right = right;
+            return index;
+        }
+
+        /** Copy coordinates of points into new leaf bucket
+        */
+        void appendBucket(FrozenNode& node, const TCoord** points, size_t count)
+        {
+            size_t stride = bucketStride(count);
+            size_t firstSlot = bucketOriginalPoints.size();
+            node.bucketBegin = TNodeIndex(firstSlot);
+            node.bucketSize = uint16_t(count);
+
+            bucketOriginalPoints.resize(firstSlot + stride, nullptr);
+            bucketCoordinates.resize((firstSlot + stride) * Dimension);
+            TCoord* block = &bucketCoordinates[firstSlot * Dimension];
+
+            for (size_t j = 0; j < stride; ++j)
+            {
+                // padding slots repeat the first point to keep distances finite
+                const TCoord* src = points[j < count ? j : 0];
+                for (size_t c = 0; c < Dimension; ++c)
+                    block[c * stride + j] = src[c];
+                if (j < count)
+                    bucketOriginalPoints[firstSlot + j] = src;
+            }
+        }
+
+        /** Find nearest point among points of the leaf bucket
+        */
+        void nearestPointInBucket(const FrozenNode& node, TNorm& bestNormSquare, const TCoord*& bestPoint, const TCoord* requestPoint) const
+        {
+            TNorm distances[kMaxLeafSize];
+            size_t stride = bucketStride(node.bucketSize);
+            bucketDistancesSqr(&bucketCoordinates[size_t(node.bucketBegin) * Dimension], stride, requestPoint, distances);
+
+            for (size_t j = 0; j < node.bucketSize; ++j)
+            {
+                if (distances[j] < bestNormSquare)
+                {
+                    bestNormSquare = distances[j];
+                    bestPoint = bucketOriginalPoints[node.bucketBegin + j];
+                }
+            }
+        }
+
+        /** Subtree which is postponed during search together with lower bound of squared distance from request point to it
+        */
+        struct NodeWithBound
+        {
+            TNodeIndex node; ///< root of subtree
+            TNorm bound;     ///< squared distance to the split plane of the parent
+        };
+
+        /** Find nearest point with pruning
+        */
+        void nearestPointInternal(TNodeIndex root, TNorm& bestNormSquare, const TCoord*& bestPoint, const TCoord* requestPoint) const
+        {
+            SmallStack<NodeWithBound> pending;
+            TNodeIndex index = root;
+
+            for (;;)
+            {
+                while (index != kNullNode)
+                {
+                    const FrozenNode& node = nodes[index];
+                    if (node.bucketSize != 0)
+                    {
+                        nearestPointInBucket(node, bestNormSquare, bestPoint, requestPoint);
+                        break;
+                    }
+
+                    size_t curCoord = node.splitAxis;
+                    TNorm newNormSquare = L2NormSqr(requestPoint, node.point);
+                    if (newNormSquare < bestNormSquare)
+                    {
+                        bestNormSquare = newNormSquare;
+                        bestPoint = originalPoints[index];
+                    }
+
+                    NodeWithBound farSubtree;
+                    TNorm tmpDistanceToSeparatePlane = TNorm(node.point[curCoord]) - TNorm(requestPoint[curCoord]);
+                    farSubtree.bound = tmpDistanceToSeparatePlane * tmpDistanceToSeparatePlane;
+
+                    if (CmpHelper::IsLess(cmp(requestPoint[curCoord], node.point[curCoord])))
+                    {
+                        index = node.left;
+                        farSubtree.node = node.right;
+                    }
+                    else
+                    {
+                        index = node.right;
+                        farSubtree.node = node.left;
+                    }
+
+                    if (farSubtree.node != kNullNode)
+                        pending.push(farSubtree);
+                }
+
+                do
+                {
+                    if (pending.empty())
+                        return;
+                    NodeWithBound next = pending.pop();
+                    index = (next.bound < bestNormSquare) ? next.node : kNullNode;
+                } while (index == kNullNode);
+            }
+        }
+
+        /** Collect points inside axis aligned bounding box
+        */
+        template<class Point, class TContainer>
+        void rangeSearchInternal(TContainer& out, TNodeIndex root, const Point& minPoint, const Point& maxPoint) const
+        {
+            SmallStack<TNodeIndex> pending;
+            pending.push(root);
+
+            while (!pending.empty())
+            {
+                TNodeIndex index = pending.pop();
+                const FrozenNode& node = nodes[index];
+                if (node.bucketSize != 0)
+                {
+                    size_t stride = bucketStride(node.bucketSize);
+                    const TCoord* block = &bucketCoordinates[size_t(node.bucketBegin) * Dimension];
+                    for (size_t j = 0; j < node.bucketSize; ++j)
+                    {
+                        bool inside = true;
+                        for (size_t c = 0; c < Dimension && inside; ++c)
+                            inside = !(block[c * stride + j] < minPoint[c] || block[c * stride + j] > maxPoint[c]);
+                        if (inside)
+                            out.push_back(bucketOriginalPoints[node.bucketBegin + j]);
+                    }
+                    continue;
+                }
+
+                size_t coord = node.splitAxis;
+                bool inside = true;
+                for (size_t c = 0; c < Dimension; ++c)
+                {
+                    if (node.point[c] < minPoint[c] || node.point[c] > maxPoint[c])
+                    {
+                        inside = false;
+                        break;
+                    }
+                }
+                if (inside)
+                    out.push_back(originalPoints[index]);
+
+                // right is pushed first to visit nodes in preorder
+                if (node.right != kNullNode && !(maxPoint[coord] < node.point[coord]))
+                    pending.push(node.right);
+                if (node.left != kNullNode && !(minPoint[coord] > node.point[coord]))
+                    pending.push(node.left);
+            }
+        }
+
+    private:
+        std::vector<FrozenNode> nodes;                                  ///< Nodes in preorder. Root has index 0.
+        std::vector<const TCoord*> originalPoints;                      ///< Pointers to original coordinates of points for nodes
+        std::vector<TCoord, AlignedAllocator<TCoord, 64>> bucketCoordinates; ///< Blocks of coordinates for leaf buckets
+        std::vector<const TCoord*> bucketOriginalPoints;                ///< Pointers to original coordinates of points in leaf buckets
+        size_t numPoints;                                               ///< Number of points in the tree
+        size_t maxLeafSize;                                             ///< Maximum number of points in the leaf bucket
+        KdTreeFrozenLayout nodesLayout;                                 ///< Order of nodes in memory
+        Cmp cmp;                                                        ///< Used comparator
+    };
+}
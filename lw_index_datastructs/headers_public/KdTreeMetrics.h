@@ -0,0 +1,640 @@
+/** @file
+* @brief Policies of distance metric for KD-tree
+* @author konstantin.burlachenko@kaust.edu.sa
+*
+* Tree works with "reduced distance" - monotonic function of the true distance which is cheaper to compute, e.g. squared distance for L2.
+* Policy is a class with the following interface:
+* 1. "TNorm distance(const TCoord* a, const TCoord* b) const" - reduced distance between two points
+* 2. "TNorm axisDistance(TNorm delta, size_t axis) const" - reduced distance between two points which differ only by delta in coordinate "axis".
+*    It's lower bound of the reduced distance from the point to any point on the other side of axis aligned plane which is on distance delta.
+* 3. "TNorm accumulate(TNorm sum, TNorm axisTerm) const" - reduced distance between points is accumulation of axisDistance() by all axes starting from TNorm().
+* 4. "template <class T> T fromDistance(T distance) const" - convert true distance into reduced one. Should be homogeneous: fromDistance(c*d) == fromDistance(c)*fromDistance(d).
+* 5. Optional "TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm bound) const" - the same value as distance() if it's less then bound, otherwise any value which is not less then bound.
+*    Allows to stop evaluation when the partial sum reaches the bound (early abandonment). If it's absent distance() is used, see kdTreeBoundedDistance().
+*    Policy derived from the one below which redefines distance() should redefine boundedDistance() too.
+* 6. Optional "TNorm replaceAxisDistance(TNorm sum, TNorm oldAxisTerm, TNorm newAxisTerm) const" - accumulated distance in which term oldAxisTerm is replaced by not smaller term newAxisTerm.
+*    Used to update distance from request point to the cell of KD-tree in O(1). If it's absent max(sum, newAxisTerm) is used, which is a looser lower bound. See kdTreeReplaceAxisDistance().
+* All methods are called in hot loops, so they should be inline and without virtual calls.
+*/
+
+#pragma once
+
+#include "KdTreeSimd.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <limits>
+#include <type_traits>
+#include <algorithm>
+
+namespace lw_index_datastructs
+{
+    const size_t kKdTreeSimdIntegerMinDimension = 16; ///< Starting from this dimension squared distance for int16/int32 coordinates is evaluated by vectorized kernels
+    const size_t kKdTreeEarlyAbandonChunk = 8;        ///< Number of coordinates between checks of the partial distance against the bound. For lower dimensions the full distance is evaluated.
+
+    namespace metric_details
+    {
+        template <class Metric, class TCoord, class TNorm>
+        inline auto boundedDistance(const Metric& metric, const TCoord* a, const TCoord* b, TNorm bound, int /*preferred*/) -> decltype(metric.boundedDistance(a, b, bound)) {
+            return metric.boundedDistance(a, b, bound);
+        }
+
+        template <class Metric, class TCoord, class TNorm>
+        inline TNorm boundedDistance(const Metric& metric, const TCoord* a, const TCoord* b, TNorm /*bound*/, long /*fallback*/) {
+            return metric.distance(a, b);
+        }
+
+        template <class Metric, class TNorm>
+        inline auto replaceAxisDistance(const Metric& metric, TNorm sum, TNorm oldAxisTerm, TNorm newAxisTerm, int /*preferred*/) -> decltype(metric.replaceAxisDistance(sum, oldAxisTerm, newAxisTerm)) {
+            return metric.replaceAxisDistance(sum, oldAxisTerm, newAxisTerm);
+        }
+
+        template <class Metric, class TNorm>
+        inline TNorm replaceAxisDistance(const Metric& /*metric*/, TNorm sum, TNorm /*oldAxisTerm*/, TNorm newAxisTerm, long /*fallback*/) {
+            return sum < newAxisTerm ? newAxisTerm : sum;
+        }
+    }
+
+    /** Reduced distance with early abandonment for any metric policy
+    * @return metric.boundedDistance(a, b, bound) if policy provides it, otherwise metric.distance(a, b)
+    */
+    template <class Metric, class TCoord, class TNorm>
+    inline TNorm kdTreeBoundedDistance(const Metric& metric, const TCoord* a, const TCoord* b, TNorm bound) {
+        return metric_details::boundedDistance(metric, a, b, bound, 0);
+    }
+
+    /** Replace one term of accumulated reduced distance for any metric policy
+    * @return metric.replaceAxisDistance(sum, oldAxisTerm, newAxisTerm) if policy provides it, otherwise max(sum, newAxisTerm)
+    */
+    template <class Metric, class TNorm>
+    inline TNorm kdTreeReplaceAxisDistance(const Metric& metric, TNorm sum, TNorm oldAxisTerm, TNorm newAxisTerm) {
+        return metric_details::replaceAxisDistance(metric, sum, oldAxisTerm, newAxisTerm, 0);
+    }
+
+    /** Reduced distance as accumulation of axisDistance() with check of the bound after each kKdTreeEarlyAbandonChunk axes.
+    * Gives exactly the same value as distance() for policies which evaluate distance() as accumulation of axisDistance() in natural order of axes.
+    */
+    template <size_t Dimension, class Metric, class TCoord, class TNorm>
+    inline TNorm accumulateAxesWithBound(const Metric& metric, const TCoord* a, const TCoord* b, TNorm bound)
+    {
+        TNorm distance = TNorm();
+        size_t i = 0;
+        for (; i + kKdTreeEarlyAbandonChunk < Dimension; )
+        {
+            for (size_t j = 0; j < kKdTreeEarlyAbandonChunk; ++j, ++i)
+                distance = metric.accumulate(distance, metric.axisDistance(TNorm(a[i]) - TNorm(b[i]), i));
+            if (distance >= bound)
+                return distance;
+        }
+        for (; i < Dimension; ++i)
+            distance = metric.accumulate(distance, metric.axisDistance(TNorm(a[i]) - TNorm(b[i]), i));
+        return distance;
+    }
+
+    /** Check that squared Euclidean distance for coordinates of this type is evaluated in 64-bit integers.
+    * It's so for integer coordinates with at most 32 bits if norm can hold such distances: norm is floating point or integer with at least 64 bits.
+    * For narrower integer norms distance is accumulated in the norm itself and caller is responsible for absence of overflow.
+    */
+    template <class TCoord, class TNorm>
+    struct KdTreeHasWideIntegerDistance : public std::integral_constant<bool, std::numeric_limits<TCoord>::is_integer && sizeof(TCoord) <= 4 &&
+                                                                              (!std::numeric_limits<TNorm>::is_integer || sizeof(TNorm) >= 8)>
+    {};
+
+    /** Squared Euclidean distance for integer coordinates with at most 32 bits as two 64-bit words: distance = high * 2^64 + low.
+    * Differences are evaluated in int64_t and squares in uint64_t, so there is no overflow for all range of coordinates and no conversions into floating point in the loop.
+    * @param high output: distance divided by 2^64
+    * @return distance modulo 2^64
+    */
+    template <size_t Dimension, class TIntCoord>
+    inline uint64_t integerDistanceSqrTwoWords(const TIntCoord* a, const TIntCoord* b, uint64_t& high)
+    {
+        uint64_t distance = 0;
+        uint64_t carries = 0;
+        for (size_t i = 0; i < Dimension; ++i)
+        {
+            // |tmp| < 2^32, so square of tmp modulo 2^64 is the exact square
+            uint64_t tmp = uint64_t(int64_t(a[i]) - int64_t(b[i]));
+            uint64_t square = tmp * tmp;
+            distance += square;
+            // only 32-bit coordinates can overflow uint64_t for reasonable dimension. Carries are counted without branches.
+            if (sizeof(TIntCoord) == 4)
+                carries += distance < square;
+        }
+        high = carries;
+        return distance;
+    }
+
+    template <size_t Dimension>
+    inline uint64_t integerDistanceSqrTwoWords(const int32_t* a, const int32_t* b, uint64_t& high)
+    {
+        if (Dimension >= kKdTreeSimdIntegerMinDimension)
+        {
+            // vectorized kernel saturates the distance, rare big distances are evaluated again
+            uint64_t distance = simdDistanceSqr(a, b, Dimension);
+            if (distance != std::numeric_limits<uint64_t>::max())
+            {
+                high = 0;
+                return distance;
+            }
+        }
+        return integerDistanceSqrTwoWords<Dimension, int32_t>(a, b, high);
+    }
+
+    template <size_t Dimension>
+    inline uint64_t integerDistanceSqrTwoWords(const int16_t* a, const int16_t* b, uint64_t& high)
+    {
+        if (Dimension >= kKdTreeSimdIntegerMinDimension)
+        {
+            high = 0;
+            return simdDistanceSqr(a, b, Dimension);
+        }
+        return integerDistanceSqrTwoWords<Dimension, int16_t>(a, b, high);
+    }
+
+    /** Squared Euclidean distance for integer coordinates with at most 32 bits.
+    * @return exact distance if it's less then 2^64, otherwise 2^64-1
+    */
+    template <size_t Dimension, class TIntCoord>
+    inline uint64_t integerDistanceSqr(const TIntCoord* a, const TIntCoord* b)
+    {
+        uint64_t high = 0;
+        uint64_t distance = integerDistanceSqrTwoWords<Dimension, TIntCoord>(a, b, high);
+        return high != 0 ? std::numeric_limits<uint64_t>::max() : distance;
+    }
+
+    template <size_t Dimension>
+    inline uint64_t integerDistanceSqr(const int32_t* a, const int32_t* b)
+    {
+        uint64_t high = 0;
+        uint64_t distance = integerDistanceSqrTwoWords<Dimension>(a, b, high);
+        return high != 0 ? std::numeric_limits<uint64_t>::max() : distance;
+    }
+
+    template <size_t Dimension>
+    inline uint64_t integerDistanceSqr(const int16_t* a, const int16_t* b)
+    {
+        uint64_t high = 0;
+        return integerDistanceSqrTwoWords<Dimension>(a, b, high);
+    }
+
+    template <class TNorm>
+    inline TNorm integerDistanceToNorm(uint64_t low, uint64_t high, std::true_type /*integerNorm*/) {
+        return (high != 0 || low > uint64_t(std::numeric_limits<TNorm>::max())) ? std::numeric_limits<TNorm>::max() : TNorm(low);
+    }
+
+    template <class TNorm>
+    inline TNorm integerDistanceToNorm(uint64_t low, uint64_t high, std::false_type /*integerNorm*/) {
+        // high * 2^64 is exact in floating point
+        return TNorm(high) * TNorm(18446744073709551616.0) + TNorm(low);
+    }
+
+    /** Convert squared distance in two 64-bit words into the norm
+    * @return rounded value for floating point norm. Integer norm is saturated by its maximum if distance does not fit into it.
+    * @remark distances are not saturated for floating point norms, so they are consistent with bounds by split planes which are evaluated in the norm
+    */
+    template <class TNorm>
+    inline TNorm integerDistanceToNorm(uint64_t low, uint64_t high) {
+        return integerDistanceToNorm<TNorm>(low, high, std::integral_constant<bool, std::numeric_limits<TNorm>::is_integer>());
+    }
+
+    /** Euclidean metric. Reduced distance is squared distance.
+    * Integer coordinates with at most 32 bits are accumulated in 64-bit integers (see integerDistanceSqrTwoWords and KdTreeHasWideIntegerDistance), others are accumulated in TCoord.
+    * Floating point norms get distances for all range of such coordinates, 64-bit integer norms get exact distances which fit into them.
+    */
+    template <class TCoord, size_t Dimension, class TNorm = TCoord>
+    struct KdTreeL2Metric
+    {
+        TNorm distance(const TCoord* a, const TCoord* b) const {
+            return distance(a, b, KdTreeHasWideIntegerDistance<TCoord, TNorm>());
+        }
+
+        TNorm distance(const TCoord* a, const TCoord* b, std::true_type /*wideIntegerDistance*/) const
+        {
+            uint64_t high = 0;
+            uint64_t low = integerDistanceSqrTwoWords<Dimension>(a, b, high);
+            return integerDistanceToNorm<TNorm>(low, high);
+        }
+
+        TNorm distance(const TCoord* a, const TCoord* b, std::false_type /*wideIntegerDistance*/) const
+        {
+            TCoord distance = TCoord();
+            for (size_t i = 0; i < Dimension; ++i)
+            {
+                TNorm tmp = a[i] - b[i];
+                distance += tmp*tmp;
+            }
+            return TNorm(distance);
+        }
+
+        TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm bound) const {
+            return boundedDistance(a, b, bound, KdTreeHasWideIntegerDistance<TCoord, TNorm>());
+        }
+
+        TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm /*bound*/, std::true_type /*wideIntegerDistance*/) const {
+            // integer distance is cheap and vectorized, checks of the bound do not pay off
+            return distance(a, b, std::true_type());
+        }
+
+        TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm bound, std::false_type /*wideIntegerDistance*/) const
+        {
+            if (Dimension <= kKdTreeEarlyAbandonChunk)
+                return distance(a, b, std::false_type());
+
+            // the same order of summation as in distance()
+            TCoord distance = TCoord();
+            size_t i = 0;
+            for (; i + kKdTreeEarlyAbandonChunk < Dimension; )
+            {
+                for (size_t j = 0; j < kKdTreeEarlyAbandonChunk; ++j, ++i)
+                {
+                    TNorm tmp = a[i] - b[i];
+                    distance += tmp*tmp;
+                }
+                if (TNorm(distance) >= bound)
+                    return TNorm(distance);
+            }
+            for (; i < Dimension; ++i)
+            {
+                TNorm tmp = a[i] - b[i];
+                distance += tmp*tmp;
+            }
+            return TNorm(distance);
+        }
+
+        TNorm axisDistance(TNorm delta, size_t /*axis*/) const {
+            return delta * delta;
+        }
+
+        TNorm accumulate(TNorm sum, TNorm axisTerm) const {
+            return sum + axisTerm;
+        }
+
+        TNorm replaceAxisDistance(TNorm sum, TNorm oldAxisTerm, TNorm newAxisTerm) const {
+            return sum + (newAxisTerm - oldAxisTerm);
+        }
+
+        template <class T>
+        T fromDistance(T distance) const {
+            return distance * distance;
+        }
+    };
+
+    /** Euclidean metric which evaluates distances between points with vectorized kernels from KdTreeSimd.h. Reduced distance is squared distance.
+    * TCoord should be float, double, int32_t or int16_t. Instruction set is selected in runtime, so it pays off for Dimension about 8 and higher, for lower dimensions KdTreeL2Metric is faster.
+    * Integer distances are converted into the norm as in KdTreeL2Metric: integer norm is saturated by its maximum, so use floating point or 64-bit integer norm for big coordinates.
+    */
+    template <class TCoord, size_t Dimension, class TNorm = TCoord>
+    struct KdTreeSimdL2Metric : public KdTreeL2Metric<TCoord, Dimension, TNorm>
+    {
+        TNorm distance(const TCoord* a, const TCoord* b) const {
+            return simdDistance(a, b);
+        }
+
+        TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm bound) const {
+            return TNorm(simdBoundedDistance(a, b, bound));
+        }
+
+    private:
+        template <class T>
+        static TNorm simdDistance(const T* a, const T* b) {
+            return TNorm(simdDistanceSqr(a, b, Dimension));
+        }
+
+        static TNorm simdDistance(const int32_t* a, const int32_t* b)
+        {
+            // vectorized kernel saturates the distance, rare big distances are evaluated again
+            uint64_t high = 0;
+            uint64_t low = simdDistanceSqr(a, b, Dimension);
+            if (low == std::numeric_limits<uint64_t>::max())
+                low = integerDistanceSqrTwoWords<Dimension, int32_t>(a, b, high);
+            return integerDistanceToNorm<TNorm>(low, high);
+        }
+
+        static TNorm simdDistance(const int16_t* a, const int16_t* b) {
+            return integerDistanceToNorm<TNorm>(simdDistanceSqr(a, b, Dimension), 0);
+        }
+
+        // bound is checked by vectorized kernels only if it's representable in type of coordinates
+        static float simdBoundedDistance(const float* a, const float* b, float bound) {
+            return simdDistanceSqrWithBound(a, b, Dimension, bound);
+        }
+
+        static double simdBoundedDistance(const double* a, const double* b, double bound) {
+            return simdDistanceSqrWithBound(a, b, Dimension, bound);
+        }
+
+        template <class T, class TBound>
+        static TNorm simdBoundedDistance(const T* a, const T* b, TBound /*bound*/) {
+            return simdDistance(a, b);
+        }
+    };
+
+    /** Euclidean metric which sums squares of differences in the given order of axes. Reduced distance is squared distance.
+    * With axes ordered by decreasing variance the partial sum grows fast and boundedDistance() stops earlier on far points. Order does not change the tree, only the evaluation of distances.
+    * @remark due to the rounding distances for floating point coordinates may differ in the last bits from KdTreeL2Metric
+    */
+    template <class TCoord, size_t Dimension, class TNorm = TCoord>
+    struct KdTreeVarianceOrderedL2Metric
+    {
+        /** Ctor. Axes are summed in natural order.
+        */
+        KdTreeVarianceOrderedL2Metric()
+        {
+            for (size_t i = 0; i < Dimension; ++i)
+                order[i] = i;
+        }
+
+        /** Order axes by decreasing variance of coordinates of points
+        * @param ctr container with points, the same as for ctor of KD-tree
+        * @param num number of points in container
+        */
+        template <class Container>
+        void orderByVariance(const Container& ctr, size_t num)
+        {
+            double mean[Dimension] = {};
+            double variance[Dimension] = {};
+
+            // Welford's update is stable for big coordinates
+            for (size_t n = 0; n < num; ++n)
+            {
+                const TCoord* point = ctr[n];
+                for (size_t i = 0; i < Dimension; ++i)
+                {
+                    double delta = double(point[i]) - mean[i];
+                    mean[i] += delta / double(n + 1);
+                    variance[i] += delta * (double(point[i]) - mean[i]);
+                }
+            }
+
+            for (size_t i = 0; i < Dimension; ++i)
+                order[i] = i;
+            std::stable_sort(order, order + Dimension, AxisWithBiggerVariance(variance));
+        }
+
+        TNorm distance(const TCoord* a, const TCoord* b) const
+        {
+            TNorm distance = TNorm();
+            for (size_t i = 0; i < Dimension; ++i)
+            {
+                TNorm tmp = TNorm(a[order[i]]) - TNorm(b[order[i]]);
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm bound) const
+        {
+            TNorm distance = TNorm();
+            size_t i = 0;
+            for (; i + kKdTreeEarlyAbandonChunk < Dimension; )
+            {
+                for (size_t j = 0; j < kKdTreeEarlyAbandonChunk; ++j, ++i)
+                {
+                    TNorm tmp = TNorm(a[order[i]]) - TNorm(b[order[i]]);
+                    distance += tmp*tmp;
+                }
+                if (distance >= bound)
+                    return distance;
+            }
+            for (; i < Dimension; ++i)
+            {
+                TNorm tmp = TNorm(a[order[i]]) - TNorm(b[order[i]]);
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        TNorm axisDistance(TNorm delta, size_t /*axis*/) const {
+            return delta * delta;
+        }
+
+        TNorm accumulate(TNorm sum, TNorm axisTerm) const {
+            return sum + axisTerm;
+        }
+
+        TNorm replaceAxisDistance(TNorm sum, TNorm oldAxisTerm, TNorm newAxisTerm) const {
+            return sum + (newAxisTerm - oldAxisTerm);
+        }
+
+        template <class T>
+        T fromDistance(T distance) const {
+            return distance * distance;
+        }
+
+        size_t order[Dimension]; ///< axes in order of summation
+
+    private:
+        struct AxisWithBiggerVariance
+        {
+            explicit AxisWithBiggerVariance(const double* axisVariance)
+            : variance(axisVariance)
+            {}
+
+            bool operator()(size_t a, size_t b) const {
+                return variance[a] > variance[b];
+            }
+
+            const double* variance;
+        };
+    };
+
+    /** Check that policy is one of Euclidean metrics above. Structures with hardwired squared Euclidean distance (FrozenKDtree) accept only such policies.
+    */
+    template <class Metric>
+    struct KdTreeIsL2Metric : public std::false_type
+    {};
+
+    template <class TCoord, size_t Dimension, class TNorm>
+    struct KdTreeIsL2Metric<KdTreeL2Metric<TCoord, Dimension, TNorm> > : public std::true_type
+    {};
+
+    template <class TCoord, size_t Dimension, class TNorm>
+    struct KdTreeIsL2Metric<KdTreeSimdL2Metric<TCoord, Dimension, TNorm> > : public std::true_type
+    {};
+
+    template <class TCoord, size_t Dimension, class TNorm>
+    struct KdTreeIsL2Metric<KdTreeVarianceOrderedL2Metric<TCoord, Dimension, TNorm> > : public std::true_type
+    {};
+
+    /** Manhattan metric. Reduced distance is the distance itself.
+    */
+    template <class TCoord, size_t Dimension, class TNorm = TCoord>
+    struct KdTreeL1Metric
+    {
+        TNorm distance(const TCoord* a, const TCoord* b) const
+        {
+            TNorm distance = TNorm();
+            for (size_t i = 0; i < Dimension; ++i)
+            {
+                TNorm tmp = TNorm(a[i]) - TNorm(b[i]);
+                distance += tmp < TNorm() ? -tmp : tmp;
+            }
+            return distance;
+        }
+
+        TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm bound) const {
+            return accumulateAxesWithBound<Dimension>(*this, a, b, bound);
+        }
+
+        TNorm axisDistance(TNorm delta, size_t /*axis*/) const {
+            return delta < TNorm() ? -delta : delta;
+        }
+
+        TNorm accumulate(TNorm sum, TNorm axisTerm) const {
+            return sum + axisTerm;
+        }
+
+        TNorm replaceAxisDistance(TNorm sum, TNorm oldAxisTerm, TNorm newAxisTerm) const {
+            return sum + (newAxisTerm - oldAxisTerm);
+        }
+
+        template <class T>
+        T fromDistance(T distance) const {
+            return distance;
+        }
+    };
+
+    /** Chebyshev metric (maximum of absolute differences of coordinates). Reduced distance is the distance itself.
+    */
+    template <class TCoord, size_t Dimension, class TNorm = TCoord>
+    struct KdTreeLinfMetric
+    {
+        TNorm distance(const TCoord* a, const TCoord* b) const
+        {
+            TNorm distance = TNorm();
+            for (size_t i = 0; i < Dimension; ++i)
+            {
+                TNorm tmp = TNorm(a[i]) - TNorm(b[i]);
+                if (tmp < TNorm())
+                    tmp = -tmp;
+                if (tmp > distance)
+                    distance = tmp;
+            }
+            return distance;
+        }
+
+        TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm bound) const {
+            return accumulateAxesWithBound<Dimension>(*this, a, b, bound);
+        }
+
+        TNorm axisDistance(TNorm delta, size_t /*axis*/) const {
+            return delta < TNorm() ? -delta : delta;
+        }
+
+        TNorm accumulate(TNorm sum, TNorm axisTerm) const {
+            return axisTerm > sum ? axisTerm : sum;
+        }
+
+        TNorm replaceAxisDistance(TNorm sum, TNorm /*oldAxisTerm*/, TNorm newAxisTerm) const {
+            return accumulate(sum, newAxisTerm);
+        }
+
+        template <class T>
+        T fromDistance(T distance) const {
+            return distance;
+        }
+    };
+
+    /** Euclidean metric with non negative weight for each coordinate: sum(w[i] * (a[i] - b[i])^2). Reduced distance is squared distance.
+    */
+    template <class TCoord, size_t Dimension, class TNorm = TCoord>
+    struct KdTreeWeightedL2Metric
+    {
+        /** Ctor. All weights are equal to 1.
+        */
+        KdTreeWeightedL2Metric()
+        {
+            for (size_t i = 0; i < Dimension; ++i)
+                weights[i] = TNorm(1);
+        }
+
+        /** Ctor
+        * @param coordWeights array with Dimension non negative weights
+        */
+        explicit KdTreeWeightedL2Metric(const TNorm* coordWeights)
+        {
+            for (size_t i = 0; i < Dimension; ++i)
+                weights[i] = coordWeights[i];
+        }
+
+        TNorm distance(const TCoord* a, const TCoord* b) const
+        {
+            TNorm distance = TNorm();
+            for (size_t i = 0; i < Dimension; ++i)
+            {
+                TNorm tmp = TNorm(a[i]) - TNorm(b[i]);
+                distance += weights[i] * tmp * tmp;
+            }
+            return distance;
+        }
+
+        TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm bound) const {
+            return accumulateAxesWithBound<Dimension>(*this, a, b, bound);
+        }
+
+        TNorm axisDistance(TNorm delta, size_t axis) const {
+            return weights[axis] * delta * delta;
+        }
+
+        TNorm accumulate(TNorm sum, TNorm axisTerm) const {
+            return sum + axisTerm;
+        }
+
+        TNorm replaceAxisDistance(TNorm sum, TNorm oldAxisTerm, TNorm newAxisTerm) const {
+            return sum + (newAxisTerm - oldAxisTerm);
+        }
+
+        template <class T>
+        T fromDistance(T distance) const {
+            return distance * distance;
+        }
+
+        TNorm weights[Dimension]; ///< weight of each coordinate
+    };
+
+    /** Minkowski metric with p >= 1: (sum(|a[i] - b[i]|^p))^(1/p). Reduced distance is the p-th power of the distance. TNorm should be floating point type.
+    * @remark for p equal to 1 or 2 dedicated metrics are faster because they do not call pow()
+    */
+    template <class TCoord, size_t Dimension, class TNorm = TCoord>
+    struct KdTreeMinkowskiMetric
+    {
+        /** Ctor
+        * @param power p parameter of the metric
+        */
+        explicit KdTreeMinkowskiMetric(double power = 2.0)
+        : p(power)
+        {}
+
+        TNorm distance(const TCoord* a, const TCoord* b) const
+        {
+            TNorm distance = TNorm();
+            for (size_t i = 0; i < Dimension; ++i)
+                distance += axisDistance(TNorm(a[i]) - TNorm(b[i]), i);
+            return distance;
+        }
+
+        TNorm boundedDistance(const TCoord* a, const TCoord* b, TNorm bound) const {
+            return accumulateAxesWithBound<Dimension>(*this, a, b, bound);
+        }
+
+        TNorm axisDistance(TNorm delta, size_t /*axis*/) const {
+            return TNorm(pow(fabs(double(delta)), p));
+        }
+
+        TNorm accumulate(TNorm sum, TNorm axisTerm) const {
+            return sum + axisTerm;
+        }
+
+        TNorm replaceAxisDistance(TNorm sum, TNorm oldAxisTerm, TNorm newAxisTerm) const {
+            return sum + (newAxisTerm - oldAxisTerm);
+        }
+
+        template <class T>
+        T fromDistance(T distance) const {
+            return T(pow(double(distance), p));
+        }
+
+        double p; ///< power of the metric
+    };
+}
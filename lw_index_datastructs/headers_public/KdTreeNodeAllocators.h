@@ -0,0 +1,131 @@
+/** @file
+* @brief Policies for allocation of memory for nodes of KD-tree
+* @author konstantin.burlachenko@kaust.edu.sa
+*
+* Policy is a class with the following interface:
+* 1. "static const bool kReleaseAllAtOnce" - if true then tree never calls deallocate() for nodes and frees all memory by releaseAll()
+* 2. "void* allocate(size_t bytes, size_t alignment)" - allocate memory. If kReleaseAllAtOnce is false it should be thread safe because it's used from parallel build.
+* 3. "void deallocate(void* memory, size_t bytes)" - free memory obtained by allocate()
+* 4. "void releaseAll()" - free all memory obtained by allocate()
+* 5. "void swap(Policy& rhs)" - exchange content of two allocators
+* 6. Copy ctor should copy only configuration of allocator, but not allocated memory
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+namespace lw_index_datastructs
+{
+    /** Allocate every node with global operator new and free it with global operator delete
+    */
+    class KdTreeHeapNodeAllocator
+    {
+    public:
+        static const bool kReleaseAllAtOnce = false; ///< Nodes are freed one by one
+
+        /** Allocate memory
+        * @param bytes size of memory in bytes
+        * @param alignment required alignment. Should not be bigger then alignment which is provided by global operator new.
+        * @return pointer to allocated memory
+        */
+        void* allocate(size_t bytes, size_t alignment);
+
+        /** Free memory
+        * @param memory pointer to memory obtained by allocate()
+        * @param bytes size of memory in bytes
+        */
+        void deallocate(void* memory, size_t bytes);
+
+        /** Do nothing. All memory is freed via deallocate().
+        */
+        void releaseAll() {}
+
+        /** Do nothing. Allocator does not have a state.
+        */
+        void swap(KdTreeHeapNodeAllocator& /*rhs*/) {}
+    };
+
+    /** Allocate nodes from big contiguous chunks of memory. Memory for separate nodes is never freed, all chunks are freed at once by releaseAll().
+    */
+    class KdTreeArenaNodeAllocator
+    {
+    public:
+        static const bool kReleaseAllAtOnce = true;             ///< All nodes are freed at once
+        static const size_t kDefaultChunkSize = 2 * 1024 * 1024; ///< Default size of one chunk in bytes
+
+        /** Ctor. Memory is not allocated until the first request.
+        * @param chunkSizeInBytes size of one chunk. Bigger requests get own chunk.
+        * @param useHugePagesForChunks request from OS huge pages for chunks (2MB pages in x86-64). If OS does not provide them then regular pages are used.
+        */
+        explicit KdTreeArenaNodeAllocator(size_t chunkSizeInBytes = kDefaultChunkSize, bool useHugePagesForChunks = false);
+
+        /** Copy ctor. Copy only configuration, memory is not shared.
+        */
+        KdTreeArenaNodeAllocator(const KdTreeArenaNodeAllocator& rhs);
+
+        /** Assignment operator. Copy only configuration, all memory which have been allocated by this allocator is freed.
+        */
+        KdTreeArenaNodeAllocator& operator = (const KdTreeArenaNodeAllocator& rhs);
+
+        /** Dtor. Free all chunks.
+        */
+        ~KdTreeArenaNodeAllocator();
+
+        /** Allocate memory from current chunk
+        * @param bytes size of memory in bytes
+        * @param alignment required alignment. Should be power of two.
+        * @return pointer to allocated memory
+        * @remark not thread safe
+        */
+        void* allocate(size_t bytes, size_t alignment);
+
+        /** Do nothing. Memory is freed by releaseAll().
+        */
+        void deallocate(void* /*memory*/, size_t /*bytes*/) {}
+
+        /** Free all chunks. Time is ~number of chunks.
+        */
+        void releaseAll();
+
+        /** Exchange content of two allocators in constant time
+        */
+        void swap(KdTreeArenaNodeAllocator& rhs);
+
+        /** Get total size of all allocated chunks in bytes
+        */
+        size_t allocatedBytes() const;
+
+        /** Get number of allocated chunks
+        */
+        size_t chunksCount() const;
+
+        /** Check that at least one chunk has been placed into explicit huge pages or transparent huge pages have been requested for it
+        */
+        bool isHugePagesUsed() const;
+
+    private:
+        struct Chunk
+        {
+            void* memory;         ///< Start of chunk
+            size_t size;          ///< Size of chunk in bytes
+            bool mappedFromOS;    ///< Memory has been obtained directly from OS virtual memory manager
+            bool hugePages;       ///< Memory lies in huge pages
+        };
+
+        /** Get new chunk of memory at least of specified size
+        */
+        Chunk allocateChunk(size_t bytes) const;
+
+        /** Return chunk to the system
+        */
+        static void freeChunk(const Chunk& chunk);
+
+        std::vector<Chunk> chunks; ///< All allocated chunks
+        char* cursor;              ///< Start of free memory in current chunk
+        char* cursorEnd;           ///< End of current chunk
+        size_t chunkSize;          ///< Size of regular chunk
+        bool useHugePages;         ///< Try to use huge pages for chunks
+    };
+}
@@ -0,0 +1,92 @@
+/** @file
+* @brief Vectorized kernels for squared Euclidean distance with selection of instruction set in runtime
+* @author konstantin.burlachenko@kaust.edu.sa
+*
+* Kernels are compiled for several instruction sets (SSE4.2, AVX2 + FMA, AVX-512F) independently of the compiler flags of the project.
+* During the first call the best instruction set which is supported by CPU and OS is detected with CPUID, so one binary runs on any x86-64 machine.
+* On other architectures only portable scalar kernels are available.
+*
+* Kernels for one pair of points vectorize over coordinates, so the order of summation differs from the scalar loop and results for float/double may differ in the last bits.
+* Kernels for leaf buckets vectorize over points and sum coordinates in the natural order without FMA, so they give exactly the same result as the scalar loop.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace lw_index_datastructs
+{
+    /** Instruction set used by vectorized kernels. Levels are ordered, each next level requires all previous ones.
+    */
+    enum class KdTreeSimdLevel
+    {
+        eScalar = 0, ///< portable C++ code
+        eSSE42 = 1,  ///< 128-bit registers
+        eAVX2 = 2,   ///< 256-bit registers, fused multiply-add
+        eAVX512 = 3  ///< 512-bit registers, masked loads for the tails
+    };
+
+    /** Detect the best instruction set supported by CPU and enabled by OS
+    */
+    KdTreeSimdLevel detectSimdLevel();
+
+    /** Get instruction set used by the kernels now
+    */
+    KdTreeSimdLevel activeSimdLevel();
+
+    /** Force kernels to use specific instruction set. Used for testing and benchmarking of the kernels.
+    * @param level requested level. If it's not supported by the machine then the best supported one is used.
+    * @return instruction set which is used after the call
+    * @remark it's not safe to call it concurrently with evaluation of distances
+    */
+    KdTreeSimdLevel setActiveSimdLevel(KdTreeSimdLevel level);
+
+    /** Get human readable name of instruction set
+    */
+    const char* simdLevelName(KdTreeSimdLevel level);
+
+    /** Squared Euclidean distance between two points
+    * @param a coordinates of the first point
+    * @param b coordinates of the second point
+    * @param dimension number of coordinates
+    */
+    float simdDistanceSqr(const float* a, const float* b, size_t dimension);
+    double simdDistanceSqr(const double* a, const double* b, size_t dimension);
+
+    /** Squared Euclidean distance with early abandonment. Partial sum is checked after each chunk of coordinates which fills vector registers and evaluation stops when it reaches the bound.
+    * @param bound bound for the distance
+    * @return the same value as simdDistanceSqr() if it's less then bound, otherwise some value which is not less then bound
+    */
+    float simdDistanceSqrWithBound(const float* a, const float* b, size_t dimension, float bound);
+    double simdDistanceSqrWithBound(const double* a, const double* b, size_t dimension, double bound);
+
+    /** Squared Euclidean distance between two points with integer coordinates.
+    * Differences and their squares are evaluated in 64-bit integers without overflow for all range of coordinates.
+    * @return exact distance if it's less then 2^64, otherwise 2^64-1
+    */
+    uint64_t simdDistanceSqr(const int32_t* a, const int32_t* b, size_t dimension);
+    uint64_t simdDistanceSqr(const int16_t* a, const int16_t* b, size_t dimension);
+
+    /** Squared Euclidean distances from one request point to many points
+    * @param requestPoint coordinates of the request point
+    * @param points pointers to coordinates of points
+    * @param count number of points
+    * @param dimension number of coordinates
+    * @param distances output with place for "count" items
+    */
+    void simdDistancesSqr(const float* requestPoint, const float* const* points, size_t count, size_t dimension, float* distances);
+    void simdDistancesSqr(const double* requestPoint, const double* const* points, size_t count, size_t dimension, double* distances);
+    void simdDistancesSqr(const int32_t* requestPoint, const int32_t* const* points, size_t count, size_t dimension, uint64_t* distances);
+    void simdDistancesSqr(const int16_t* requestPoint, const int16_t* const* points, size_t count, size_t dimension, uint64_t* distances);
+
+    /** Squared Euclidean distances from one request point to points stored in structure-of-arrays form: first coordinate of all points, then second coordinate of all points, etc.
+    * @param block coordinates of points
+    * @param stride length of the row in the block. Distances are evaluated for all "stride" slots.
+    * @param dimension number of rows in the block
+    * @param requestPoint coordinates of the request point
+    * @param distances output with place for "stride" items
+    */
+    void simdBucketDistancesSqr(const float* block, size_t stride, size_t dimension, const float* requestPoint, float* distances);
+    void simdBucketDistancesSqr(const double* block, size_t stride, size_t dimension, const double* requestPoint, double* distances);
+}
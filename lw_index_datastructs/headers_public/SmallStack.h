@@ -0,0 +1,90 @@
+/** @file
+* @brief Stack with inline storage for iterative traversals of trees
+* @author konstantin.burlachenko@kaust.edu.sa
+*
+* First "InlineCapacity" items are stored inside the object itself, so for balanced trees traversal does not touch the heap.
+* Items above inline capacity go into dynamically allocated overflow storage, so depth of the traversal is limited only by memory.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <assert.h>
+#include <vector>
+
+namespace lw_index_datastructs
+{
+    template <class T,                        ///< Type of item. Should be cheap to copy.
+              size_t InlineCapacity = 64>     ///< Number of items which are stored without memory allocation
+    class SmallStack
+    {
+    public:
+        /** Ctor for empty stack
+        */
+        SmallStack()
+        : count(0)
+        {}
+
+        /** Push item on top of the stack
+        */
+        void push(const T& item)
+        {
+            if (count < InlineCapacity)
+                inlineItems[count] = item;
+            else
+                overflowItems.push_back(item);
+            count++;
+        }
+
+        /** Remove item from top of the stack
+        * @return removed item
+        */
+        T pop()
+        {
+            assert(count > 0);
+            count--;
+            if (count < InlineCapacity)
+                return inlineItems[count];
+
+            T item = overflowItems.back();
+            overflowItems.pop_back();
+            return item;
+        }
+
+        /** Get item on top of the stack
+        */
+        T& top()
+        {
+            assert(count > 0);
+            if (count <= InlineCapacity)
+                return inlineItems[count - 1];
+            else
+                return overflowItems.back();
+        }
+
+        /** Check that stack is empty
+        */
+        bool empty() const {
+            return count == 0;
+        }
+
+        /** Get number of items in the stack
+        */
+        size_t size() const {
+            return count;
+        }
+
+        /** Remove all items. Overflow storage is kept for reuse.
+        */
+        void clear()
+        {
+            count = 0;
+            overflowItems.clear();
+        }
+
+    private:
+        T inlineItems[InlineCapacity];  ///< Storage for the first items
+        std::vector<T> overflowItems;   ///< Storage for items above InlineCapacity
+        size_t count;                   ///< Number of items in the stack
+    };
+}
@@ -0,0 +1,108 @@
+/** @file
+* @brief Pool of worker threads with work-stealing scheduling of tasks
+* @author konstantin.burlachenko@kaust.edu.sa
+*
+* Each worker owns a double-ended queue of tasks. Worker takes tasks from the back of own queue (LIFO order keeps recently created
+* and so hot in cache subproblems on the same core) and when own queue is empty it steals tasks from the front of queues of other workers.
+* Such scheduling suits well for fork-join recursive algorithms like construction of KD-tree subtrees.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace lw_index_datastructs
+{
+    class WorkStealingTaskPool
+    {
+    public:
+        typedef std::function<void()> Task; ///< Type of task which can be executed by pool. Task should not throw exceptions.
+
+        /** Ctor. Start worker threads.
+        * @param threadsCount number of worker threads. Zero means to use number of hardware threads.
+        */
+        explicit WorkStealingTaskPool(size_t threadsCount = 0);
+
+        /** Dtor. Wait for completion of all submitted tasks and stop worker threads.
+        */
+        ~WorkStealingTaskPool();
+
+        /** Get number of worker threads
+        */
+        size_t threadsCount() const;
+
+        /** Submit task for execution. If call is performed from worker thread of this pool task is placed into queue of this worker.
+        * @param task task to execute
+        */
+        void submit(Task task);
+
+        /** Execute one pending task in the calling thread if there is any. Used by threads which are waiting for completion of tasks.
+        * @return true if some task has been executed
+        */
+        bool tryRunPendingTask();
+
+    private:
+        WorkStealingTaskPool(const WorkStealingTaskPool&) = delete;
+        WorkStealingTaskPool& operator = (const WorkStealingTaskPool&) = delete;
+
+        struct WorkerQueue
+        {
+            std::mutex lock;         ///< Lock which protect tasks
+            std::deque<Task> tasks;  ///< Owner works with back of the queue, thieves work with front of the queue
+        };
+
+        /** Entry point for worker thread
+        */
+        void workerLoop(size_t workerIndex);
+
+        /** Find task in own queue or steal it from other queues
+        */
+        bool takeTask(size_t firstQueue, Task& task);
+
+        std::vector<std::unique_ptr<WorkerQueue>> queues; ///< Queue per worker
+        std::vector<std::thread> workers;                 ///< Worker threads
+        std::mutex sleepLock;                             ///< Lock used to sleep when there are no tasks
+        std::condition_variable wakeUp;                   ///< Condition to wake up sleeping workers
+        std::atomic<size_t> pendingTasks;                 ///< Number of tasks in all queues and tasks which are being submitted. Never less then number of tasks in queues.
+        std::atomic<size_t> nextExternalQueue;            ///< Round robin counter for tasks submitted not from worker threads
+        bool stopFlag;                                    ///< Flag for worker threads to finish. Protected by sleepLock.
+    };
+
+    /** Group of tasks with ability to wait for completion of all of them. Tasks of the group can spawn new tasks into the same group.
+    */
+    class TaskGroup
+    {
+    public:
+        /** Ctor
+        * @param taskPool pool which executes tasks of the group
+        */
+        explicit TaskGroup(WorkStealingTaskPool& taskPool);
+
+        /** Dtor. Wait for completion of all tasks.
+        */
+        ~TaskGroup();
+
+        /** Submit task into the group
+        */
+        void run(WorkStealingTaskPool::Task task);
+
+        /** Wait for completion of all tasks in the group. Calling thread helps to execute pending tasks while waiting.
+        */
+        void wait();
+
+    private:
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator = (const TaskGroup&) = delete;
+
+        WorkStealingTaskPool& pool;        ///< Pool which executes tasks
+        std::atomic<size_t> unfinished;    ///< Number of not finished tasks
+    };
+}
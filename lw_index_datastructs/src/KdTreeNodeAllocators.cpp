@@ -0,0 +1,210 @@
+#include "lw_index_datastructs/headers_public/KdTreeNodeAllocators.h"
+
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <utility>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#elif defined(__linux__)
+    #include <sys/mman.h>
+#endif
+
+namespace lw_index_datastructs
+{
+    namespace
+    {
+        const size_t kHugePageSize = 2 * 1024 * 1024; ///< Size of huge page in x86-64
+
+        size_t roundUp(size_t value, size_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    void* KdTreeHeapNodeAllocator::allocate(size_t bytes, size_t /*alignment*/)
+    {
+        return ::operator new(bytes);
+    }
+
+    void KdTreeHeapNodeAllocator::deallocate(void* memory, size_t /*bytes*/)
+    {
+        ::operator delete(memory);
+    }
+
+    KdTreeArenaNodeAllocator::KdTreeArenaNodeAllocator(size_t chunkSizeInBytes, bool useHugePagesForChunks)
+    : cursor(nullptr)
+    , cursorEnd(nullptr)
+    , chunkSize(chunkSizeInBytes)
+    , useHugePages(useHugePagesForChunks)
+    {
+        if (useHugePages)
+            chunkSize = roundUp(chunkSize, kHugePageSize);
+    }
+
+    KdTreeArenaNodeAllocator::KdTreeArenaNodeAllocator(const KdTreeArenaNodeAllocator& rhs)
+    : cursor(nullptr)
+    , cursorEnd(nullptr)
+    , chunkSize(rhs.chunkSize)
+    , useHugePages(rhs.useHugePages)
+    {}
+
+    KdTreeArenaNodeAllocator& KdTreeArenaNodeAllocator::operator = (const KdTreeArenaNodeAllocator& rhs)
+    {
+        if (this != &rhs)
+        {
+            releaseAll();
+            chunkSize = rhs.chunkSize;
+            useHugePages = rhs.useHugePages;
+        }
+        return *this;
+    }
+
+    KdTreeArenaNodeAllocator::~KdTreeArenaNodeAllocator()
+    {
+        releaseAll();
+    }
+
+    void* KdTreeArenaNodeAllocator::allocate(size_t bytes, size_t alignment)
+    {
+        uintptr_t start = roundUp(reinterpret_cast<uintptr_t>(cursor), alignment);
+        if (cursor != nullptr && start + bytes <= reinterpret_cast<uintptr_t>(cursorEnd))
+        {
+            cursor = reinterpret_cast<char*>(start + bytes);
+            return reinterpret_cast<void*>(start);
+        }
+
+        size_t requiredBytes = bytes + alignment;
+        if (requiredBytes > chunkSize)
+        {
+            // big request lives in own chunk, current chunk is used further for small requests
+            Chunk dedicated = allocateChunk(requiredBytes);
+            chunks.push_back(dedicated);
+            return reinterpret_cast<void*>(roundUp(reinterpret_cast<uintptr_t>(dedicated.memory), alignment));
+        }
+
+        Chunk regular = allocateChunk(chunkSize);
+        chunks.push_back(regular);
+        cursor = static_cast<char*>(regular.memory);
+        cursorEnd = cursor + regular.size;
+
+        start = roundUp(reinterpret_cast<uintptr_t>(cursor), alignment);
+        cursor = reinterpret_cast<char*>(start + bytes);
+        return reinterpret_cast<void*>(start);
+    }
+
+    void KdTreeArenaNodeAllocator::releaseAll()
+    {
+        for (size_t i = 0; i < chunks.size(); ++i)
+            freeChunk(chunks[i]);
+        chunks.clear();
+        cursor = nullptr;
+        cursorEnd = nullptr;
+    }
+
+    void KdTreeArenaNodeAllocator::swap(KdTreeArenaNodeAllocator& rhs)
+    {
+        chunks.swap(rhs.chunks);
+        std::swap(cursor, rhs.cursor);
+        std::swap(cursorEnd, rhs.cursorEnd);
+        std::swap(chunkSize, rhs.chunkSize);
+        std::swap(useHugePages, rhs.useHugePages);
+    }
+
+    size_t KdTreeArenaNodeAllocator::allocatedBytes() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < chunks.size(); ++i)
+            total += chunks[i].size;
+        return total;
+    }
+
+    size_t KdTreeArenaNodeAllocator::chunksCount() const
+    {
+        return chunks.size();
+    }
+
+    bool KdTreeArenaNodeAllocator::isHugePagesUsed() const
+    {
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            if (chunks[i].hugePages)
+                return true;
+        }
+        return false;
+    }
+
+    KdTreeArenaNodeAllocator::Chunk KdTreeArenaNodeAllocator::allocateChunk(size_t bytes) const
+    {
+        Chunk chunk = {nullptr, bytes, false, false};
+
+        if (useHugePages)
+        {
+            chunk.size = roundUp(bytes, kHugePageSize);
+#if defined(_WIN32)
+            // Large pages require "Lock pages in memory" privilege. Without it the request fails and regular pages are used.
+            SIZE_T largePage = GetLargePageMinimum();
+            if (largePage != 0)
+            {
+                SIZE_T largeSize = roundUp(chunk.size, largePage);
+                chunk.memory = VirtualAlloc(nullptr, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                if (chunk.memory)
+                {
+                    chunk.size = largeSize;
+                    chunk.mappedFromOS = true;
+                    chunk.hugePages = true;
+                    return chunk;
+                }
+            }
+            chunk.memory = VirtualAlloc(nullptr, chunk.size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            if (chunk.memory)
+            {
+                chunk.mappedFromOS = true;
+                return chunk;
+            }
+#elif defined(__linux__)
+    #if defined(MAP_HUGETLB)
+            // Explicit huge pages are available only if administrator reserved them (vm.nr_hugepages)
+            chunk.memory = mmap(nullptr, chunk.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (chunk.memory != MAP_FAILED)
+            {
+                chunk.mappedFromOS = true;
+                chunk.hugePages = true;
+                return chunk;
+            }
+    #endif
+            chunk.memory = mmap(nullptr, chunk.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (chunk.memory != MAP_FAILED)
+            {
+                chunk.mappedFromOS = true;
+    #if defined(MADV_HUGEPAGE)
+                // Ask for transparent huge pages
+                chunk.hugePages = (madvise(chunk.memory, chunk.size, MADV_HUGEPAGE) == 0);
+    #endif
+                return chunk;
+            }
+#endif
+            chunk.size = bytes;
+        }
+
+        chunk.memory = ::operator new(chunk.size);
+        chunk.mappedFromOS = false;
+        chunk.hugePages = false;
+        return chunk;
+    }
+
+    void KdTreeArenaNodeAllocator::freeChunk(const Chunk& chunk)
+    {
+        if (!chunk.mappedFromOS)
+        {
+            ::operator delete(chunk.memory);
+            return;
+        }
+
+#if defined(_WIN32)
+        VirtualFree(chunk.memory, 0, MEM_RELEASE);
+#elif defined(__linux__)
+        munmap(chunk.memory, chunk.size);
+#endif
+    }
+}
@@ -0,0 +1,1070 @@
+#include "lw_index_datastructs/headers_public/KdTreeSimd.h"
+
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define LW_SIMD_X86_64 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#else
+    #define LW_SIMD_X86_64 0
+#endif
+
+// GCC and Clang generate code for instruction set of the function from its attribute, so flags of the project are not needed.
+// MSVC allows any intrinsics in any function.
+#if defined(__GNUC__) || defined(__clang__)
+    #define LW_SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define LW_SIMD_TARGET(isa)
+#endif
+
+// Bucket kernels give exactly the same result as the scalar loop, so the compiler should not fuse their multiplications and additions into FMA.
+// GCC fuses them by default (-ffp-contract=fast), Clang fuses only operations inside one expression of the source, which are not split between intrinsics.
+#if defined(__GNUC__) && !defined(__clang__)
+    #define LW_SIMD_NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+    #define LW_SIMD_NO_FP_CONTRACT
+#endif
+
+#if defined(_MSC_VER)
+    #pragma fp_contract(off)
+#endif
+
+namespace lw_index_datastructs
+{
+    namespace
+    {
+        /** Set of kernels for one instruction set
+        */
+        struct SimdKernels
+        {
+            KdTreeSimdLevel level;
+
+            float (*distanceFloat)(const float* a, const float* b, size_t dimension);
+            double (*distanceDouble)(const double* a, const double* b, size_t dimension);
+            uint64_t (*distanceInt32)(const int32_t* a, const int32_t* b, size_t dimension);
+            uint64_t (*distanceInt16)(const int16_t* a, const int16_t* b, size_t dimension);
+
+            float (*boundedDistanceFloat)(const float* a, const float* b, size_t dimension, float bound);
+            double (*boundedDistanceDouble)(const double* a, const double* b, size_t dimension, double bound);
+
+            void (*distancesFloat)(const float* requestPoint, const float* const* points, size_t count, size_t dimension, float* distances);
+            void (*distancesDouble)(const double* requestPoint, const double* const* points, size_t count, size_t dimension, double* distances);
+            void (*distancesInt32)(const int32_t* requestPoint, const int32_t* const* points, size_t count, size_t dimension, uint64_t* distances);
+            void (*distancesInt16)(const int16_t* requestPoint, const int16_t* const* points, size_t count, size_t dimension, uint64_t* distances);
+
+            void (*bucketFloat)(const float* block, size_t stride, size_t dimension, const float* requestPoint, float* distances);
+            void (*bucketDouble)(const double* block, size_t stride, size_t dimension, const double* requestPoint, double* distances);
+        };
+
+        //=========================== Scalar kernels ======================================
+        template <class T>
+        T distanceSqrScalar(const T* a, const T* b, size_t dimension)
+        {
+            T distance = T();
+            for (size_t i = 0; i < dimension; ++i)
+            {
+                T tmp = a[i] - b[i];
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        const size_t kScalarBoundCheckChunk = 8; ///< Number of coordinates between checks of the bound in scalar kernel with early abandonment
+
+        template <class T>
+        T distanceSqrWithBoundScalar(const T* a, const T* b, size_t dimension, T bound)
+        {
+            T distance = T();
+            for (size_t i = 0; i < dimension; ++i)
+            {
+                T tmp = a[i] - b[i];
+                distance += tmp*tmp;
+                if ((i + 1) % kScalarBoundCheckChunk == 0 && distance >= bound)
+                    return distance;
+            }
+            return distance;
+        }
+
+        /** Absolute difference of two int32_t. It always fits into uint32_t.
+        */
+        inline uint64_t absDifference(int32_t a, int32_t b) {
+            return a > b ? uint64_t(int64_t(a) - int64_t(b)) : uint64_t(int64_t(b) - int64_t(a));
+        }
+
+        const uint64_t kSaturatedDistance = std::numeric_limits<uint64_t>::max(); ///< Result of integer kernels if distance does not fit into uint64_t
+
+        /** Check that sum of "dimension" squares of numbers which are at most maxDifference fits into uint64_t.
+        * Check is conservative and avoids integer division, if it fails the distance is evaluated again with saturation.
+        */
+        inline bool sumOfSquaresFits(uint64_t maxDifference, size_t dimension) {
+            return double(maxDifference) * double(maxDifference) * double(dimension) < 1.8e19;
+        }
+
+        /** Squared distance with saturation. Vectorized int32 kernels fall back to it if result may not fit into uint64_t.
+        */
+        uint64_t distanceSqrInt32Scalar(const int32_t* a, const int32_t* b, size_t dimension)
+        {
+            uint64_t distance = 0;
+            for (size_t i = 0; i < dimension; ++i)
+            {
+                uint64_t tmp = absDifference(a[i], b[i]);
+                distance += tmp*tmp;
+                if (distance < tmp*tmp)
+                    return kSaturatedDistance;
+            }
+            return distance;
+        }
+
+        /** Squared distance for int16 coordinates. Each square is less then 2^32, so the sum can not overflow for any practical dimension.
+        */
+        uint64_t distanceSqrInt16Scalar(const int16_t* a, const int16_t* b, size_t dimension)
+        {
+            uint64_t distance = 0;
+            for (size_t i = 0; i < dimension; ++i)
+            {
+                uint64_t tmp = absDifference(a[i], b[i]);
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        template <class T>
+        void distancesSqrScalar(const T* requestPoint, const T* const* points, size_t count, size_t dimension, T* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrScalar(requestPoint, points[j], dimension);
+        }
+
+        void distancesSqrInt32Scalar(const int32_t* requestPoint, const int32_t* const* points, size_t count, size_t dimension, uint64_t* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrInt32Scalar(requestPoint, points[j], dimension);
+        }
+
+        void distancesSqrInt16Scalar(const int16_t* requestPoint, const int16_t* const* points, size_t count, size_t dimension, uint64_t* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrInt16Scalar(requestPoint, points[j], dimension);
+        }
+
+        template <class T>
+        void bucketDistancesSqrScalar(const T* block, size_t stride, size_t dimension, const T* requestPoint, T* distances)
+        {
+            for (size_t j = 0; j < stride; ++j)
+                distances[j] = T();
+
+            for (size_t c = 0; c < dimension; ++c)
+            {
+                const T requestCoord = requestPoint[c];
+                const T* row = block + c * stride;
+                for (size_t j = 0; j < stride; ++j)
+                {
+                    T tmp = row[j] - requestCoord;
+                    distances[j] += tmp*tmp;
+                }
+            }
+        }
+
+        /** Evaluate part of the bucket [begin, stride) with scalar code. Used for the tails of vectorized kernels.
+        */
+        template <class T>
+        void bucketTailScalar(const T* block, size_t stride, size_t dimension, const T* requestPoint, T* distances, size_t begin)
+        {
+            for (size_t j = begin; j < stride; ++j)
+            {
+                T distance = T();
+                for (size_t c = 0; c < dimension; ++c)
+                {
+                    T tmp = block[c * stride + j] - requestPoint[c];
+                    distance += tmp*tmp;
+                }
+                distances[j] = distance;
+            }
+        }
+
+        const SimdKernels kScalarKernels = {
+            KdTreeSimdLevel::eScalar,
+            &distanceSqrScalar<float>, &distanceSqrScalar<double>, &distanceSqrInt32Scalar, &distanceSqrInt16Scalar,
+            &distanceSqrWithBoundScalar<float>, &distanceSqrWithBoundScalar<double>,
+            &distancesSqrScalar<float>, &distancesSqrScalar<double>, &distancesSqrInt32Scalar, &distancesSqrInt16Scalar,
+            &bucketDistancesSqrScalar<float>, &bucketDistancesSqrScalar<double>
+        };
+
+#if LW_SIMD_X86_64
+        //=========================== SSE4.2 kernels ======================================
+        LW_SIMD_TARGET("sse4.2") inline float horizontalSum(__m128 v)
+        {
+            v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+            v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+            return _mm_cvtss_f32(v);
+        }
+
+        LW_SIMD_TARGET("sse4.2") inline double horizontalSum(__m128d v) {
+            return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+        }
+
+        LW_SIMD_TARGET("sse4.2") inline uint64_t horizontalSum(__m128i v) {
+            return uint64_t(_mm_cvtsi128_si64(v)) + uint64_t(_mm_extract_epi64(v, 1));
+        }
+
+        LW_SIMD_TARGET("sse4.2") inline uint32_t horizontalMaxEpu32(__m128i v)
+        {
+            v = _mm_max_epu32(v, _mm_shuffle_epi32(v, 0x4E));
+            v = _mm_max_epu32(v, _mm_shuffle_epi32(v, 0xB1));
+            return uint32_t(_mm_cvtsi128_si32(v));
+        }
+
+        /** Squares of absolute differences of int32 lanes accumulated into two uint64 lanes. Absolute differences are used to check overflow of the sum at the end.
+        */
+        LW_SIMD_TARGET("sse4.2") inline __m128i accumulateSquaredDifferences(__m128i acc, __m128i& maxDifference, __m128i x, __m128i y)
+        {
+            __m128i d = _mm_sub_epi32(_mm_max_epi32(x, y), _mm_min_epi32(x, y));
+            maxDifference = _mm_max_epu32(maxDifference, d);
+            acc = _mm_add_epi64(acc, _mm_mul_epu32(d, d));
+            d = _mm_srli_epi64(d, 32);
+            return _mm_add_epi64(acc, _mm_mul_epu32(d, d));
+        }
+
+        /** Squares of absolute differences of int16 lanes accumulated into two uint64 lanes.
+        * @remark pmaddwd can not be used because difference of int16 needs 17 bits, so squares are split into low and high halves with pmullw and pmulhuw
+        */
+        LW_SIMD_TARGET("sse4.2") inline __m128i accumulateSquaredDifferencesInt16(__m128i acc, __m128i x, __m128i y)
+        {
+            __m128i d = _mm_sub_epi16(_mm_max_epi16(x, y), _mm_min_epi16(x, y));
+            __m128i low = _mm_mullo_epi16(d, d);
+            __m128i high = _mm_mulhi_epu16(d, d);
+            __m128i squares0 = _mm_unpacklo_epi16(low, high);
+            __m128i squares1 = _mm_unpackhi_epi16(low, high);
+            __m128i zero = _mm_setzero_si128();
+            acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(squares0, zero));
+            acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(squares0, zero));
+            acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(squares1, zero));
+            return _mm_add_epi64(acc, _mm_unpackhi_epi32(squares1, zero));
+        }
+
+        template <bool WithBound>
+        LW_SIMD_TARGET("sse4.2") inline float distanceSqrFloatSse(const float* a, const float* b, size_t dimension, float bound)
+        {
+            __m128 acc0 = _mm_setzero_ps();
+            __m128 acc1 = _mm_setzero_ps();
+            size_t i = 0;
+            for (; i + 8 <= dimension; i += 8)
+            {
+                __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+                __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+                if (WithBound)
+                {
+                    float partial = horizontalSum(_mm_add_ps(acc0, acc1));
+                    if (partial >= bound)
+                        return partial;
+                }
+            }
+            for (; i + 4 <= dimension; i += 4)
+            {
+                __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+            }
+            float distance = horizontalSum(_mm_add_ps(acc0, acc1));
+            for (; i < dimension; ++i)
+            {
+                float tmp = a[i] - b[i];
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        template <bool WithBound>
+        LW_SIMD_TARGET("sse4.2") inline double distanceSqrDoubleSse(const double* a, const double* b, size_t dimension, double bound)
+        {
+            __m128d acc0 = _mm_setzero_pd();
+            __m128d acc1 = _mm_setzero_pd();
+            size_t i = 0;
+            for (; i + 4 <= dimension; i += 4)
+            {
+                __m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+                __m128d d1 = _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));
+                acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+                acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+                if (WithBound)
+                {
+                    double partial = horizontalSum(_mm_add_pd(acc0, acc1));
+                    if (partial >= bound)
+                        return partial;
+                }
+            }
+            for (; i + 2 <= dimension; i += 2)
+            {
+                __m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+                acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+            }
+            double distance = horizontalSum(_mm_add_pd(acc0, acc1));
+            for (; i < dimension; ++i)
+            {
+                double tmp = a[i] - b[i];
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        LW_SIMD_TARGET("sse4.2") inline uint64_t distanceSqrInt32Sse(const int32_t* a, const int32_t* b, size_t dimension)
+        {
+            __m128i acc = _mm_setzero_si128();
+            __m128i maxDifference = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + 4 <= dimension; i += 4)
+            {
+                acc = accumulateSquaredDifferences(acc, maxDifference, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+            }
+            uint64_t distance = horizontalSum(acc);
+            uint64_t maxTmp = horizontalMaxEpu32(maxDifference);
+            for (; i < dimension; ++i)
+            {
+                uint64_t tmp = absDifference(a[i], b[i]);
+                distance += tmp*tmp;
+                maxTmp = tmp > maxTmp ? tmp : maxTmp;
+            }
+            return sumOfSquaresFits(maxTmp, dimension) ? distance : distanceSqrInt32Scalar(a, b, dimension);
+        }
+
+        LW_SIMD_TARGET("sse4.2") inline uint64_t distanceSqrInt16Sse(const int16_t* a, const int16_t* b, size_t dimension)
+        {
+            __m128i acc = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + 8 <= dimension; i += 8)
+            {
+                acc = accumulateSquaredDifferencesInt16(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+            }
+            uint64_t distance = horizontalSum(acc);
+            for (; i < dimension; ++i)
+            {
+                uint64_t tmp = absDifference(a[i], b[i]);
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        LW_SIMD_TARGET("sse4.2") float distanceSqrFloatSseKernel(const float* a, const float* b, size_t dimension) {
+            return distanceSqrFloatSse<false>(a, b, dimension, float());
+        }
+
+        LW_SIMD_TARGET("sse4.2") float distanceSqrFloatSseWithBoundKernel(const float* a, const float* b, size_t dimension, float bound) {
+            return distanceSqrFloatSse<true>(a, b, dimension, bound);
+        }
+
+        LW_SIMD_TARGET("sse4.2") double distanceSqrDoubleSseKernel(const double* a, const double* b, size_t dimension) {
+            return distanceSqrDoubleSse<false>(a, b, dimension, double());
+        }
+
+        LW_SIMD_TARGET("sse4.2") double distanceSqrDoubleSseWithBoundKernel(const double* a, const double* b, size_t dimension, double bound) {
+            return distanceSqrDoubleSse<true>(a, b, dimension, bound);
+        }
+
+        LW_SIMD_TARGET("sse4.2") uint64_t distanceSqrInt32SseKernel(const int32_t* a, const int32_t* b, size_t dimension) {
+            return distanceSqrInt32Sse(a, b, dimension);
+        }
+
+        LW_SIMD_TARGET("sse4.2") uint64_t distanceSqrInt16SseKernel(const int16_t* a, const int16_t* b, size_t dimension) {
+            return distanceSqrInt16Sse(a, b, dimension);
+        }
+
+        LW_SIMD_TARGET("sse4.2") void distancesSqrFloatSse(const float* requestPoint, const float* const* points, size_t count, size_t dimension, float* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrFloatSse<false>(requestPoint, points[j], dimension, float());
+        }
+
+        LW_SIMD_TARGET("sse4.2") void distancesSqrDoubleSse(const double* requestPoint, const double* const* points, size_t count, size_t dimension, double* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrDoubleSse<false>(requestPoint, points[j], dimension, double());
+        }
+
+        LW_SIMD_TARGET("sse4.2") void distancesSqrInt32Sse(const int32_t* requestPoint, const int32_t* const* points, size_t count, size_t dimension, uint64_t* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrInt32Sse(requestPoint, points[j], dimension);
+        }
+
+        LW_SIMD_TARGET("sse4.2") void distancesSqrInt16Sse(const int16_t* requestPoint, const int16_t* const* points, size_t count, size_t dimension, uint64_t* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrInt16Sse(requestPoint, points[j], dimension);
+        }
+
+        LW_SIMD_TARGET("sse4.2") LW_SIMD_NO_FP_CONTRACT void bucketDistancesSqrFloatSse(const float* block, size_t stride, size_t dimension, const float* requestPoint, float* distances)
+        {
+            size_t j = 0;
+            for (; j + 4 <= stride; j += 4)
+            {
+                __m128 acc = _mm_setzero_ps();
+                for (size_t c = 0; c < dimension; ++c)
+                {
+                    __m128 d = _mm_sub_ps(_mm_loadu_ps(block + c * stride + j), _mm_set1_ps(requestPoint[c]));
+                    acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+                }
+                _mm_storeu_ps(distances + j, acc);
+            }
+            bucketTailScalar(block, stride, dimension, requestPoint, distances, j);
+        }
+
+        LW_SIMD_TARGET("sse4.2") LW_SIMD_NO_FP_CONTRACT void bucketDistancesSqrDoubleSse(const double* block, size_t stride, size_t dimension, const double* requestPoint, double* distances)
+        {
+            size_t j = 0;
+            for (; j + 2 <= stride; j += 2)
+            {
+                __m128d acc = _mm_setzero_pd();
+                for (size_t c = 0; c < dimension; ++c)
+                {
+                    __m128d d = _mm_sub_pd(_mm_loadu_pd(block + c * stride + j), _mm_set1_pd(requestPoint[c]));
+                    acc = _mm_add_pd(acc, _mm_mul_pd(d, d));
+                }
+                _mm_storeu_pd(distances + j, acc);
+            }
+            bucketTailScalar(block, stride, dimension, requestPoint, distances, j);
+        }
+
+        const SimdKernels kSseKernels = {
+            KdTreeSimdLevel::eSSE42,
+            &distanceSqrFloatSseKernel, &distanceSqrDoubleSseKernel, &distanceSqrInt32SseKernel, &distanceSqrInt16SseKernel,
+            &distanceSqrFloatSseWithBoundKernel, &distanceSqrDoubleSseWithBoundKernel,
+            &distancesSqrFloatSse, &distancesSqrDoubleSse, &distancesSqrInt32Sse, &distancesSqrInt16Sse,
+            &bucketDistancesSqrFloatSse, &bucketDistancesSqrDoubleSse
+        };
+
+        //=========================== AVX2 kernels ========================================
+        LW_SIMD_TARGET("avx2,fma") inline float horizontalSum(__m256 v) {
+            return horizontalSum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+        }
+
+        LW_SIMD_TARGET("avx2,fma") inline double horizontalSum(__m256d v) {
+            return horizontalSum(_mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1)));
+        }
+
+        LW_SIMD_TARGET("avx2,fma") inline uint64_t horizontalSum(__m256i v) {
+            return horizontalSum(_mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+        }
+
+        template <bool WithBound>
+        LW_SIMD_TARGET("avx2,fma") inline float distanceSqrFloatAvx2(const float* a, const float* b, size_t dimension, float bound)
+        {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            size_t i = 0;
+            for (; i + 16 <= dimension; i += 16)
+            {
+                __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+                __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+                acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+                acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+                if (WithBound)
+                {
+                    float partial = horizontalSum(_mm256_add_ps(acc0, acc1));
+                    if (partial >= bound)
+                        return partial;
+                }
+            }
+            for (; i + 8 <= dimension; i += 8)
+            {
+                __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+                acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+            }
+            float distance = horizontalSum(_mm256_add_ps(acc0, acc1));
+            for (; i < dimension; ++i)
+            {
+                float tmp = a[i] - b[i];
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        template <bool WithBound>
+        LW_SIMD_TARGET("avx2,fma") inline double distanceSqrDoubleAvx2(const double* a, const double* b, size_t dimension, double bound)
+        {
+            __m256d acc0 = _mm256_setzero_pd();
+            __m256d acc1 = _mm256_setzero_pd();
+            size_t i = 0;
+            for (; i + 8 <= dimension; i += 8)
+            {
+                __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+                __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4));
+                acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+                acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+                if (WithBound)
+                {
+                    double partial = horizontalSum(_mm256_add_pd(acc0, acc1));
+                    if (partial >= bound)
+                        return partial;
+                }
+            }
+            for (; i + 4 <= dimension; i += 4)
+            {
+                __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+                acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+            }
+            double distance = horizontalSum(_mm256_add_pd(acc0, acc1));
+            for (; i < dimension; ++i)
+            {
+                double tmp = a[i] - b[i];
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        LW_SIMD_TARGET("avx2,fma") inline uint64_t distanceSqrInt32Avx2(const int32_t* a, const int32_t* b, size_t dimension)
+        {
+            __m256i acc = _mm256_setzero_si256();
+            __m256i maxDifference = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + 8 <= dimension; i += 8)
+            {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+                __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+                __m256i d = _mm256_sub_epi32(_mm256_max_epi32(x, y), _mm256_min_epi32(x, y));
+                maxDifference = _mm256_max_epu32(maxDifference, d);
+                acc = _mm256_add_epi64(acc, _mm256_mul_epu32(d, d));
+                d = _mm256_srli_epi64(d, 32);
+                acc = _mm256_add_epi64(acc, _mm256_mul_epu32(d, d));
+            }
+            __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            __m128i maxDifference128 = _mm_max_epu32(_mm256_castsi256_si128(maxDifference), _mm256_extracti128_si256(maxDifference, 1));
+            if (i + 4 <= dimension)
+            {
+                acc128 = accumulateSquaredDifferences(acc128, maxDifference128, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                                                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+                i += 4;
+            }
+            uint64_t distance = horizontalSum(acc128);
+            uint64_t maxTmp = horizontalMaxEpu32(maxDifference128);
+            for (; i < dimension; ++i)
+            {
+                uint64_t tmp = absDifference(a[i], b[i]);
+                distance += tmp*tmp;
+                maxTmp = tmp > maxTmp ? tmp : maxTmp;
+            }
+            return sumOfSquaresFits(maxTmp, dimension) ? distance : distanceSqrInt32Scalar(a, b, dimension);
+        }
+
+        LW_SIMD_TARGET("avx2,fma") inline uint64_t distanceSqrInt16Avx2(const int16_t* a, const int16_t* b, size_t dimension)
+        {
+            __m256i acc = _mm256_setzero_si256();
+            const __m256i zero = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + 16 <= dimension; i += 16)
+            {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+                __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+                __m256i d = _mm256_sub_epi16(_mm256_max_epi16(x, y), _mm256_min_epi16(x, y));
+                __m256i low = _mm256_mullo_epi16(d, d);
+                __m256i high = _mm256_mulhi_epu16(d, d);
+                __m256i squares0 = _mm256_unpacklo_epi16(low, high);
+                __m256i squares1 = _mm256_unpackhi_epi16(low, high);
+                acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(squares0, zero));
+                acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(squares0, zero));
+                acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(squares1, zero));
+                acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(squares1, zero));
+            }
+            __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            if (i + 8 <= dimension)
+            {
+                acc128 = accumulateSquaredDifferencesInt16(acc128, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+                i += 8;
+            }
+            uint64_t distance = horizontalSum(acc128);
+            for (; i < dimension; ++i)
+            {
+                uint64_t tmp = absDifference(a[i], b[i]);
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        LW_SIMD_TARGET("avx2,fma") float distanceSqrFloatAvx2Kernel(const float* a, const float* b, size_t dimension) {
+            return distanceSqrFloatAvx2<false>(a, b, dimension, float());
+        }
+
+        LW_SIMD_TARGET("avx2,fma") float distanceSqrFloatAvx2WithBoundKernel(const float* a, const float* b, size_t dimension, float bound) {
+            return distanceSqrFloatAvx2<true>(a, b, dimension, bound);
+        }
+
+        LW_SIMD_TARGET("avx2,fma") double distanceSqrDoubleAvx2Kernel(const double* a, const double* b, size_t dimension) {
+            return distanceSqrDoubleAvx2<false>(a, b, dimension, double());
+        }
+
+        LW_SIMD_TARGET("avx2,fma") double distanceSqrDoubleAvx2WithBoundKernel(const double* a, const double* b, size_t dimension, double bound) {
+            return distanceSqrDoubleAvx2<true>(a, b, dimension, bound);
+        }
+
+        LW_SIMD_TARGET("avx2,fma") uint64_t distanceSqrInt32Avx2Kernel(const int32_t* a, const int32_t* b, size_t dimension) {
+            return distanceSqrInt32Avx2(a, b, dimension);
+        }
+
+        LW_SIMD_TARGET("avx2,fma") uint64_t distanceSqrInt16Avx2Kernel(const int16_t* a, const int16_t* b, size_t dimension) {
+            return distanceSqrInt16Avx2(a, b, dimension);
+        }
+
+        LW_SIMD_TARGET("avx2,fma") void distancesSqrFloatAvx2(const float* requestPoint, const float* const* points, size_t count, size_t dimension, float* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrFloatAvx2<false>(requestPoint, points[j], dimension, float());
+        }
+
+        LW_SIMD_TARGET("avx2,fma") void distancesSqrDoubleAvx2(const double* requestPoint, const double* const* points, size_t count, size_t dimension, double* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrDoubleAvx2<false>(requestPoint, points[j], dimension, double());
+        }
+
+        LW_SIMD_TARGET("avx2,fma") void distancesSqrInt32Avx2(const int32_t* requestPoint, const int32_t* const* points, size_t count, size_t dimension, uint64_t* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrInt32Avx2(requestPoint, points[j], dimension);
+        }
+
+        LW_SIMD_TARGET("avx2,fma") void distancesSqrInt16Avx2(const int16_t* requestPoint, const int16_t* const* points, size_t count, size_t dimension, uint64_t* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrInt16Avx2(requestPoint, points[j], dimension);
+        }
+
+        // bucket kernels do not use FMA to keep results equal to the scalar loop
+        LW_SIMD_TARGET("avx2,fma") LW_SIMD_NO_FP_CONTRACT void bucketDistancesSqrFloatAvx2(const float* block, size_t stride, size_t dimension, const float* requestPoint, float* distances)
+        {
+            size_t j = 0;
+            for (; j + 16 <= stride; j += 16)
+            {
+                __m256 acc0 = _mm256_setzero_ps();
+                __m256 acc1 = _mm256_setzero_ps();
+                for (size_t c = 0; c < dimension; ++c)
+                {
+                    __m256 q = _mm256_set1_ps(requestPoint[c]);
+                    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(block + c * stride + j), q);
+                    __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(block + c * stride + j + 8), q);
+                    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(d0, d0));
+                    acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(d1, d1));
+                }
+                _mm256_storeu_ps(distances + j, acc0);
+                _mm256_storeu_ps(distances + j + 8, acc1);
+            }
+            for (; j + 8 <= stride; j += 8)
+            {
+                __m256 acc = _mm256_setzero_ps();
+                for (size_t c = 0; c < dimension; ++c)
+                {
+                    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(block + c * stride + j), _mm256_set1_ps(requestPoint[c]));
+                    acc = _mm256_add_ps(acc, _mm256_mul_ps(d, d));
+                }
+                _mm256_storeu_ps(distances + j, acc);
+            }
+            bucketTailScalar(block, stride, dimension, requestPoint, distances, j);
+        }
+
+        LW_SIMD_TARGET("avx2,fma") LW_SIMD_NO_FP_CONTRACT void bucketDistancesSqrDoubleAvx2(const double* block, size_t stride, size_t dimension, const double* requestPoint, double* distances)
+        {
+            size_t j = 0;
+            for (; j + 8 <= stride; j += 8)
+            {
+                __m256d acc0 = _mm256_setzero_pd();
+                __m256d acc1 = _mm256_setzero_pd();
+                for (size_t c = 0; c < dimension; ++c)
+                {
+                    __m256d q = _mm256_set1_pd(requestPoint[c]);
+                    __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(block + c * stride + j), q);
+                    __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(block + c * stride + j + 4), q);
+                    acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+                    acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+                }
+                _mm256_storeu_pd(distances + j, acc0);
+                _mm256_storeu_pd(distances + j + 4, acc1);
+            }
+            for (; j + 4 <= stride; j += 4)
+            {
+                __m256d acc = _mm256_setzero_pd();
+                for (size_t c = 0; c < dimension; ++c)
+                {
+                    __m256d d = _mm256_sub_pd(_mm256_loadu_pd(block + c * stride + j), _mm256_set1_pd(requestPoint[c]));
+                    acc = _mm256_add_pd(acc, _mm256_mul_pd(d, d));
+                }
+                _mm256_storeu_pd(distances + j, acc);
+            }
+            bucketTailScalar(block, stride, dimension, requestPoint, distances, j);
+        }
+
+        const SimdKernels kAvx2Kernels = {
+            KdTreeSimdLevel::eAVX2,
+            &distanceSqrFloatAvx2Kernel, &distanceSqrDoubleAvx2Kernel, &distanceSqrInt32Avx2Kernel, &distanceSqrInt16Avx2Kernel,
+            &distanceSqrFloatAvx2WithBoundKernel, &distanceSqrDoubleAvx2WithBoundKernel,
+            &distancesSqrFloatAvx2, &distancesSqrDoubleAvx2, &distancesSqrInt32Avx2, &distancesSqrInt16Avx2,
+            &bucketDistancesSqrFloatAvx2, &bucketDistancesSqrDoubleAvx2
+        };
+
+        //=========================== AVX-512 kernels =====================================
+        /** Mask for the first "count" lanes, count should be less then 16
+        */
+        inline __mmask16 firstLanesMask16(size_t count) {
+            return __mmask16((1u << count) - 1u);
+        }
+
+        inline __mmask8 firstLanesMask8(size_t count) {
+            return __mmask8((1u << count) - 1u);
+        }
+
+        template <bool WithBound>
+        LW_SIMD_TARGET("avx512f") inline float distanceSqrFloatAvx512(const float* a, const float* b, size_t dimension, float bound)
+        {
+            __m512 acc0 = _mm512_setzero_ps();
+            __m512 acc1 = _mm512_setzero_ps();
+            size_t i = 0;
+            for (; i + 32 <= dimension; i += 32)
+            {
+                __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+                __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+                acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+                acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+                if (WithBound)
+                {
+                    float partial = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+                    if (partial >= bound)
+                        return partial;
+                }
+            }
+            for (; i + 16 <= dimension; i += 16)
+            {
+                __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+                acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+            }
+            if (i < dimension)
+            {
+                __mmask16 mask = firstLanesMask16(dimension - i);
+                __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+                acc1 = _mm512_fmadd_ps(d0, d0, acc1);
+            }
+            return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+        }
+
+        template <bool WithBound>
+        LW_SIMD_TARGET("avx512f") inline double distanceSqrDoubleAvx512(const double* a, const double* b, size_t dimension, double bound)
+        {
+            __m512d acc0 = _mm512_setzero_pd();
+            __m512d acc1 = _mm512_setzero_pd();
+            size_t i = 0;
+            for (; i + 16 <= dimension; i += 16)
+            {
+                __m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+                __m512d d1 = _mm512_sub_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8));
+                acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+                acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+                if (WithBound)
+                {
+                    double partial = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+                    if (partial >= bound)
+                        return partial;
+                }
+            }
+            for (; i + 8 <= dimension; i += 8)
+            {
+                __m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+                acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+            }
+            if (i < dimension)
+            {
+                __mmask8 mask = firstLanesMask8(dimension - i);
+                __m512d d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i));
+                acc1 = _mm512_fmadd_pd(d0, d0, acc1);
+            }
+            return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+        }
+
+        LW_SIMD_TARGET("avx512f") inline uint64_t distanceSqrInt32Avx512(const int32_t* a, const int32_t* b, size_t dimension)
+        {
+            __m512i acc = _mm512_setzero_si512();
+            __m512i maxDifference = _mm512_setzero_si512();
+            for (size_t i = 0; i < dimension; i += 16)
+            {
+                __mmask16 mask = dimension - i >= 16 ? __mmask16(0xFFFF) : firstLanesMask16(dimension - i);
+                __m512i x = _mm512_maskz_loadu_epi32(mask, a + i);
+                __m512i y = _mm512_maskz_loadu_epi32(mask, b + i);
+                __m512i d = _mm512_sub_epi32(_mm512_max_epi32(x, y), _mm512_min_epi32(x, y));
+                maxDifference = _mm512_max_epu32(maxDifference, d);
+                acc = _mm512_add_epi64(acc, _mm512_mul_epu32(d, d));
+                d = _mm512_srli_epi64(d, 32);
+                acc = _mm512_add_epi64(acc, _mm512_mul_epu32(d, d));
+            }
+            if (!sumOfSquaresFits(_mm512_reduce_max_epu32(maxDifference), dimension))
+                return distanceSqrInt32Scalar(a, b, dimension);
+            return uint64_t(_mm512_reduce_add_epi64(acc));
+        }
+
+        LW_SIMD_TARGET("avx512f") float distanceSqrFloatAvx512Kernel(const float* a, const float* b, size_t dimension) {
+            return distanceSqrFloatAvx512<false>(a, b, dimension, float());
+        }
+
+        LW_SIMD_TARGET("avx512f") float distanceSqrFloatAvx512WithBoundKernel(const float* a, const float* b, size_t dimension, float bound) {
+            return distanceSqrFloatAvx512<true>(a, b, dimension, bound);
+        }
+
+        LW_SIMD_TARGET("avx512f") double distanceSqrDoubleAvx512Kernel(const double* a, const double* b, size_t dimension) {
+            return distanceSqrDoubleAvx512<false>(a, b, dimension, double());
+        }
+
+        LW_SIMD_TARGET("avx512f") double distanceSqrDoubleAvx512WithBoundKernel(const double* a, const double* b, size_t dimension, double bound) {
+            return distanceSqrDoubleAvx512<true>(a, b, dimension, bound);
+        }
+
+        LW_SIMD_TARGET("avx512f") uint64_t distanceSqrInt32Avx512Kernel(const int32_t* a, const int32_t* b, size_t dimension) {
+            return distanceSqrInt32Avx512(a, b, dimension);
+        }
+
+        LW_SIMD_TARGET("avx512f") void distancesSqrFloatAvx512(const float* requestPoint, const float* const* points, size_t count, size_t dimension, float* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrFloatAvx512<false>(requestPoint, points[j], dimension, float());
+        }
+
+        LW_SIMD_TARGET("avx512f") void distancesSqrDoubleAvx512(const double* requestPoint, const double* const* points, size_t count, size_t dimension, double* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrDoubleAvx512<false>(requestPoint, points[j], dimension, double());
+        }
+
+        LW_SIMD_TARGET("avx512f") void distancesSqrInt32Avx512(const int32_t* requestPoint, const int32_t* const* points, size_t count, size_t dimension, uint64_t* distances)
+        {
+            for (size_t j = 0; j < count; ++j)
+                distances[j] = distanceSqrInt32Avx512(requestPoint, points[j], dimension);
+        }
+
+        LW_SIMD_TARGET("avx512f") LW_SIMD_NO_FP_CONTRACT void bucketDistancesSqrFloatAvx512(const float* block, size_t stride, size_t dimension, const float* requestPoint, float* distances)
+        {
+            for (size_t j = 0; j < stride; j += 16)
+            {
+                __mmask16 mask = stride - j >= 16 ? __mmask16(0xFFFF) : firstLanesMask16(stride - j);
+                __m512 acc = _mm512_setzero_ps();
+                for (size_t c = 0; c < dimension; ++c)
+                {
+                    __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, block + c * stride + j), _mm512_set1_ps(requestPoint[c]));
+                    acc = _mm512_add_ps(acc, _mm512_mul_ps(d, d));
+                }
+                _mm512_mask_storeu_ps(distances + j, mask, acc);
+            }
+        }
+
+        LW_SIMD_TARGET("avx512f") LW_SIMD_NO_FP_CONTRACT void bucketDistancesSqrDoubleAvx512(const double* block, size_t stride, size_t dimension, const double* requestPoint, double* distances)
+        {
+            for (size_t j = 0; j < stride; j += 8)
+            {
+                __mmask8 mask = stride - j >= 8 ? __mmask8(0xFF) : firstLanesMask8(stride - j);
+                __m512d acc = _mm512_setzero_pd();
+                for (size_t c = 0; c < dimension; ++c)
+                {
+                    __m512d d = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, block + c * stride + j), _mm512_set1_pd(requestPoint[c]));
+                    acc = _mm512_add_pd(acc, _mm512_mul_pd(d, d));
+                }
+                _mm512_mask_storeu_pd(distances + j, mask, acc);
+            }
+        }
+
+        const SimdKernels kAvx512Kernels = {
+            KdTreeSimdLevel::eAVX512,
+            &distanceSqrFloatAvx512Kernel, &distanceSqrDoubleAvx512Kernel, &distanceSqrInt32Avx512Kernel, &distanceSqrInt16Avx2Kernel,
+            &distanceSqrFloatAvx512WithBoundKernel, &distanceSqrDoubleAvx512WithBoundKernel,
+            &distancesSqrFloatAvx512, &distancesSqrDoubleAvx512, &distancesSqrInt32Avx512, &distancesSqrInt16Avx2,
+            &bucketDistancesSqrFloatAvx512, &bucketDistancesSqrDoubleAvx512
+        };
+
+        //=========================== Detection of instruction set ========================
+        void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+        {
+#if defined(_MSC_VER)
+            int info[4] = {};
+            __cpuidex(info, int(leaf), int(subleaf));
+            for (int i = 0; i < 4; ++i)
+                regs[i] = static_cast<unsigned int>(info[i]);
+#else
+            regs[0] = regs[1] = regs[2] = regs[3] = 0;
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        }
+
+        /** Get mask of register states which OS saves during context switch
+        */
+        uint64_t readXcr0()
+        {
+#if defined(_MSC_VER)
+            return uint64_t(_xgetbv(0));
+#else
+            unsigned int eax = 0, edx = 0;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (uint64_t(edx) << 32) | eax;
+#endif
+        }
+
+        KdTreeSimdLevel detectSimdLevelWithCpuid()
+        {
+            unsigned int regs[4] = {};
+            cpuid(0, 0, regs);
+            const unsigned int maxLeaf = regs[0];
+            if (maxLeaf < 1)
+                return KdTreeSimdLevel::eScalar;
+
+            cpuid(1, 0, regs);
+            const bool sse41 = (regs[2] & (1u << 19)) != 0;
+            const bool sse42 = (regs[2] & (1u << 20)) != 0;
+            const bool fma = (regs[2] & (1u << 12)) != 0;
+            const bool osxsave = (regs[2] & (1u << 27)) != 0;
+            const bool avx = (regs[2] & (1u << 28)) != 0;
+
+            if (!sse41 || !sse42)
+                return KdTreeSimdLevel::eScalar;
+
+            bool avx2 = false;
+            bool avx512f = false;
+            if (maxLeaf >= 7)
+            {
+                cpuid(7, 0, regs);
+                avx2 = (regs[1] & (1u << 5)) != 0;
+                avx512f = (regs[1] & (1u << 16)) != 0;
+            }
+
+            // OS should save upper halves of YMM registers (and ZMM, opmask registers for AVX-512)
+            const uint64_t xcr0 = osxsave ? readXcr0() : 0;
+            const bool osSupportsAvx = (xcr0 & 0x6) == 0x6;
+            const bool osSupportsAvx512 = (xcr0 & 0xE6) == 0xE6;
+
+            if (!avx || !avx2 || !fma || !osSupportsAvx)
+                return KdTreeSimdLevel::eSSE42;
+            if (!avx512f || !osSupportsAvx512)
+                return KdTreeSimdLevel::eAVX2;
+            return KdTreeSimdLevel::eAVX512;
+        }
+#endif
+
+        const SimdKernels& kernelsForLevel(KdTreeSimdLevel level)
+        {
+#if LW_SIMD_X86_64
+            switch (level)
+            {
+            case KdTreeSimdLevel::eAVX512:
+                return kAvx512Kernels;
+            case KdTreeSimdLevel::eAVX2:
+                return kAvx2Kernels;
+            case KdTreeSimdLevel::eSSE42:
+                return kSseKernels;
+            default:
+                break;
+            }
+#else
+            (void)level;
+#endif
+            return kScalarKernels;
+        }
+
+        /** Get slot with kernels which are used now. Initialized during the first call.
+        */
+        const SimdKernels*& activeKernelsSlot()
+        {
+            static const SimdKernels* active = &kernelsForLevel(detectSimdLevel());
+            return active;
+        }
+
+        inline const SimdKernels& activeKernels() {
+            return *activeKernelsSlot();
+        }
+    }
+
+    KdTreeSimdLevel detectSimdLevel()
+    {
+#if LW_SIMD_X86_64
+        static const KdTreeSimdLevel detected = detectSimdLevelWithCpuid();
+        return detected;
+#else
+        return KdTreeSimdLevel::eScalar;
+#endif
+    }
+
+    KdTreeSimdLevel activeSimdLevel()
+    {
+        return activeKernels().level;
+    }
+
+    KdTreeSimdLevel setActiveSimdLevel(KdTreeSimdLevel level)
+    {
+        KdTreeSimdLevel supported = detectSimdLevel();
+        if (int(level) > int(supported))
+            level = supported;
+        activeKernelsSlot() = &kernelsForLevel(level);
+        return level;
+    }
+
+    const char* simdLevelName(KdTreeSimdLevel level)
+    {
+        switch (level)
+        {
+        case KdTreeSimdLevel::eScalar:
+            return "scalar";
+        case KdTreeSimdLevel::eSSE42:
+            return "SSE4.2";
+        case KdTreeSimdLevel::eAVX2:
+            return "AVX2";
+        case KdTreeSimdLevel::eAVX512:
+            return "AVX-512";
+        }
+        return "unknown";
+    }
+
+    float simdDistanceSqr(const float* a, const float* b, size_t dimension) {
+        return activeKernels().distanceFloat(a, b, dimension);
+    }
+
+    double simdDistanceSqr(const double* a, const double* b, size_t dimension) {
+        return activeKernels().distanceDouble(a, b, dimension);
+    }
+
+    float simdDistanceSqrWithBound(const float* a, const float* b, size_t dimension, float bound) {
+        return activeKernels().boundedDistanceFloat(a, b, dimension, bound);
+    }
+
+    double simdDistanceSqrWithBound(const double* a, const double* b, size_t dimension, double bound) {
+        return activeKernels().boundedDistanceDouble(a, b, dimension, bound);
+    }
+
+    uint64_t simdDistanceSqr(const int32_t* a, const int32_t* b, size_t dimension) {
+        return activeKernels().distanceInt32(a, b, dimension);
+    }
+
+    uint64_t simdDistanceSqr(const int16_t* a, const int16_t* b, size_t dimension) {
+        return activeKernels().distanceInt16(a, b, dimension);
+    }
+
+    void simdDistancesSqr(const float* requestPoint, const float* const* points, size_t count, size_t dimension, float* distances) {
+        activeKernels().distancesFloat(requestPoint, points, count, dimension, distances);
+    }
+
+    void simdDistancesSqr(const double* requestPoint, const double* const* points, size_t count, size_t dimension, double* distances) {
+        activeKernels().distancesDouble(requestPoint, points, count, dimension, distances);
+    }
+
+    void simdDistancesSqr(const int32_t* requestPoint, const int32_t* const* points, size_t count, size_t dimension, uint64_t* distances) {
+        activeKernels().distancesInt32(requestPoint, points, count, dimension, distances);
+    }
+
+    void simdDistancesSqr(const int16_t* requestPoint, const int16_t* const* points, size_t count, size_t dimension, uint64_t* distances) {
+        activeKernels().distancesInt16(requestPoint, points, count, dimension, distances);
+    }
+
+    void simdBucketDistancesSqr(const float* block, size_t stride, size_t dimension, const float* requestPoint, float* distances) {
+        activeKernels().bucketFloat(block, stride, dimension, requestPoint, distances);
+    }
+
+    void simdBucketDistancesSqr(const double* block, size_t stride, size_t dimension, const double* requestPoint, double* distances) {
+        activeKernels().bucketDouble(block, stride, dimension, requestPoint, distances);
+    }
+}
@@ -0,0 +1,166 @@
+#include "lw_index_datastructs/headers_public/WorkStealingTaskPool.h"
+
+namespace lw_index_datastructs
+{
+    namespace
+    {
+        /** Identity of the pool worker for current thread
+        */
+        struct WorkerIdentity
+        {
+            const WorkStealingTaskPool* pool; ///< Pool to which current thread belongs
+            size_t index;                     ///< Index of the worker inside the pool
+        };
+
+        thread_local WorkerIdentity gCurrentWorker = { nullptr, 0 };
+    }
+
+    WorkStealingTaskPool::WorkStealingTaskPool(size_t threadsCount)
+    : pendingTasks(0)
+    , nextExternalQueue(0)
+    , stopFlag(false)
+    {
+        if (threadsCount == 0)
+            threadsCount = std::thread::hardware_concurrency();
+        if (threadsCount == 0)
+            threadsCount = 1;
+
+        for (size_t i = 0; i < threadsCount; ++i)
+            queues.emplace_back(new WorkerQueue());
+
+        for (size_t i = 0; i < threadsCount; ++i)
+            workers.emplace_back(&WorkStealingTaskPool::workerLoop, this, i);
+    }
+
+    WorkStealingTaskPool::~WorkStealingTaskPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopFlag = true;
+        }
+        wakeUp.notify_all();
+
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    size_t WorkStealingTaskPool::threadsCount() const
+    {
+        return workers.size();
+    }
+
+    void WorkStealingTaskPool::submit(Task task)
+    {
+        size_t queueIndex = 0;
+        if (gCurrentWorker.pool == this)
+            queueIndex = gCurrentWorker.index;
+        else
+            queueIndex = nextExternalQueue++ % queues.size();
+
+        {
+            // increment under the lock to not lose wake up of worker which is going to sleep.
+            // Counter is incremented before the task is published, so concurrent takeTask() never decrements it below zero.
+            std::lock_guard<std::mutex> guard(sleepLock);
+            pendingTasks++;
+        }
+
+        {
+            WorkerQueue& q = *queues[queueIndex];
+            std::lock_guard<std::mutex> guard(q.lock);
+            q.tasks.push_back(std::move(task));
+        }
+        wakeUp.notify_one();
+    }
+
+    bool WorkStealingTaskPool::tryRunPendingTask()
+    {
+        size_t firstQueue = (gCurrentWorker.pool == this) ? gCurrentWorker.index : 0;
+        Task task;
+        if (!takeTask(firstQueue, task))
+            return false;
+        task();
+        return true;
+    }
+
+    bool WorkStealingTaskPool::takeTask(size_t firstQueue, Task& task)
+    {
+        if (pendingTasks.load() == 0)
+            return false;
+
+        {
+            WorkerQueue& own = *queues[firstQueue];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                pendingTasks--;
+                return true;
+            }
+        }
+
+        size_t queuesCount = queues.size();
+        for (size_t i = 1; i < queuesCount; ++i)
+        {
+            WorkerQueue& victim = *queues[(firstQueue + i) % queuesCount];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                pendingTasks--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void WorkStealingTaskPool::workerLoop(size_t workerIndex)
+    {
+        gCurrentWorker.pool = this;
+        gCurrentWorker.index = workerIndex;
+
+        for (;;)
+        {
+            if (tryRunPendingTask())
+                continue;
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wakeUp.wait(guard, [this]() { return stopFlag || pendingTasks.load() > 0; });
+            if (stopFlag && pendingTasks.load() == 0)
+                break;
+        }
+
+        gCurrentWorker.pool = nullptr;
+    }
+
+    TaskGroup::TaskGroup(WorkStealingTaskPool& taskPool)
+    : pool(taskPool)
+    , unfinished(0)
+    {}
+
+    TaskGroup::~TaskGroup()
+    {
+        wait();
+    }
+
+    void TaskGroup::run(WorkStealingTaskPool::Task task)
+    {
+        unfinished++;
+        pool.submit([this, task]()
+                    {
+                        task();
+                        unfinished--;
+                    });
+    }
+
+    void TaskGroup::wait()
+    {
+        while (unfinished.load() != 0)
+        {
+            if (!pool.tryRunPendingTask())
+                std::this_thread::yield();
+        }
+    }
+}
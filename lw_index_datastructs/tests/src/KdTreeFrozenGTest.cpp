@@ -0,0 +1,363 @@
+#include "lw_index_datastructs/headers_public/KdTreeFrozen.h"
+#include "GTestMacroses.h"
+
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <limits>
+
+namespace
+{
+    template <class TCoord, size_t Dimension>
+    std::vector<TCoord> generateFrozenTestPoints(size_t num, unsigned int seed, TCoord maxValue)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<double> dist(0.0, double(maxValue));
+        std::vector<TCoord> points(num * Dimension);
+        for (size_t i = 0; i < points.size(); ++i)
+            points[i] = TCoord(dist(gen));
+        return points;
+    }
+
+    template <class TCoord, size_t Dimension>
+    std::vector<const TCoord*> frozenTestPointers(const std::vector<TCoord>& points)
+    {
+        std::vector<const TCoord*> res(points.size() / Dimension);
+        for (size_t i = 0; i < res.size(); ++i)
+            res[i] = &points[i * Dimension];
+        return res;
+    }
+}
+
+TEST(Utils, KdTreeFrozenGTest)
+{
+    {
+        lw_index_datastructs::FrozenKDtree<int, 2, double> frozen;
+        EXPECT_TRUE(frozen.size() == 0);
+        EXPECT_TRUE(frozen.height() == 0);
+        int req[] = { 1, 1 };
+        EXPECT_TRUE(frozen.nearestPointInEuclidianMetric(req) == nullptr);
+        std::vector<const int*> res;
+        frozen.rangeSearchWithBoundingBox(res, req, req);
+        EXPECT_TRUE(res.empty());
+    }
+
+    {
+        int points[][2] = { { 0, 2 }, { 10, 10 }, { 0, 10 }, { 15, 0 } };
+        lw_index_datastructs::KDtree<int, 2, double> kd(points, 4, lw_index_datastructs::KdTreeBuildMode::eIncrementalInsertion);
+        lw_index_datastructs::FrozenKDtree<int, 2, double> frozen(kd);
+        EXPECT_TRUE(frozen.size() == 4);
+        EXPECT_TRUE(frozen.height() == kd.height());
+
+        int reqA[] = { -1, -1 };
+        EXPECT_TRUE(frozen.nearestPointInEuclidianMetric(reqA) == points[0]);
+        int reqB[] = { 14, 1 };
+        EXPECT_TRUE(frozen.nearestPointInEuclidianMetric(reqB) == points[3]);
+
+        int bbB[][2] = { { -1, -1 }, { 1, 20 } };
+        std::vector<const int*> bbRes;
+        frozen.rangeSearchWithBoundingBox(bbRes, bbB[0], bbB[1]);
+        EXPECT_TRUE(bbRes.size() == 2);
+    }
+
+    {
+        const size_t kPoints = 5000;
+        std::vector<double> points = generateFrozenTestPoints<double, 3>(kPoints, 7, 100.0);
+        std::vector<const double*> ptrs = frozenTestPointers<double, 3>(points);
+
+        lw_index_datastructs::KDtree<double, 3> kdBalanced(ptrs, ptrs.size());
+        lw_index_datastructs::KDtree<double, 3> kdIncremental(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eIncrementalInsertion);
+        lw_index_datastructs::FrozenKDtree<double, 3> frozenFromBalanced(kdBalanced);
+        lw_index_datastructs::FrozenKDtree<double, 3> frozenFromIncremental(kdIncremental);
+        lw_index_datastructs::FrozenKDtree<double, 3> frozenFromPoints(ptrs, ptrs.size());
+
+        EXPECT_TRUE(frozenFromBalanced.height() == kdBalanced.height());
+        EXPECT_TRUE(frozenFromIncremental.height() == kdIncremental.height());
+        EXPECT_TRUE(frozenFromPoints.height() == kdBalanced.height());
+        EXPECT_TRUE(frozenFromPoints.size() == kPoints);
+
+        std::vector<double> requests = generateFrozenTestPoints<double, 3>(300, 8, 100.0);
+        for (size_t i = 0; i < 300; ++i)
+        {
+            const double* req = &requests[i * 3];
+            const double* expected = kdBalanced.nearestPointInEuclidianMetric(req);
+            EXPECT_TRUE(frozenFromBalanced.nearestPointInEuclidianMetric(req) == expected);
+            EXPECT_TRUE(frozenFromIncremental.nearestPointInEuclidianMetric(req) == kdIncremental.nearestPointInEuclidianMetric(req));
+            EXPECT_TRUE(frozenFromPoints.nearestPointInEuclidianMetric(req) == expected);
+        }
+
+        double bbMin[] = { 10.0, 20.0, 30.0 };
+        double bbMax[] = { 40.0, 50.0, 60.0 };
+        std::vector<const double*> expectedInBox;
+        kdBalanced.rangeSearchWithBoundingBox(expectedInBox, bbMin, bbMax);
+        std::sort(expectedInBox.begin(), expectedInBox.end());
+
+        std::vector<const double*> inBox;
+        frozenFromIncremental.rangeSearchWithBoundingBox(inBox, bbMin, bbMax);
+        std::sort(inBox.begin(), inBox.end());
+        EXPECT_TRUE(inBox == expectedInBox);
+
+        inBox.clear();
+        frozenFromPoints.rangeSearchWithBoundingBox(inBox, bbMin, bbMax);
+        std::sort(inBox.begin(), inBox.end());
+        EXPECT_TRUE(inBox == expectedInBox);
+
+        // split axes of the source tree are preserved
+        lw_index_datastructs::KDtree<double, 3> kdSpread(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eBalancedMedianSplit, lw_index_datastructs::KdTreeSplitRule::eMaxSpread);
+        lw_index_datastructs::FrozenKDtree<double, 3> frozenFromSpread(kdSpread);
+        lw_index_datastructs::FrozenKDtree<double, 3> frozenSpreadBuckets(ptrs, ptrs.size(), 16, lw_index_datastructs::KdTreeFrozenLayout::ePreorder, lw_index_datastructs::KdTreeSplitRule::eMaxSpread);
+        for (size_t i = 0; i < 300; ++i)
+        {
+            const double* req = &requests[i * 3];
+            const double* expected = kdBalanced.nearestPointInEuclidianMetric(req);
+            EXPECT_TRUE(frozenFromSpread.nearestPointInEuclidianMetric(req) == expected);
+            EXPECT_TRUE(frozenSpreadBuckets.nearestPointInEuclidianMetric(req) == expected);
+        }
+        inBox.clear();
+        frozenFromSpread.rangeSearchWithBoundingBox(inBox, bbMin, bbMax);
+        std::sort(inBox.begin(), inBox.end());
+        EXPECT_TRUE(inBox == expectedInBox);
+    }
+}
+
+TEST(Utils, KdTreeFrozenLeafBucketsGTest)
+{
+    const size_t kPoints = 3000;
+    std::vector<double> points = generateFrozenTestPoints<double, 3>(kPoints, 11, 100.0);
+    std::vector<const double*> ptrs = frozenTestPointers<double, 3>(points);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eIncrementalInsertion);
+
+    std::vector<double> requests = generateFrozenTestPoints<double, 3>(200, 12, 100.0);
+    double bbMin[] = { 10.0, 20.0, 30.0 };
+    double bbMax[] = { 40.0, 50.0, 60.0 };
+    std::vector<const double*> expectedInBox;
+    kd.rangeSearchWithBoundingBox(expectedInBox, bbMin, bbMax);
+    std::sort(expectedInBox.begin(), expectedInBox.end());
+
+    // leaf size above the maximum is clamped
+    size_t leafSizes[] = { 1, 2, 7, 8, 16, 33, 64, 256, 1000 };
+    for (size_t l = 0; l < sizeof(leafSizes) / sizeof(leafSizes[0]); ++l)
+    {
+        lw_index_datastructs::FrozenKDtree<double, 3> frozenFromPoints(ptrs, ptrs.size(), leafSizes[l]);
+        lw_index_datastructs::FrozenKDtree<double, 3> frozenFromTree(kd, leafSizes[l]);
+        EXPECT_TRUE(frozenFromPoints.size() == kPoints);
+        EXPECT_TRUE(frozenFromTree.size() == kPoints);
+        EXPECT_TRUE(frozenFromPoints.leafSize() == std::min(leafSizes[l], size_t(lw_index_datastructs::FrozenKDtree<double, 3>::kMaxLeafSize)));
+        EXPECT_TRUE(frozenFromPoints.height() <= 13);
+
+        for (size_t i = 0; i < 200; ++i)
+        {
+            const double* req = &requests[i * 3];
+            const double* expected = kd.nearestPointInEuclidianMetric(req);
+            EXPECT_TRUE(frozenFromPoints.nearestPointInEuclidianMetric(req) == expected);
+            EXPECT_TRUE(frozenFromTree.nearestPointInEuclidianMetric(req) == expected);
+        }
+
+        for (size_t i = 0; i < 50; ++i)
+            EXPECT_TRUE(frozenFromPoints.nearestPointInEuclidianMetric(ptrs[i]) == ptrs[i]);
+
+        std::vector<const double*> inBox;
+        frozenFromPoints.rangeSearchWithBoundingBox(inBox, bbMin, bbMax);
+        std::sort(inBox.begin(), inBox.end());
+        EXPECT_TRUE(inBox == expectedInBox);
+    }
+
+    {
+        // integer buckets are accumulated in 64-bit integers, so 64-bit norm does not overflow when sum of squares exceeds 2^63 for far points of the bucket
+        std::vector<int32_t> points = generateFrozenTestPoints<int32_t, 3>(kPoints, 13, 1500000000);
+        std::vector<int32_t> intRequests = generateFrozenTestPoints<int32_t, 3>(200, 14, 100000000);
+        for (size_t i = 0; i < intRequests.size(); ++i)
+            intRequests[i] = -1400000000 - intRequests[i];
+        std::vector<const int32_t*> intPtrs = frozenTestPointers<int32_t, 3>(points);
+        lw_index_datastructs::FrozenKDtree<int32_t, 3, int64_t> intFrozen(intPtrs, intPtrs.size(), 16);
+        for (size_t i = 0; i < 200; ++i)
+        {
+            const int32_t* req = &intRequests[i * 3];
+            uint64_t best = std::numeric_limits<uint64_t>::max();
+            for (size_t j = 0; j < intPtrs.size(); ++j)
+                best = std::min(best, lw_index_datastructs::integerDistanceSqr<3>(intPtrs[j], req));
+            EXPECT_TRUE(lw_index_datastructs::integerDistanceSqr<3>(intFrozen.nearestPointInEuclidianMetric(req), req) == best);
+        }
+
+        std::vector<int16_t> shortPoints = generateFrozenTestPoints<int16_t, 20>(kPoints, 15, 32767);
+        std::vector<int16_t> shortRequests = generateFrozenTestPoints<int16_t, 20>(50, 16, 32767);
+        for (size_t i = 0; i < shortPoints.size(); i += 3)
+            shortPoints[i] = int16_t(-shortPoints[i] - 1);
+        std::vector<const int16_t*> shortPtrs = frozenTestPointers<int16_t, 20>(shortPoints);
+        lw_index_datastructs::FrozenKDtree<int16_t, 20, double> shortFrozen(shortPtrs, shortPtrs.size(), 33);
+        for (size_t i = 0; i < 50; ++i)
+        {
+            const int16_t* req = &shortRequests[i * 20];
+            uint64_t best = std::numeric_limits<uint64_t>::max();
+            for (size_t j = 0; j < shortPtrs.size(); ++j)
+                best = std::min(best, lw_index_datastructs::integerDistanceSqr<20>(shortPtrs[j], req));
+            EXPECT_TRUE(lw_index_datastructs::integerDistanceSqr<20>(shortFrozen.nearestPointInEuclidianMetric(req), req) == best);
+        }
+    }
+
+    {
+        // whole tree fits into one bucket
+        int points[][2] = { { 0, 2 }, { 10, 10 }, { 0, 10 }, { 15, 0 } };
+        lw_index_datastructs::FrozenKDtree<int, 2, double> frozen(points, 4, 8);
+        EXPECT_TRUE(frozen.height() == 1);
+        int reqB[] = { 14, 1 };
+        EXPECT_TRUE(frozen.nearestPointInEuclidianMetric(reqB) == points[3]);
+    }
+}
+
+TEST(Utils, KdTreeFrozenGPerf)
+{
+    const size_t kPoints = 2 * 1000 * 1000;
+    const size_t kRequests = 200 * 1000;
+
+    std::vector<float> points = generateFrozenTestPoints<float, 3>(kPoints, 1, 1000.0f);
+    std::vector<const float*> ptrs = frozenTestPointers<float, 3>(points);
+    std::vector<float> requests = generateFrozenTestPoints<float, 3>(kRequests, 2, 1000.0f);
+
+    // shuffle points to not have locality in memory of the user between neighbours in the tree
+    std::shuffle(ptrs.begin(), ptrs.end(), std::mt19937(3));
+
+    lw_index_datastructs::KDtree<float, 3, float> kd(ptrs, ptrs.size());
+    lw_index_datastructs::FrozenKDtree<float, 3, float> frozen(kd);
+
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; ++i)
+        checksum += (kd.nearestPointInEuclidianMetric(&requests[i * 3]) != nullptr);
+    gProxiedRecordPerf("nearest point in pointer based tree", kRequests, kPoints, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; ++i)
+        checksum += (frozen.nearestPointInEuclidianMetric(&requests[i * 3]) != nullptr);
+    gProxiedRecordPerf("nearest point in frozen tree", kRequests, kPoints, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    size_t leafSizes[] = { 8, 16, 32, 64 };
+    for (size_t l = 0; l < sizeof(leafSizes) / sizeof(leafSizes[0]); ++l)
+    {
+        lw_index_datastructs::FrozenKDtree<float, 3, float> frozenWithBuckets(kd, leafSizes[l]);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kRequests; ++i)
+            checksum += (frozenWithBuckets.nearestPointInEuclidianMetric(&requests[i * 3]) != nullptr);
+        gProxiedRecordPerf("nearest point in frozen tree with leaf bucket of size " + gPrintNumber(leafSizes[l]), kRequests, kPoints, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    EXPECT_TRUE(checksum == 6 * kRequests);
+}
+
+TEST(Utils, KdTreeFrozenLayoutsGTest)
+{
+    const size_t kPoints = 4000;
+    std::vector<double> points = generateFrozenTestPoints<double, 3>(kPoints, 21, 100.0);
+    std::vector<const double*> ptrs = frozenTestPointers<double, 3>(points);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eIncrementalInsertion);
+
+    std::vector<double> requests = generateFrozenTestPoints<double, 3>(200, 22, 100.0);
+    double bbMin[] = { 10.0, 20.0, 30.0 };
+    double bbMax[] = { 40.0, 50.0, 60.0 };
+    std::vector<const double*> expectedInBox;
+    kd.rangeSearchWithBoundingBox(expectedInBox, bbMin, bbMax);
+    std::sort(expectedInBox.begin(), expectedInBox.end());
+
+    lw_index_datastructs::KdTreeFrozenLayout layouts[] = { lw_index_datastructs::KdTreeFrozenLayout::ePreorder,
+                                                           lw_index_datastructs::KdTreeFrozenLayout::eVanEmdeBoas,
+                                                           lw_index_datastructs::KdTreeFrozenLayout::eBlocked };
+    size_t leafSizes[] = { 1, 16 };
+
+    for (size_t t = 0; t < sizeof(layouts) / sizeof(layouts[0]); ++t)
+    {
+        for (size_t l = 0; l < sizeof(leafSizes) / sizeof(leafSizes[0]); ++l)
+        {
+            lw_index_datastructs::FrozenKDtree<double, 3> frozenFromTree(kd, leafSizes[l], layouts[t]);
+            lw_index_datastructs::FrozenKDtree<double, 3> frozenFromPoints(ptrs, ptrs.size(), leafSizes[l], layouts[t]);
+            EXPECT_TRUE(frozenFromTree.layout() == layouts[t]);
+            EXPECT_TRUE(frozenFromTree.size() == kPoints);
+            EXPECT_TRUE(frozenFromPoints.size() == kPoints);
+            if (leafSizes[l] == 1)
+            {
+                EXPECT_TRUE(frozenFromTree.height() == kd.height());
+            }
+
+            for (size_t i = 0; i < 200; ++i)
+            {
+                const double* req = &requests[i * 3];
+                const double* expected = kd.nearestPointInEuclidianMetric(req);
+                EXPECT_TRUE(frozenFromTree.nearestPointInEuclidianMetric(req) == expected);
+                EXPECT_TRUE(frozenFromPoints.nearestPointInEuclidianMetric(req) == expected);
+            }
+
+            std::vector<const double*> inBox;
+            frozenFromTree.rangeSearchWithBoundingBox(inBox, bbMin, bbMax);
+            std::sort(inBox.begin(), inBox.end());
+            EXPECT_TRUE(inBox == expectedInBox);
+
+            inBox.clear();
+            frozenFromPoints.rangeSearchWithBoundingBox(inBox, bbMin, bbMax);
+            std::sort(inBox.begin(), inBox.end());
+            EXPECT_TRUE(inBox == expectedInBox);
+        }
+    }
+
+    {
+        // degenerate tree (list) is deeper than recursion of van Emde Boas split
+        int points[64][2];
+        for (int i = 0; i < 64; ++i)
+        {
+            points[i][0] = i;
+            points[i][1] = i;
+        }
+        lw_index_datastructs::KDtree<int, 2, double> chain(points, 64, lw_index_datastructs::KdTreeBuildMode::eIncrementalInsertion);
+        for (size_t t = 0; t < sizeof(layouts) / sizeof(layouts[0]); ++t)
+        {
+            lw_index_datastructs::FrozenKDtree<int, 2, double> frozen(chain, 1, layouts[t]);
+            EXPECT_TRUE(frozen.height() == 64);
+            int req[] = { 40, 41 };
+            EXPECT_TRUE(frozen.nearestPointInEuclidianMetric(req) == points[40] || frozen.nearestPointInEuclidianMetric(req) == points[41]);
+        }
+    }
+}
+
+TEST(Utils, KdTreeFrozenLayoutsGPerf)
+{
+    // 100M points need ~10GB of RAM for points, pointer based tree and frozen tree. Extend this list on the machine which has it.
+    const size_t kPointsCounts[] = { 1000 * 1000, 10 * 1000 * 1000 };
+    const size_t kRequests = 200 * 1000;
+
+    std::vector<float> requests = generateFrozenTestPoints<float, 3>(kRequests, 2, 1000.0f);
+    lw_index_datastructs::KdTreeFrozenLayout layouts[] = { lw_index_datastructs::KdTreeFrozenLayout::ePreorder,
+                                                           lw_index_datastructs::KdTreeFrozenLayout::eVanEmdeBoas,
+                                                           lw_index_datastructs::KdTreeFrozenLayout::eBlocked };
+    const char* layoutNames[] = { "preorder", "van Emde Boas", "blocked" };
+
+    size_t checksum = 0;
+    size_t expectedChecksum = 0;
+
+    for (size_t c = 0; c < sizeof(kPointsCounts) / sizeof(kPointsCounts[0]); ++c)
+    {
+        const size_t kPoints = kPointsCounts[c];
+        std::vector<float> points = generateFrozenTestPoints<float, 3>(kPoints, 1, 1000.0f);
+        std::vector<const float*> ptrs = frozenTestPointers<float, 3>(points);
+        std::shuffle(ptrs.begin(), ptrs.end(), std::mt19937(3));
+
+        lw_index_datastructs::KDtree<float, 3, float> kd(ptrs, ptrs.size());
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kRequests; ++i)
+            checksum += (kd.nearestPointInEuclidianMetric(&requests[i * 3]) != nullptr);
+        gProxiedRecordPerf("nearest point in pointer based tree", kRequests, kPoints, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        expectedChecksum += kRequests;
+
+        for (size_t t = 0; t < sizeof(layouts) / sizeof(layouts[0]); ++t)
+        {
+            lw_index_datastructs::FrozenKDtree<float, 3, float> frozen(kd, 1, layouts[t]);
+            start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < kRequests; ++i)
+                checksum += (frozen.nearestPointInEuclidianMetric(&requests[i * 3]) != nullptr);
+            gProxiedRecordPerf(std::string("nearest point in frozen tree with ") + layoutNames[t] + " layout", kRequests, kPoints, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            expectedChecksum += kRequests;
+        }
+    }
+
+    EXPECT_TRUE(checksum == expectedChecksum);
+}
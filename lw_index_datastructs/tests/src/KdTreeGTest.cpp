@@ -2,6 +2,66 @@
 #include "GTestMacroses.h"
 
 #include <vector>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <math.h>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <string>
+
+namespace
+{
+    template <class TCoord, size_t Dimension>
+    std::vector<TCoord> generateUniformPoints(size_t num, unsigned int seed, TCoord maxValue)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<double> dist(0.0, double(maxValue));
+        std::vector<TCoord> points(num * Dimension);
+        for (size_t i = 0; i < points.size(); ++i)
+            points[i] = TCoord(dist(gen));
+        return points;
+    }
+
+    template <class TCoord, size_t Dimension>
+    std::vector<const TCoord*> pointersToPoints(const std::vector<TCoord>& points)
+    {
+        std::vector<const TCoord*> res(points.size() / Dimension);
+        for (size_t i = 0; i < res.size(); ++i)
+            res[i] = &points[i * Dimension];
+        return res;
+    }
+
+    template <class TNorm, class TCoord, size_t Dimension>
+    TNorm bruteForceNearestDistanceSqr(const std::vector<const TCoord*>& points, const TCoord* request)
+    {
+        TNorm best = std::numeric_limits<TNorm>::max();
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            TNorm d = TNorm();
+            for (size_t c = 0; c < Dimension; ++c)
+                d += (TNorm(points[i][c]) - TNorm(request[c])) * (TNorm(points[i][c]) - TNorm(request[c]));
+            if (d < best)
+                best = d;
+        }
+        return best;
+    }
+
+    template <class TNorm, class TCoord, size_t Dimension>
+    TNorm distanceSqr(const TCoord* a, const TCoord* b)
+    {
+        TNorm d = TNorm();
+        for (size_t c = 0; c < Dimension; ++c)
+            d += (TNorm(a[c]) - TNorm(b[c])) * (TNorm(a[c]) - TNorm(b[c]));
+        return d;
+    }
+
+    double millisecondsSince(const std::chrono::steady_clock::time_point& start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
 
 TEST(Utils, KdTreeGTest)
 {
@@ -100,3 +160,1790 @@ TEST(Utils, KdTreeGTest)
         }
     }
 }
+
+TEST(Utils, KdTreeBalancedBuildGTest)
+{
+    {
+        // sorted input degenerates incremental tree into a list
+        const size_t kPoints = 1000;
+        std::vector<int> points(kPoints * 2);
+        for (size_t i = 0; i < kPoints; ++i)
+        {
+            points[2 * i + 0] = int(i);
+            points[2 * i + 1] = int(i);
+        }
+        std::vector<const int*> ptrs = pointersToPoints<int, 2>(points);
+
+        lw_index_datastructs::KDtree<int, 2, double> kdIncremental(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eIncrementalInsertion);
+        EXPECT_TRUE(kdIncremental.size() == kPoints);
+        EXPECT_TRUE(kdIncremental.height() == kPoints);
+
+        lw_index_datastructs::KDtree<int, 2, double> kdBalanced(ptrs, ptrs.size());
+        EXPECT_TRUE(kdBalanced.size() == kPoints);
+        EXPECT_TRUE(kdBalanced.height() == 10);
+
+        int req[] = { 500, 501 };
+        const int* res = kdBalanced.nearestPointInEuclidianMetric(req);
+        EXPECT_TRUE(res[0] == 500 || res[0] == 501);
+
+        kdBalanced.buildBalanced(ptrs, 1);
+        EXPECT_TRUE(kdBalanced.size() == 1);
+        EXPECT_TRUE(kdBalanced.height() == 1);
+
+        kdBalanced.buildBalanced(ptrs, 0);
+        EXPECT_TRUE(kdBalanced.size() == 0);
+        EXPECT_TRUE(kdBalanced.height() == 0);
+    }
+
+    {
+        // points with coordinate equal to the split go to the right subtree
+        int points[][2] = { { 1, 1 }, { 1, 2 }, { 1, 3 }, { 1, 4 }, { 1, 5 }, { 0, 7 }, { 2, 7 } };
+        lw_index_datastructs::KDtree<int, 2, double> kd(points, 7);
+        EXPECT_TRUE(kd.size() == 7);
+        EXPECT_TRUE(kd.height() == 4);
+
+        for (size_t i = 0; i < 7; ++i)
+        {
+            const int* res = kd.nearestPointInEuclidianMetric(points[i]);
+            EXPECT_TRUE(res == points[i]);
+        }
+
+        int bb[][2] = { { 1, 2 }, { 1, 4 } };
+        std::vector<const int*> bbRes;
+        kd.rangeSearchWithBoundingBox(bbRes, bb[0], bb[1]);
+        EXPECT_TRUE(bbRes.size() == 3);
+    }
+
+    {
+        const size_t kPoints = 5000;
+        std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 1, 100.0);
+        std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+
+        lw_index_datastructs::KDtree<double, 3> kd;
+        kd.buildBalanced(ptrs, ptrs.size());
+        EXPECT_TRUE(kd.size() == kPoints);
+        EXPECT_TRUE(kd.height() == 13);
+
+        std::vector<double> requests = generateUniformPoints<double, 3>(200, 2, 100.0);
+        for (size_t i = 0; i < 200; ++i)
+        {
+            const double* req = &requests[i * 3];
+            const double* res = kd.nearestPointInEuclidianMetric(req);
+            EXPECT_TRUE(res != nullptr);
+            EXPECT_DOUBLE_EQ((distanceSqr<double, double, 3>(res, req)), (bruteForceNearestDistanceSqr<double, double, 3>(ptrs, req)));
+        }
+
+        double bbMin[] = { 10.0, 20.0, 30.0 };
+        double bbMax[] = { 40.0, 50.0, 60.0 };
+        std::vector<const double*> bbRes;
+        kd.rangeSearchWithBoundingBox(bbRes, bbMin, bbMax);
+
+        size_t expectedInBox = 0;
+        for (size_t i = 0; i < ptrs.size(); ++i)
+        {
+            bool inside = true;
+            for (size_t c = 0; c < 3; ++c)
+                inside = inside && ptrs[i][c] >= bbMin[c] && ptrs[i][c] <= bbMax[c];
+            if (inside)
+                expectedInBox++;
+        }
+        EXPECT_TRUE(bbRes.size() == expectedInBox);
+    }
+
+    {
+        // points closer then tolerance of the comparator to the split go to the right subtree as in pushInTree()
+        double points[][1] = { { 1.0 }, { 1.0 + 5e-7 }, { 2.0 } };
+        lw_index_datastructs::KDtree<double, 1> kdBalanced(points, 3);
+
+        lw_index_datastructs::KDtree<double, 1> kdIncremental;
+        kdIncremental.pushInTree(points[1]);
+        kdIncremental.pushInTree(points[2]);
+        kdIncremental.pushInTree(points[0]);
+        EXPECT_TRUE(kdBalanced.isSameStructure(kdIncremental));
+        EXPECT_TRUE(kdBalanced.height() == 3);
+    }
+}
+
+TEST(Utils, KdTreeBuildGPerf)
+{
+    const size_t kPoints = 1000 * 1000;
+    const size_t kRequests = 100 * 1000;
+
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 1, 1000.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> requests = generateUniformPoints<double, 3>(kRequests, 2, 1000.0);
+
+    {
+        auto start = std::chrono::steady_clock::now();
+        lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eIncrementalInsertion);
+        gProxiedRecordPerf("build with pushInTree", 1, kPoints, millisecondsSince(start));
+        gProxiedRecordProperty("height with pushInTree", kd.height());
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kRequests; ++i)
+            kd.nearestPointInEuclidianMetric(&requests[i * 3]);
+        gProxiedRecordPerf("nearest point in tree built with pushInTree", kRequests, kPoints, millisecondsSince(start));
+    }
+
+    {
+        auto start = std::chrono::steady_clock::now();
+        lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eBalancedMedianSplit);
+        gProxiedRecordPerf("build with median split", 1, kPoints, millisecondsSince(start));
+        gProxiedRecordProperty("height with median split", kd.height());
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kRequests; ++i)
+            kd.nearestPointInEuclidianMetric(&requests[i * 3]);
+        gProxiedRecordPerf("nearest point in tree built with median split", kRequests, kPoints, millisecondsSince(start));
+    }
+}
+
+TEST(Utils, KdTreeParallelBuildGTest)
+{
+    const size_t kPoints = 20000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 3, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+
+    lw_index_datastructs::KDtree<double, 3> kdSerial;
+    kdSerial.buildBalanced(ptrs, ptrs.size());
+
+    size_t threads[] = { 1, 2, 4 };
+    size_t grains[] = { 1, 100, 1000, kPoints };
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+    {
+        lw_index_datastructs::WorkStealingTaskPool pool(threads[t]);
+        EXPECT_TRUE(pool.threadsCount() == threads[t]);
+
+        for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); ++g)
+        {
+            lw_index_datastructs::KDtree<double, 3> kdParallel;
+            kdParallel.buildBalancedParallel(ptrs, ptrs.size(), pool, grains[g]);
+            EXPECT_TRUE(kdParallel.size() == kPoints);
+            EXPECT_TRUE(kdParallel.height() == kdSerial.height());
+            EXPECT_TRUE(kdParallel.isSameStructure(kdSerial));
+        }
+    }
+
+    lw_index_datastructs::KDtree<double, 3> kdParallel;
+    kdParallel.buildBalancedParallel(ptrs, ptrs.size(), 3, 500);
+    EXPECT_TRUE(kdParallel.isSameStructure(kdSerial));
+
+    lw_index_datastructs::KDtree<double, 3> kdIncremental(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eIncrementalInsertion);
+    EXPECT_FALSE(kdIncremental.isSameStructure(kdSerial));
+
+    kdParallel.buildBalancedParallel(ptrs, 0, 2);
+    EXPECT_TRUE(kdParallel.size() == 0);
+    EXPECT_TRUE(kdParallel.isSameStructure(lw_index_datastructs::KDtree<double, 3>()));
+}
+
+TEST(Utils, KdTreeParallelBuildGPerf)
+{
+    const size_t kPoints = 4 * 1000 * 1000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 1, 1000.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+
+    {
+        auto start = std::chrono::steady_clock::now();
+        lw_index_datastructs::KDtree<double, 3> kd;
+        kd.buildBalanced(ptrs, ptrs.size());
+        gProxiedRecordPerf("serial build with median split", 1, kPoints, millisecondsSince(start));
+    }
+
+    size_t threads[] = { 2, 4, 8 };
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+    {
+        lw_index_datastructs::WorkStealingTaskPool pool(threads[t]);
+        auto start = std::chrono::steady_clock::now();
+        lw_index_datastructs::KDtree<double, 3> kd;
+        kd.buildBalancedParallel(ptrs, ptrs.size(), pool);
+        gProxiedRecordPerf("parallel build with median split in " + gPrintNumber(threads[t]) + " threads", 1, kPoints, millisecondsSince(start));
+    }
+}
+
+TEST(Utils, KdTreeWithNodeAllocatorsGTest)
+{
+    typedef lw_index_datastructs::KDtree<double, 3, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeHeapNodeAllocator> KdTreeWithHeap;
+    typedef lw_index_datastructs::KDtree<double, 3, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeArenaNodeAllocator> KdTreeWithArena;
+
+    const size_t kPoints = 10000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 5, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+
+    KdTreeWithHeap kdHeap;
+    kdHeap.buildBalancedParallel(ptrs, ptrs.size(), 2, 100);
+    KdTreeWithArena kdArena(lw_index_datastructs::KdTreeArenaNodeAllocator(64 * 1024, true));
+    kdArena.buildBalanced(ptrs, ptrs.size());
+    EXPECT_TRUE(kdArena.nodeAllocator().allocatedBytes() > 0);
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        EXPECT_TRUE(kdHeap.nearestPointInEuclidianMetric(ptrs[i]) == ptrs[i]);
+        EXPECT_TRUE(kdArena.nearestPointInEuclidianMetric(ptrs[i]) == ptrs[i]);
+    }
+
+    // incremental insertions after bulk build take nodes from the same arena
+    double extra[] = { 1000.0, 1000.0, 1000.0 };
+    kdArena.pushInTree(extra);
+    kdHeap.pushInTree(extra);
+    EXPECT_TRUE(kdArena.size() == kPoints + 1);
+    EXPECT_TRUE(kdArena.nearestPointInEuclidianMetric(extra) == extra);
+    EXPECT_TRUE(kdHeap.nearestPointInEuclidianMetric(extra) == extra);
+
+    KdTreeWithArena kdArenaCopy(kdArena);
+    EXPECT_TRUE(kdArenaCopy.isSameStructure(kdArena));
+    EXPECT_TRUE(kdArenaCopy.nodeAllocator().isHugePagesUsed() == kdArena.nodeAllocator().isHugePagesUsed());
+
+    kdArena.removeAll();
+    EXPECT_TRUE(kdArena.size() == 0);
+    EXPECT_TRUE(kdArena.nodeAllocator().allocatedBytes() == 0);
+    EXPECT_TRUE(kdArenaCopy.size() == kPoints + 1);
+    EXPECT_TRUE(kdArenaCopy.nearestPointInEuclidianMetric(extra) == extra);
+}
+
+TEST(Utils, KdTreeWithNodeAllocatorsGPerf)
+{
+    typedef lw_index_datastructs::KDtree<double, 3, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeHeapNodeAllocator> KdTreeWithHeap;
+    typedef lw_index_datastructs::KDtree<double, 3, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeArenaNodeAllocator> KdTreeWithArena;
+
+    const size_t kPoints = 2 * 1000 * 1000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 1, 1000.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+
+    {
+        KdTreeWithHeap kd;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kPoints; ++i)
+            kd.pushInTree(ptrs[i]);
+        gProxiedRecordPerf("pushInTree with heap allocator", 1, kPoints, millisecondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        kd.removeAll();
+        gProxiedRecordPerf("removeAll with heap allocator", 1, kPoints, millisecondsSince(start));
+    }
+
+    {
+        KdTreeWithArena kd;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kPoints; ++i)
+            kd.pushInTree(ptrs[i]);
+        gProxiedRecordPerf("pushInTree with arena allocator", 1, kPoints, millisecondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        kd.removeAll();
+        gProxiedRecordPerf("removeAll with arena allocator", 1, kPoints, millisecondsSince(start));
+    }
+
+    {
+        KdTreeWithArena kd(lw_index_datastructs::KdTreeArenaNodeAllocator(lw_index_datastructs::KdTreeArenaNodeAllocator::kDefaultChunkSize, true));
+        auto start = std::chrono::steady_clock::now();
+        kd.buildBalanced(ptrs, ptrs.size());
+        gProxiedRecordPerf("buildBalanced with arena allocator in huge pages", 1, kPoints, millisecondsSince(start));
+    }
+
+    {
+        KdTreeWithHeap kd;
+        auto start = std::chrono::steady_clock::now();
+        kd.buildBalanced(ptrs, ptrs.size());
+        gProxiedRecordPerf("buildBalanced with heap allocator", 1, kPoints, millisecondsSince(start));
+    }
+}
+
+TEST(Utils, KdTreeSplitRuleGTest)
+{
+    // points are stretched along the first axis
+    const size_t kPoints = 6000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 5, 100.0);
+    for (size_t i = 0; i < kPoints; ++i)
+    {
+        points[3 * i + 0] *= 50.0;
+        points[3 * i + 2] *= 0.1;
+    }
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+
+    lw_index_datastructs::KDtree<double, 3> kdRoundRobin(ptrs, ptrs.size());
+    lw_index_datastructs::KDtree<double, 3> kdSpread(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eBalancedMedianSplit, lw_index_datastructs::KdTreeSplitRule::eMaxSpread);
+    EXPECT_TRUE(kdSpread.size() == kPoints);
+    EXPECT_TRUE(kdSpread.height() == kdRoundRobin.height());
+    EXPECT_FALSE(kdSpread.isSameStructure(kdRoundRobin));
+
+    lw_index_datastructs::KDtree<double, 3> kdSpreadParallel;
+    kdSpreadParallel.buildBalancedParallel(ptrs, ptrs.size(), 2, 100, lw_index_datastructs::KdTreeSplitRule::eMaxSpread);
+    EXPECT_TRUE(kdSpreadParallel.isSameStructure(kdSpread));
+
+    lw_index_datastructs::KDtree<double, 3> kdSpreadCopy(kdSpread);
+    EXPECT_TRUE(kdSpreadCopy.isSameStructure(kdSpread));
+
+    std::vector<double> requests = generateUniformPoints<double, 3>(200, 6, 100.0);
+    for (size_t i = 0; i < 200; ++i)
+    {
+        double* req = &requests[i * 3];
+        req[0] *= 50.0;
+        req[2] *= 0.1;
+        const double* res = kdSpread.nearestPointInEuclidianMetric(req);
+        EXPECT_TRUE(res != nullptr);
+        EXPECT_DOUBLE_EQ((distanceSqr<double, double, 3>(res, req)), (bruteForceNearestDistanceSqr<double, double, 3>(ptrs, req)));
+    }
+
+    double bbMin[] = { 1000.0, 20.0, 3.0 };
+    double bbMax[] = { 2500.0, 50.0, 6.0 };
+    std::vector<const double*> bbRes;
+    kdSpread.rangeSearchWithBoundingBox(bbRes, bbMin, bbMax);
+    std::vector<const double*> bbExpected;
+    kdRoundRobin.rangeSearchWithBoundingBox(bbExpected, bbMin, bbMax);
+    EXPECT_TRUE(bbRes.size() == bbExpected.size());
+    EXPECT_TRUE(bbRes.size() > 0);
+
+    // incremental insertion keeps split axis of existing nodes
+    for (size_t i = 100; i < kPoints; ++i)
+        kdSpread.pushInTree(ptrs[i]);
+    EXPECT_TRUE(kdSpread.size() == 2 * kPoints - 100);
+    for (size_t i = 0; i < 50; ++i)
+        EXPECT_DOUBLE_EQ((distanceSqr<double, double, 3>(kdSpread.nearestPointInEuclidianMetric(ptrs[i * 100]), ptrs[i * 100])), 0.0);
+}
+
+TEST(Utils, KdTreeSplitRuleGPerf)
+{
+    const size_t kPoints = 1000 * 1000;
+    const size_t kRequests = 100 * 1000;
+
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 1, 1000.0);
+    std::vector<double> requests = generateUniformPoints<double, 3>(kRequests, 2, 1000.0);
+    for (size_t i = 0; i < kPoints; ++i)
+        points[3 * i + 2] *= 0.01;
+    for (size_t i = 0; i < kRequests; ++i)
+        requests[3 * i + 2] *= 0.01;
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+
+    lw_index_datastructs::KdTreeSplitRule rules[] = { lw_index_datastructs::KdTreeSplitRule::eRoundRobin, lw_index_datastructs::KdTreeSplitRule::eMaxSpread };
+    const char* ruleNames[] = { "round robin", "max spread" };
+
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eBalancedMedianSplit, rules[r]);
+        gProxiedRecordPerf(std::string("build with ") + ruleNames[r] + " split axis", 1, kPoints, millisecondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kRequests; ++i)
+            kd.nearestPointInEuclidianMetric(&requests[i * 3]);
+        gProxiedRecordPerf(std::string("nearest point for flat data in tree with ") + ruleNames[r] + " split axis", kRequests, kPoints, millisecondsSince(start));
+    }
+}
+
+TEST(Utils, KdTreeOwnedStorageGTest)
+{
+    const size_t kPoints = 5000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 9, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> requests = generateUniformPoints<double, 3>(200, 10, 100.0);
+
+    lw_index_datastructs::KDtree<double, 3> kdExternal(ptrs, ptrs.size());
+    std::vector<const double*> expectedNearest;
+    for (size_t i = 0; i < 200; ++i)
+        expectedNearest.push_back(kdExternal.nearestPointInEuclidianMetric(&requests[i * 3]));
+
+    double bbMin[] = { 10.0, 20.0, 30.0 };
+    double bbMax[] = { 40.0, 50.0, 60.0 };
+    std::vector<const double*> expectedInBox;
+    kdExternal.rangeSearchWithBoundingBox(expectedInBox, bbMin, bbMax);
+
+    lw_index_datastructs::KDtree<double, 3> kdOwned(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eBalancedMedianSplit,
+                                                    lw_index_datastructs::KdTreeSplitRule::eRoundRobin, lw_index_datastructs::KdTreeStorageMode::eOwnedCoordinates);
+    EXPECT_TRUE(kdOwned.storageMode() == lw_index_datastructs::KdTreeStorageMode::eOwnedCoordinates);
+    EXPECT_TRUE(kdOwned.isSameStructure(kdExternal));
+
+    lw_index_datastructs::KDtree<double, 3> kdOwnedCopy(kdOwned);
+    EXPECT_TRUE(kdOwnedCopy.storageMode() == lw_index_datastructs::KdTreeStorageMode::eOwnedCoordinates);
+    EXPECT_TRUE(kdOwnedCopy.isSameStructure(kdExternal));
+
+    // queries of the trees with own copy of coordinates do not read memory of the user, but still return pointers to it
+    std::vector<double> pointsBackup = points;
+    std::fill(points.begin(), points.end(), -1.0);
+
+    for (size_t i = 0; i < 200; ++i)
+    {
+        EXPECT_TRUE(kdOwned.nearestPointInEuclidianMetric(&requests[i * 3]) == expectedNearest[i]);
+        EXPECT_TRUE(kdOwnedCopy.nearestPointInEuclidianMetric(&requests[i * 3]) == expectedNearest[i]);
+    }
+
+    std::vector<const double*> inBox;
+    kdOwned.rangeSearchWithBoundingBox(inBox, bbMin, bbMax);
+    EXPECT_TRUE(inBox == expectedInBox);
+
+    // points appended after build are copied too
+    std::vector<double> extraPoints = generateUniformPoints<double, 3>(kPoints, 11, 100.0);
+    std::vector<const double*> extraPtrs = pointersToPoints<double, 3>(extraPoints);
+    for (size_t i = 0; i < kPoints; ++i)
+        kdOwned.pushInTree(extraPtrs[i]);
+    EXPECT_TRUE(kdOwned.size() == 2 * kPoints);
+    std::vector<double> extraBackup = extraPoints;
+    std::fill(extraPoints.begin(), extraPoints.end(), -1.0);
+    for (size_t i = 0; i < kPoints; i += 97)
+        EXPECT_TRUE(kdOwned.nearestPointInEuclidianMetric(&extraBackup[i * 3]) == extraPtrs[i]);
+
+    // switch back to the memory of the user
+    points = pointsBackup;
+    extraPoints = extraBackup;
+    kdOwned.setStorageMode(lw_index_datastructs::KdTreeStorageMode::eExternalPoints);
+    EXPECT_TRUE(kdOwned.storageMode() == lw_index_datastructs::KdTreeStorageMode::eExternalPoints);
+    for (size_t i = 0; i < kPoints; i += 97)
+        EXPECT_TRUE(kdOwned.nearestPointInEuclidianMetric(extraPtrs[i]) == extraPtrs[i]);
+
+    kdExternal.setStorageMode(lw_index_datastructs::KdTreeStorageMode::eOwnedCoordinates);
+    EXPECT_TRUE(kdExternal.isSameStructure(kdOwnedCopy));
+    kdExternal.buildBalanced(ptrs, 100);
+    EXPECT_TRUE(kdExternal.size() == 100);
+    EXPECT_TRUE(kdExternal.nearestPointInEuclidianMetric(ptrs[50]) == ptrs[50]);
+    kdExternal.removeAll();
+    EXPECT_TRUE(kdExternal.nearestPointInEuclidianMetric(ptrs[50]) == nullptr);
+}
+
+TEST(Utils, KdTreeOwnedStorageGPerf)
+{
+    const size_t kPoints = 2 * 1000 * 1000;
+    const size_t kRequests = 200 * 1000;
+
+    std::vector<float> points = generateUniformPoints<float, 3>(kPoints, 1, 1000.0f);
+    std::vector<const float*> ptrs = pointersToPoints<float, 3>(points);
+    std::vector<float> requests = generateUniformPoints<float, 3>(kRequests, 2, 1000.0f);
+
+    // shuffle points to not have locality in memory of the user between neighbours in the tree
+    std::shuffle(ptrs.begin(), ptrs.end(), std::mt19937(3));
+
+    lw_index_datastructs::KdTreeStorageMode modes[] = { lw_index_datastructs::KdTreeStorageMode::eExternalPoints, lw_index_datastructs::KdTreeStorageMode::eOwnedCoordinates };
+    const char* modeNames[] = { "external points", "owned coordinates" };
+    size_t checksum = 0;
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+    {
+        auto start = std::chrono::steady_clock::now();
+        lw_index_datastructs::KDtree<float, 3, float> kd(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eBalancedMedianSplit,
+                                                         lw_index_datastructs::KdTreeSplitRule::eRoundRobin, modes[m]);
+        gProxiedRecordPerf(std::string("build with ") + modeNames[m], 1, kPoints, millisecondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kRequests; ++i)
+            checksum += (kd.nearestPointInEuclidianMetric(&requests[i * 3]) != nullptr);
+        gProxiedRecordPerf(std::string("nearest point with ") + modeNames[m], kRequests, kPoints, millisecondsSince(start));
+    }
+
+    EXPECT_TRUE(checksum == 2 * kRequests);
+}
+
+TEST(Utils, KdTreeMoveAndSwapGTest)
+{
+    typedef lw_index_datastructs::KDtree<double, 3, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeHeapNodeAllocator> KdTreeWithHeap;
+    typedef lw_index_datastructs::KDtree<double, 3> KdTreeWithArena;
+
+    EXPECT_TRUE(std::is_nothrow_move_constructible<KdTreeWithArena>::value);
+    EXPECT_TRUE(std::is_nothrow_move_assignable<KdTreeWithArena>::value);
+    EXPECT_TRUE(std::is_nothrow_move_constructible<KdTreeWithHeap>::value);
+
+    const size_t kPoints = 3000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 13, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+
+    {
+        KdTreeWithArena kd(ptrs, ptrs.size());
+        KdTreeWithArena reference(kd);
+        size_t chunks = kd.nodeAllocator().chunksCount();
+
+        KdTreeWithArena moved(std::move(kd));
+        EXPECT_TRUE(moved.size() == kPoints);
+        EXPECT_TRUE(moved.isSameStructure(reference));
+        EXPECT_TRUE(moved.nodeAllocator().chunksCount() == chunks);
+        EXPECT_TRUE(kd.size() == 0);
+        EXPECT_TRUE(kd.nodeAllocator().chunksCount() == 0);
+        EXPECT_TRUE(kd.nearestPointInEuclidianMetric(ptrs[0]) == nullptr);
+
+        // moved-from tree is usable
+        kd.buildBalanced(ptrs, 10);
+        EXPECT_TRUE(kd.nearestPointInEuclidianMetric(ptrs[5]) == ptrs[5]);
+
+        kd = std::move(moved);
+        EXPECT_TRUE(kd.size() == kPoints);
+        EXPECT_TRUE(kd.isSameStructure(reference));
+        EXPECT_TRUE(moved.size() == 0);
+
+        KdTreeWithArena small(ptrs, 10);
+        swap(kd, small);
+        EXPECT_TRUE(kd.size() == 10);
+        EXPECT_TRUE(small.size() == kPoints);
+        EXPECT_TRUE(small.isSameStructure(reference));
+        kd.swap(small);
+        EXPECT_TRUE(kd.isSameStructure(reference));
+    }
+
+    {
+        // copy assignment keeps enable flags, self assignment does nothing
+        KdTreeWithHeap kd(ptrs, ptrs.size());
+        EXPECT_TRUE(kd.nearestPointInEuclidianMetric(ptrs[7], false) == ptrs[7]);
+        EXPECT_TRUE(kd.sizeOfDisabledPoints() == 1);
+
+        KdTreeWithHeap copy;
+        copy = kd;
+        EXPECT_TRUE(copy.isSameStructure(kd));
+        EXPECT_TRUE(copy.sizeOfDisabledPoints() == 1);
+        EXPECT_TRUE(copy.nearestPointInEuclidianMetric(ptrs[7]) != ptrs[7]);
+
+        KdTreeWithHeap& alias = copy;
+        copy = alias;
+        EXPECT_TRUE(copy.isSameStructure(kd));
+
+        copy = std::move(alias);
+        EXPECT_TRUE(copy.isSameStructure(kd));
+    }
+
+    {
+        // vector of trees moves trees during reallocation
+        std::vector<KdTreeWithArena> trees;
+        std::vector<const double*> nearest;
+        for (size_t i = 0; i < 20; ++i)
+        {
+            trees.push_back(KdTreeWithArena(ptrs, 100 * (i + 1), lw_index_datastructs::KdTreeBuildMode::eBalancedMedianSplit,
+                                            lw_index_datastructs::KdTreeSplitRule::eRoundRobin, lw_index_datastructs::KdTreeStorageMode::eOwnedCoordinates));
+            nearest.push_back(trees.back().nearestPointInEuclidianMetric(ptrs[0]));
+        }
+        for (size_t i = 0; i < trees.size(); ++i)
+        {
+            EXPECT_TRUE(trees[i].size() == 100 * (i + 1));
+            EXPECT_TRUE(trees[i].nearestPointInEuclidianMetric(ptrs[0]) == ptrs[0]);
+            EXPECT_TRUE(nearest[i] == ptrs[0]);
+        }
+    }
+}
+
+TEST(Utils, KdTreeDeepTreeGTest)
+{
+    typedef lw_index_datastructs::KDtree<int, 2, double, lw_index_datastructs::Comparator<int>, lw_index_datastructs::KdTreeHeapNodeAllocator> KdTreeWithHeap;
+
+    // sorted input degenerates incremental tree into a list, all operations should not depend on the size of the call stack
+    const size_t kPoints = 10000;
+    std::vector<int> points(kPoints * 2);
+    for (size_t i = 0; i < kPoints; ++i)
+    {
+        points[2 * i + 0] = int(i);
+        points[2 * i + 1] = int(i);
+    }
+    std::vector<const int*> ptrs = pointersToPoints<int, 2>(points);
+
+    KdTreeWithHeap kd(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eIncrementalInsertion);
+    EXPECT_TRUE(kd.height() == kPoints);
+
+    int req[] = { int(kPoints) + 10, int(kPoints) + 10 };
+    EXPECT_TRUE(kd.nearestPointInEuclidianMetric(req) == ptrs.back());
+    EXPECT_TRUE(kd.nearestPointInEuclidianMetric(ptrs[0]) == ptrs[0]);
+
+    int bb[][2] = { { 100, 100 }, { 199, 199 } };
+    std::vector<const int*> bbRes;
+    kd.rangeSearchWithBoundingBox(bbRes, bb[0], bb[1]);
+    EXPECT_TRUE(bbRes.size() == 100);
+    EXPECT_TRUE(bbRes.front() == ptrs[100]);
+
+    KdTreeWithHeap copy(kd);
+    EXPECT_TRUE(copy.isSameStructure(kd));
+    EXPECT_TRUE(copy.height() == kPoints);
+
+    kd.makeAllPointsEnable();
+    kd.setStorageMode(lw_index_datastructs::KdTreeStorageMode::eOwnedCoordinates);
+    EXPECT_TRUE(kd.nearestPointInEuclidianMetric(ptrs[5000]) == ptrs[5000]);
+    kd.removeAll();
+    EXPECT_TRUE(kd.size() == 0);
+    EXPECT_TRUE(copy.nearestPointInEuclidianMetric(ptrs[kPoints - 1]) == ptrs[kPoints - 1]);
+}
+
+TEST(Utils, KdTreeKnearestGTest)
+{
+    const size_t kPoints = 4000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 15, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> requests = generateUniformPoints<double, 3>(100, 16, 100.0);
+
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+    const lw_index_datastructs::KDtree<double, 3>& kdConst = kd;
+
+    size_t Ks[] = { 1, 2, 10, 64 };
+    std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> neighbours(64);
+    for (size_t k = 0; k < sizeof(Ks) / sizeof(Ks[0]); ++k)
+    {
+        for (size_t i = 0; i < 100; ++i)
+        {
+            const double* req = &requests[i * 3];
+            std::vector<double> expected;
+            for (size_t j = 0; j < kPoints; ++j)
+                expected.push_back(distanceSqr<double, double, 3>(ptrs[j], req));
+            std::sort(expected.begin(), expected.end());
+
+            size_t found = kdConst.findKnearestPoints(req, Ks[k], neighbours.data());
+            EXPECT_TRUE(found == Ks[k]);
+            for (size_t j = 0; j < found; ++j)
+            {
+                EXPECT_DOUBLE_EQ(neighbours[j].distanceSqr, expected[j]);
+                EXPECT_DOUBLE_EQ((distanceSqr<double, double, 3>(neighbours[j].point, req)), neighbours[j].distanceSqr);
+            }
+            if (Ks[k] == 1)
+            {
+                EXPECT_TRUE(neighbours[0].point == kd.nearestPointInEuclidianMetric(req));
+            }
+        }
+    }
+
+    {
+        // disabled points are skipped, old interface disables found points on request
+        int points2d[][2] = { { 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 }, { 4, 0 } };
+        lw_index_datastructs::KDtree<int, 2, double> small(points2d, 5);
+        lw_index_datastructs::KdTreeNeighbour<int, double> res[8];
+        int req[] = { 0, 0 };
+
+        EXPECT_TRUE(small.findKnearestPoints(req, 0, res) == 0);
+        EXPECT_TRUE(small.findKnearestPoints(req, 8, res) == 5);
+        for (size_t i = 0; i < 5; ++i)
+        {
+            EXPECT_TRUE(res[i].point == points2d[i]);
+            EXPECT_TRUE(res[i].distanceSqr == double(i * i));
+        }
+
+        std::vector<const int*> out;
+        small.findKnearestPointInEuclidianMetric(out, req, 2, false);
+        EXPECT_TRUE(out.size() == 2);
+        EXPECT_TRUE(out[0] == points2d[0] && out[1] == points2d[1]);
+        EXPECT_TRUE(small.sizeOfDisabledPoints() == 2);
+
+        EXPECT_TRUE(small.findKnearestPoints(req, 8, res) == 3);
+        EXPECT_TRUE(res[0].point == points2d[2]);
+
+        out.clear();
+        small.findKnearestPointInEuclidianMetric(out, req, 10);
+        EXPECT_TRUE(out.size() == 3);
+        small.makeAllPointsEnable();
+        EXPECT_TRUE(small.findKnearestPoints(req, 8, res) == 5);
+
+        lw_index_datastructs::KDtree<int, 2, double> empty;
+        EXPECT_TRUE(empty.findKnearestPoints(req, 8, res) == 0);
+    }
+
+    {
+        // owned coordinates return pointers to points of the user
+        lw_index_datastructs::KDtree<double, 3> kdOwned(ptrs, ptrs.size(), lw_index_datastructs::KdTreeBuildMode::eBalancedMedianSplit,
+                                                        lw_index_datastructs::KdTreeSplitRule::eRoundRobin, lw_index_datastructs::KdTreeStorageMode::eOwnedCoordinates);
+        std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> ownedNeighbours(10);
+        for (size_t i = 0; i < 100; ++i)
+        {
+            EXPECT_TRUE(kdOwned.findKnearestPoints(&requests[i * 3], 10, ownedNeighbours.data()) == 10);
+            EXPECT_TRUE(kd.findKnearestPoints(&requests[i * 3], 10, neighbours.data()) == 10);
+            for (size_t j = 0; j < 10; ++j)
+                EXPECT_TRUE(ownedNeighbours[j].distanceSqr == neighbours[j].distanceSqr);
+            EXPECT_TRUE(ownedNeighbours[0].point == neighbours[0].point);
+        }
+    }
+}
+
+TEST(Utils, KdTreeKnearestGPerf)
+{
+    const size_t kPoints = 1000 * 1000;
+    const size_t kRequests = 100 * 1000;
+
+    std::vector<float> points = generateUniformPoints<float, 3>(kPoints, 1, 1000.0f);
+    std::vector<const float*> ptrs = pointersToPoints<float, 3>(points);
+    std::vector<float> requests = generateUniformPoints<float, 3>(kRequests, 2, 1000.0f);
+    lw_index_datastructs::KDtree<float, 3, float> kd(ptrs, ptrs.size());
+
+    size_t Ks[] = { 1, 10, 100 };
+    std::vector<lw_index_datastructs::KdTreeNeighbour<float, float>> neighbours(100);
+    size_t checksum = 0;
+    for (size_t k = 0; k < sizeof(Ks) / sizeof(Ks[0]); ++k)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kRequests; ++i)
+            checksum += kd.findKnearestPoints(&requests[i * 3], Ks[k], neighbours.data());
+        gProxiedRecordPerf("k nearest points in one pass for K=" + gPrintNumber(Ks[k]), kRequests, kPoints, millisecondsSince(start));
+    }
+
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kRequests; ++i)
+            checksum += (kd.nearestPointInEuclidianMetric(&requests[i * 3]) != nullptr);
+        gProxiedRecordPerf("nearest point", kRequests, kPoints, millisecondsSince(start));
+    }
+
+    EXPECT_TRUE(checksum == kRequests * 111 + kRequests);
+}
+
+TEST(Utils, KdTreeBatchQueriesGTest)
+{
+    const size_t kPoints = 5000;
+    const size_t kQueries = 1000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 17, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> queries = generateUniformPoints<double, 3>(kQueries, 18, 100.0);
+
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+    const size_t K = 5;
+    std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> expectedKnn(kQueries * K);
+    for (size_t q = 0; q < kQueries; ++q)
+        EXPECT_TRUE(kd.findKnearestPoints(&queries[q * 3], K, &expectedKnn[q * K]) == K);
+
+    size_t threads[] = { 1, 2, 4 };
+    size_t grains[] = { 1, 7, 256, kQueries * 2 };
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+    {
+        lw_index_datastructs::WorkStealingTaskPool pool(threads[t]);
+        for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); ++g)
+        {
+            std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> nearest(kQueries);
+            kd.findNearestPointsBatch(queries.data(), kQueries, nearest.data(), pool, grains[g]);
+            std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> knn(kQueries * K);
+            kd.findKnearestPointsBatch(queries.data(), kQueries, K, knn.data(), pool, grains[g]);
+
+            for (size_t q = 0; q < kQueries; ++q)
+            {
+                EXPECT_TRUE(nearest[q].point == kd.nearestPointInEuclidianMetric(&queries[q * 3]));
+                EXPECT_DOUBLE_EQ(nearest[q].distanceSqr, expectedKnn[q * K].distanceSqr);
+                for (size_t i = 0; i < K; ++i)
+                {
+                    EXPECT_TRUE(knn[q * K + i].point == expectedKnn[q * K + i].point);
+                    EXPECT_TRUE(knn[q * K + i].distanceSqr == expectedKnn[q * K + i].distanceSqr);
+                }
+            }
+        }
+    }
+
+    {
+        // rows for tree with less then K points are padded
+        int points2d[][2] = { { 0, 0 }, { 1, 0 } };
+        lw_index_datastructs::KDtree<int, 2, double> small(points2d, 2);
+        int queries2d[] = { 0, 0, 5, 0 };
+        lw_index_datastructs::KdTreeNeighbour<int, double> res[6];
+        small.findKnearestPointsBatch(queries2d, 2, 3, res, 2, 1);
+        EXPECT_TRUE(res[0].point == points2d[0] && res[1].point == points2d[1] && res[2].point == nullptr);
+        EXPECT_TRUE(res[3].point == points2d[1] && res[3].distanceSqr == 16.0);
+        EXPECT_TRUE(res[5].point == nullptr && res[5].distanceSqr == std::numeric_limits<double>::max());
+
+        lw_index_datastructs::KDtree<int, 2, double> empty;
+        empty.findNearestPointsBatch(queries2d, 2, res, 2);
+        EXPECT_TRUE(res[0].point == nullptr && res[1].point == nullptr);
+    }
+}
+
+TEST(Utils, KdTreeBatchQueriesGPerf)
+{
+    const size_t kPoints = 1000 * 1000;
+    const size_t kQueries = 500 * 1000;
+
+    std::vector<float> points = generateUniformPoints<float, 3>(kPoints, 1, 1000.0f);
+    std::vector<const float*> ptrs = pointersToPoints<float, 3>(points);
+    std::vector<float> queries = generateUniformPoints<float, 3>(kQueries, 2, 1000.0f);
+    lw_index_datastructs::KDtree<float, 3, float> kd(ptrs, ptrs.size());
+
+    std::vector<lw_index_datastructs::KdTreeNeighbour<float, float>> nearest(kQueries);
+    std::vector<lw_index_datastructs::KdTreeNeighbour<float, float>> knn(kQueries * 8);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t q = 0; q < kQueries; ++q)
+        nearest[q].point = kd.nearestPointInEuclidianMetric(&queries[q * 3]);
+    gProxiedRecordPerf("nearest point one by one", kQueries, kPoints, millisecondsSince(start));
+
+    size_t threads[] = { 1, 2, 4, 8 };
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+    {
+        lw_index_datastructs::WorkStealingTaskPool pool(threads[t]);
+
+        start = std::chrono::steady_clock::now();
+        kd.findNearestPointsBatch(queries.data(), kQueries, nearest.data(), pool);
+        gProxiedRecordPerf("batch of nearest points in " + gPrintNumber(threads[t]) + " threads", kQueries, kPoints, millisecondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        kd.findKnearestPointsBatch(queries.data(), kQueries, 8, knn.data(), pool);
+        gProxiedRecordPerf("batch of 8 nearest points in " + gPrintNumber(threads[t]) + " threads", kQueries, kPoints, millisecondsSince(start));
+    }
+}
+
+TEST(Utils, KdTreeApproximateNearestGTest)
+{
+    const size_t kPoints = 5000;
+    std::vector<double> points = generateUniformPoints<double, 4>(kPoints, 19, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 4>(points);
+    std::vector<double> requests = generateUniformPoints<double, 4>(300, 20, 100.0);
+    lw_index_datastructs::KDtree<double, 4> kd(ptrs, ptrs.size());
+
+    double epsValues[] = { 0.0, 0.1, 0.5, 1.0, 3.0 };
+    std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> exact(8);
+    std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> approximate(8);
+
+    for (size_t e = 0; e < sizeof(epsValues) / sizeof(epsValues[0]); ++e)
+    {
+        double eps = epsValues[e];
+        double allowedRatioSqr = (1.0 + eps) * (1.0 + eps) * (1.0 + 1e-12);
+        for (size_t i = 0; i < 300; ++i)
+        {
+            const double* req = &requests[i * 4];
+            double trueNearest = bruteForceNearestDistanceSqr<double, double, 4>(ptrs, req);
+            const double* res = kd.approximateNearestPointInEuclidianMetric(req, eps);
+            EXPECT_TRUE(res != nullptr);
+            EXPECT_TRUE((distanceSqr<double, double, 4>(res, req)) <= trueNearest * allowedRatioSqr);
+            if (eps == 0.0)
+            {
+                EXPECT_TRUE(res == kd.nearestPointInEuclidianMetric(req));
+            }
+
+            EXPECT_TRUE(kd.findKnearestPoints(req, 8, exact.data()) == 8);
+            EXPECT_TRUE(kd.findKnearestPoints(req, 8, approximate.data(), eps) == 8);
+            for (size_t j = 0; j < 8; ++j)
+            {
+                EXPECT_TRUE(approximate[j].distanceSqr >= exact[j].distanceSqr);
+                EXPECT_TRUE(approximate[j].distanceSqr <= exact[j].distanceSqr * allowedRatioSqr);
+            }
+        }
+    }
+
+    {
+        // integer norm
+        int points2d[][2] = { { 0, 0 }, { 10, 0 }, { 0, 10 }, { 7, 7 }, { 3, 4 } };
+        lw_index_datastructs::KDtree<int, 2, int> small(points2d, 5);
+        int req[] = { 3, 3 };
+        EXPECT_TRUE(small.approximateNearestPointInEuclidianMetric(req, 0.0) == points2d[4]);
+        const int* res = small.approximateNearestPointInEuclidianMetric(req, 2.0);
+        int dx = res[0] - req[0];
+        int dy = res[1] - req[1];
+        EXPECT_TRUE(dx * dx + dy * dy <= 9 * 1);
+
+        lw_index_datastructs::KDtree<int, 2, int> empty;
+        EXPECT_TRUE(empty.approximateNearestPointInEuclidianMetric(req, 1.0) == nullptr);
+    }
+}
+
+namespace
+{
+    template <size_t Dim>
+    void measureApproximateNearestPoint(size_t numPoints, size_t numRequests, const double* epsValues, size_t epsCount)
+    {
+        std::vector<float> points = generateUniformPoints<float, Dim>(numPoints, 1, 1000.0f);
+        std::vector<const float*> ptrs = pointersToPoints<float, Dim>(points);
+        std::vector<float> requests = generateUniformPoints<float, Dim>(numRequests, 2, 1000.0f);
+        lw_index_datastructs::KDtree<float, Dim, float> kd(ptrs, ptrs.size());
+
+        std::vector<float> exactDistances(numRequests);
+        for (size_t i = 0; i < numRequests; ++i)
+            exactDistances[i] = distanceSqr<float, float, Dim>(kd.nearestPointInEuclidianMetric(&requests[i * Dim]), &requests[i * Dim]);
+
+        for (size_t e = 0; e < epsCount; ++e)
+        {
+            std::vector<const float*> found(numRequests);
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < numRequests; ++i)
+                found[i] = kd.approximateNearestPointInEuclidianMetric(&requests[i * Dim], epsValues[e]);
+            double ms = millisecondsSince(start);
+
+            double sumOfRatios = 0.0;
+            for (size_t i = 0; i < numRequests; ++i)
+            {
+                float d = distanceSqr<float, float, Dim>(found[i], &requests[i * Dim]);
+                sumOfRatios += exactDistances[i] > 0.0f ? sqrt(double(d) / double(exactDistances[i])) : 1.0;
+                EXPECT_TRUE(d <= exactDistances[i] * (1.0 + epsValues[e]) * (1.0 + epsValues[e]) * 1.0001);
+            }
+
+            std::string name = "approximate nearest point in " + gPrintNumber(Dim) + "D with eps=" + std::to_string(epsValues[e]);
+            gProxiedRecordPerf(name, numRequests, numPoints, ms);
+            gProxiedRecordProperty(name + " average distance ratio", sumOfRatios / double(numRequests));
+        }
+    }
+}
+
+TEST(Utils, KdTreeApproximateNearestGPerf)
+{
+    const size_t kPoints = 1000 * 1000;
+    const size_t kRequests = 20 * 1000;
+    const double epsValues[] = { 0.0, 0.1, 0.25, 0.5, 1.0, 2.0 };
+    const size_t epsCount = sizeof(epsValues) / sizeof(epsValues[0]);
+
+    measureApproximateNearestPoint<3>(kPoints, kRequests, epsValues, epsCount);
+    measureApproximateNearestPoint<8>(kPoints, kRequests, epsValues, epsCount);
+}
+
+TEST(Utils, KdTreeBestBinFirstGTest)
+{
+    const size_t kPoints = 3000;
+    std::vector<float> points = generateUniformPoints<float, 16>(kPoints, 21, 100.0f);
+    std::vector<const float*> ptrs = pointersToPoints<float, 16>(points);
+    std::vector<float> requests = generateUniformPoints<float, 16>(100, 22, 100.0f);
+    lw_index_datastructs::KDtree<float, 16, float> kd(ptrs, ptrs.size());
+
+    std::vector<lw_index_datastructs::KdTreeNeighbour<float, float>> exact(5);
+    std::vector<lw_index_datastructs::KdTreeNeighbour<float, float>> found(5);
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        const float* req = &requests[i * 16];
+
+        // budget which is enough to visit whole tree gives exact result
+        EXPECT_TRUE(kd.bestBinFirstNearestPointInEuclidianMetric(req, kPoints) == kd.nearestPointInEuclidianMetric(req));
+        EXPECT_TRUE(kd.findKnearestPoints(req, 5, exact.data()) == 5);
+        EXPECT_TRUE(kd.findKnearestPointsBestBinFirst(req, 5, found.data(), std::numeric_limits<size_t>::max()) == 5);
+        for (size_t j = 0; j < 5; ++j)
+            EXPECT_TRUE(found[j].distanceSqr == exact[j].distanceSqr);
+
+        // small budget limits number of checked points
+        EXPECT_TRUE(kd.findKnearestPointsBestBinFirst(req, 5, found.data(), 3) == 3);
+        EXPECT_TRUE(kd.findKnearestPointsBestBinFirst(req, 5, found.data(), 0) == 0);
+        EXPECT_TRUE(kd.bestBinFirstNearestPointInEuclidianMetric(req, 0) == nullptr);
+
+        const float* res = kd.bestBinFirstNearestPointInEuclidianMetric(req, 50);
+        EXPECT_TRUE(res != nullptr);
+        EXPECT_TRUE((distanceSqr<float, float, 16>(res, req)) >= exact[0].distanceSqr);
+        EXPECT_TRUE(kd.findKnearestPointsBestBinFirst(req, 5, found.data(), 50) == 5);
+        for (size_t j = 1; j < 5; ++j)
+            EXPECT_TRUE(found[j - 1].distanceSqr <= found[j].distanceSqr);
+    }
+
+    {
+        int points2d[][2] = { { 0, 0 }, { 10, 0 }, { 0, 10 }, { 7, 7 }, { 3, 4 } };
+        lw_index_datastructs::KDtree<int, 2, int> small(points2d, 5);
+        int req[] = { 3, 3 };
+        EXPECT_TRUE(small.bestBinFirstNearestPointInEuclidianMetric(req, 5) == points2d[4]);
+
+        small.nearestPointInEuclidianMetric(req, false);
+        const int* res = small.bestBinFirstNearestPointInEuclidianMetric(req, 5);
+        EXPECT_TRUE(res != nullptr && res != points2d[4]);
+
+        lw_index_datastructs::KDtree<int, 2, int> empty;
+        EXPECT_TRUE(empty.bestBinFirstNearestPointInEuclidianMetric(req, 10) == nullptr);
+    }
+}
+
+namespace
+{
+    template <size_t Dim>
+    void measureBestBinFirstNearestPoint(size_t numPoints, size_t numRequests, const size_t* budgets, size_t budgetsCount)
+    {
+        std::vector<float> points = generateUniformPoints<float, Dim>(numPoints, 23, 1000.0f);
+        std::vector<const float*> ptrs = pointersToPoints<float, Dim>(points);
+        std::vector<float> requests = generateUniformPoints<float, Dim>(numRequests, 24, 1000.0f);
+        lw_index_datastructs::KDtree<float, Dim, float> kd(ptrs, ptrs.size());
+
+        std::vector<const float*> exact(numRequests);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numRequests; ++i)
+            exact[i] = kd.nearestPointInEuclidianMetric(&requests[i * Dim]);
+        gProxiedRecordPerf("exact nearest point in " + gPrintNumber(Dim) + "D", numRequests, numPoints, millisecondsSince(start));
+
+        for (size_t b = 0; b < budgetsCount; ++b)
+        {
+            std::vector<const float*> found(numRequests);
+            start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < numRequests; ++i)
+                found[i] = kd.bestBinFirstNearestPointInEuclidianMetric(&requests[i * Dim], budgets[b]);
+            double ms = millisecondsSince(start);
+
+            size_t hits = 0;
+            for (size_t i = 0; i < numRequests; ++i)
+            {
+                if (found[i] == exact[i])
+                    hits++;
+            }
+
+            std::string name = "best-bin-first nearest point in " + gPrintNumber(Dim) + "D with " + gPrintNumber(budgets[b]) + " checks";
+            gProxiedRecordPerf(name, numRequests, numPoints, ms);
+            gProxiedRecordProperty(name + " recall", double(hits) / double(numRequests));
+        }
+    }
+}
+
+TEST(Utils, KdTreeBestBinFirstGPerf)
+{
+    const size_t kPoints = 100 * 1000;
+    const size_t kRequests = 1000;
+    const size_t budgets[] = { 64, 256, 1024, 4096 };
+    const size_t budgetsCount = sizeof(budgets) / sizeof(budgets[0]);
+
+    measureBestBinFirstNearestPoint<16>(kPoints, kRequests, budgets, budgetsCount);
+    measureBestBinFirstNearestPoint<32>(kPoints, kRequests, budgets, budgetsCount);
+}
+
+TEST(Utils, KdTreeRadiusSearchGTest)
+{
+    typedef lw_index_datastructs::KdTreeNeighbour<double, double> Neighbour;
+
+    const size_t kPoints = 4000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 25, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> requests = generateUniformPoints<double, 3>(100, 26, 100.0);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+
+    double radiuses[] = { 0.0, 2.5, 10.0, 200.0 };
+    for (size_t r = 0; r < sizeof(radiuses) / sizeof(radiuses[0]); ++r)
+    {
+        double radius = radiuses[r];
+        for (size_t i = 0; i < 100; ++i)
+        {
+            const double* req = &requests[i * 3];
+
+            std::vector<const double*> expected;
+            for (size_t j = 0; j < kPoints; ++j)
+            {
+                if ((distanceSqr<double, double, 3>(ptrs[j], req)) <= radius * radius)
+                    expected.push_back(ptrs[j]);
+            }
+            std::sort(expected.begin(), expected.end());
+
+            std::vector<Neighbour> unsorted;
+            EXPECT_TRUE(kd.rangeSearchWithRadius(unsorted, req, radius) == expected.size());
+            std::vector<const double*> found;
+            for (size_t j = 0; j < unsorted.size(); ++j)
+            {
+                EXPECT_TRUE(unsorted[j].distanceSqr == (distanceSqr<double, double, 3>(unsorted[j].point, req)));
+                found.push_back(unsorted[j].point);
+            }
+            std::sort(found.begin(), found.end());
+            EXPECT_TRUE(found == expected);
+
+            std::vector<Neighbour> sorted;
+            EXPECT_TRUE(kd.rangeSearchWithRadius(sorted, req, radius, true) == expected.size());
+            for (size_t j = 1; j < sorted.size(); ++j)
+                EXPECT_TRUE(sorted[j - 1].distanceSqr <= sorted[j].distanceSqr);
+
+            // cap with sorting returns the closest points from the ball
+            const size_t kCap = 7;
+            std::vector<Neighbour> sortedCapped;
+            size_t expectedCapped = std::min(kCap, expected.size());
+            EXPECT_TRUE(kd.rangeSearchWithRadius(sortedCapped, req, radius, true, kCap) == expectedCapped);
+            for (size_t j = 0; j < sortedCapped.size(); ++j)
+                EXPECT_TRUE(sortedCapped[j].distanceSqr == sorted[j].distanceSqr);
+
+            // cap without sorting returns any points from the ball
+            std::vector<Neighbour> unsortedCapped;
+            EXPECT_TRUE(kd.rangeSearchWithRadius(unsortedCapped, req, radius, false, kCap) == expectedCapped);
+            for (size_t j = 0; j < unsortedCapped.size(); ++j)
+                EXPECT_TRUE(std::binary_search(expected.begin(), expected.end(), unsortedCapped[j].point));
+        }
+    }
+
+    {
+        // points on the sphere and disabled points
+        int points2d[][2] = { { 0, 0 }, { 5, 0 }, { 0, 5 }, { 3, 4 }, { 4, 4 }, { -5, 0 }, { 0, -6 } };
+        lw_index_datastructs::KDtree<int, 2, int> small(points2d, 7);
+        int req[] = { 0, 0 };
+        std::vector<lw_index_datastructs::KdTreeNeighbour<int, int>> res;
+        EXPECT_TRUE(small.rangeSearchWithRadius(res, req, 5, true) == 5);
+        EXPECT_TRUE(res[0].point == points2d[0] && res[0].distanceSqr == 0);
+        for (size_t j = 1; j < res.size(); ++j)
+            EXPECT_TRUE(res[j].distanceSqr == 25);
+
+        small.nearestPointInEuclidianMetric(req, false);
+        res.clear();
+        EXPECT_TRUE(small.rangeSearchWithRadius(res, req, 5) == 4);
+        EXPECT_TRUE(small.rangeSearchWithRadius(res, req, 5, false, 0) == 0);
+        EXPECT_TRUE(res.size() == 4);
+
+        lw_index_datastructs::KDtree<int, 2, int> empty;
+        EXPECT_TRUE(empty.rangeSearchWithRadius(res, req, 5) == 0);
+    }
+}
+
+TEST(Utils, KdTreeRadiusSearchGPerf)
+{
+    const size_t kPoints = 1000 * 1000;
+    const size_t kRequests = 20 * 1000;
+    const double kRadius = 15.0;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 27, 1000.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> requests = generateUniformPoints<double, 3>(kRequests, 28, 1000.0);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+
+    size_t totalWithPredicates = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; ++i)
+    {
+        const double* req = &requests[i * 3];
+        auto areaRelativeToPlane = [req, kRadius](const double* position, size_t coordIndex)
+                                   {
+                                       if (req[coordIndex] + kRadius < position[coordIndex])
+                                           return lw_index_datastructs::KdTreepPlaneIntersectTest::eAreaInLeft;
+                                       else if (req[coordIndex] - kRadius > position[coordIndex])
+                                           return lw_index_datastructs::KdTreepPlaneIntersectTest::eAreaInRight;
+                                       else
+                                           return lw_index_datastructs::KdTreepPlaneIntersectTest::eAreaIntersectsPlane;
+                                   };
+        auto isPointInside = [req, kRadius](const double* p)
+                             {
+                                 return distanceSqr<double, double, 3>(p, req) <= kRadius * kRadius;
+                             };
+        std::vector<const double*> res;
+        kd.rangeSearchWithPredicats(res, areaRelativeToPlane, isPointInside);
+        totalWithPredicates += res.size();
+    }
+    gProxiedRecordPerf("radius search with predicates", kRequests, kPoints, millisecondsSince(start));
+
+    size_t totalWithRadius = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; ++i)
+    {
+        std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> res;
+        totalWithRadius += kd.rangeSearchWithRadius(res, &requests[i * 3], kRadius);
+    }
+    gProxiedRecordPerf("radius search", kRequests, kPoints, millisecondsSince(start));
+
+    size_t totalSorted = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; ++i)
+    {
+        std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> res;
+        totalSorted += kd.rangeSearchWithRadius(res, &requests[i * 3], kRadius, true);
+    }
+    gProxiedRecordPerf("radius search with sorting", kRequests, kPoints, millisecondsSince(start));
+
+    EXPECT_TRUE(totalWithPredicates == totalWithRadius);
+    EXPECT_TRUE(totalWithPredicates == totalSorted);
+    gProxiedRecordProperty("average number of points in the ball", double(totalWithRadius) / double(kRequests));
+}
+
+TEST(Utils, KdTreeKnnGraphGTest)
+{
+    const size_t kPoints = 2000;
+    const size_t K = 6;
+    std::vector<float> points = generateUniformPoints<float, 3>(kPoints, 29, 100.0f);
+    std::vector<const float*> ptrs = pointersToPoints<float, 3>(points);
+    lw_index_datastructs::KDtree<float, 3, float> kd(ptrs, ptrs.size());
+
+    // every third point is disabled
+    for (size_t i = 0; i < kPoints; i += 3)
+        kd.nearestPointInEuclidianMetric(ptrs[i], false);
+    std::vector<const float*> enablePoints;
+    for (size_t i = 0; i < kPoints; ++i)
+    {
+        if (i % 3 != 0)
+            enablePoints.push_back(ptrs[i]);
+    }
+
+    size_t groupSizes[] = { 1, 7, 32, 5000 };
+    for (size_t g = 0; g < sizeof(groupSizes) / sizeof(groupSizes[0]); ++g)
+    {
+        lw_index_datastructs::KdTreeKnnGraph<float, float> graph;
+        kd.buildKnearestNeighboursGraph(K, graph, 2, groupSizes[g]);
+        EXPECT_TRUE(graph.size() == enablePoints.size());
+        EXPECT_TRUE(graph.rowOffsets.size() == graph.size() + 1);
+        EXPECT_TRUE(graph.neighbours.size() == graph.size() * K);
+        EXPECT_TRUE(graph.distancesSqr.size() == graph.neighbours.size());
+
+        std::vector<const float*> vertices = graph.vertices;
+        std::sort(vertices.begin(), vertices.end());
+        EXPECT_TRUE(vertices == enablePoints);
+
+        for (size_t v = 0; v < graph.size(); ++v)
+        {
+            const float* p = graph.vertices[v];
+            std::vector<float> expected;
+            for (size_t i = 0; i < enablePoints.size(); ++i)
+            {
+                if (enablePoints[i] != p)
+                    expected.push_back(distanceSqr<float, float, 3>(enablePoints[i], p));
+            }
+            std::sort(expected.begin(), expected.end());
+
+            EXPECT_TRUE(graph.rowOffsets[v + 1] - graph.rowOffsets[v] == K);
+            for (size_t j = graph.rowOffsets[v], k = 0; j < graph.rowOffsets[v + 1]; ++j, ++k)
+            {
+                size_t neighbour = graph.neighbours[j];
+                EXPECT_TRUE(neighbour != v && neighbour < graph.size());
+                EXPECT_TRUE(graph.distancesSqr[j] == (distanceSqr<float, float, 3>(graph.vertices[neighbour], p)));
+                EXPECT_TRUE(graph.distancesSqr[j] == expected[k]);
+            }
+        }
+    }
+
+    {
+        // less points then K + 1
+        int points2d[][2] = { { 0, 0 }, { 5, 0 }, { 0, 7 } };
+        lw_index_datastructs::KDtree<int, 2, int> small(points2d, 3);
+        lw_index_datastructs::KdTreeKnnGraph<int, int> graph;
+        small.buildKnearestNeighboursGraph(4, graph, 1);
+        EXPECT_TRUE(graph.size() == 3);
+        for (size_t v = 0; v < 3; ++v)
+        {
+            EXPECT_TRUE(graph.rowOffsets[v + 1] - graph.rowOffsets[v] == 2);
+            EXPECT_TRUE(graph.distancesSqr[graph.rowOffsets[v]] <= graph.distancesSqr[graph.rowOffsets[v] + 1]);
+        }
+
+        small.buildKnearestNeighboursGraph(0, graph, 1);
+        EXPECT_TRUE(graph.size() == 3);
+        EXPECT_TRUE(graph.neighbours.empty());
+        EXPECT_TRUE(graph.rowOffsets.size() == 4 && graph.rowOffsets[3] == 0);
+
+        lw_index_datastructs::KDtree<int, 2, int> empty;
+        empty.buildKnearestNeighboursGraph(4, graph, 1);
+        EXPECT_TRUE(graph.size() == 0);
+        EXPECT_TRUE(graph.rowOffsets.size() == 1);
+    }
+}
+
+TEST(Utils, KdTreeKnnGraphGPerf)
+{
+    const size_t kPoints = 500 * 1000;
+    const size_t K = 8;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 30, 1000.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+
+    std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> neighbours((K + 1) * kPoints);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kPoints; ++i)
+        kd.findKnearestPoints(ptrs[i], K + 1, &neighbours[i * (K + 1)]);
+    gProxiedRecordPerf("kNN graph by separate queries", kPoints, kPoints, millisecondsSince(start));
+
+    {
+        lw_index_datastructs::WorkStealingTaskPool pool(1);
+        lw_index_datastructs::KdTreeKnnGraph<double, double> graph;
+        start = std::chrono::steady_clock::now();
+        kd.buildKnearestNeighboursGraph(K, graph, pool);
+        gProxiedRecordPerf("kNN graph by dual-tree traversal in 1 thread", kPoints, kPoints, millisecondsSince(start));
+        EXPECT_TRUE(graph.neighbours.size() == K * kPoints);
+    }
+
+    {
+        lw_index_datastructs::WorkStealingTaskPool pool(0);
+        lw_index_datastructs::KdTreeKnnGraph<double, double> graph;
+        start = std::chrono::steady_clock::now();
+        kd.buildKnearestNeighboursGraph(K, graph, pool);
+        gProxiedRecordPerf("kNN graph by dual-tree traversal in " + gPrintNumber(pool.threadsCount()) + " threads", kPoints, kPoints, millisecondsSince(start));
+        EXPECT_TRUE(graph.neighbours.size() == K * kPoints);
+    }
+}
+
+TEST(Utils, KdTreeJoinGTest)
+{
+    typedef lw_index_datastructs::KDtree<double, 3> Tree;
+
+    std::vector<double> pointsA = generateUniformPoints<double, 3>(1500, 31, 100.0);
+    std::vector<double> pointsB = generateUniformPoints<double, 3>(1000, 32, 100.0);
+    std::vector<const double*> ptrsA = pointersToPoints<double, 3>(pointsA);
+    std::vector<const double*> ptrsB = pointersToPoints<double, 3>(pointsB);
+    Tree a(ptrsA, ptrsA.size());
+    Tree b(ptrsB, ptrsB.size());
+
+    // disable a few points in both trees
+    for (size_t i = 0; i < ptrsA.size(); i += 10)
+        a.nearestPointInEuclidianMetric(ptrsA[i], false);
+    for (size_t i = 0; i < ptrsB.size(); i += 7)
+        b.nearestPointInEuclidianMetric(ptrsB[i], false);
+
+    double radiuses[] = { 0.0, 4.0, 9.5 };
+    for (size_t r = 0; r < sizeof(radiuses) / sizeof(radiuses[0]); ++r)
+    {
+        double radius = radiuses[r];
+        std::vector<std::pair<const double*, const double*>> expected;
+        for (size_t i = 0; i < ptrsA.size(); ++i)
+        {
+            for (size_t j = 0; j < ptrsB.size(); ++j)
+            {
+                if (i % 10 != 0 && j % 7 != 0 && (distanceSqr<double, double, 3>(ptrsA[i], ptrsB[j])) <= radius * radius)
+                    expected.push_back(std::make_pair(ptrsA[i], ptrsB[j]));
+            }
+        }
+
+        std::vector<std::pair<const double*, const double*>> found;
+        a.joinWithinRadius(b, radius, [&](const double* pa, const double* pb, double d)
+                                      {
+                                          EXPECT_TRUE(d == (distanceSqr<double, double, 3>(pa, pb)));
+                                          found.push_back(std::make_pair(pa, pb));
+                                      });
+        std::sort(expected.begin(), expected.end());
+        std::sort(found.begin(), found.end());
+        EXPECT_TRUE(found == expected);
+    }
+
+    {
+        // self join reports every point with itself and every other pair twice
+        size_t pairs = 0;
+        size_t samePoint = 0;
+        b.joinWithinRadius(b, 5.0, [&](const double* pa, const double* pb, double /*d*/)
+                                   {
+                                       pairs++;
+                                       if (pa == pb)
+                                           samePoint++;
+                                   });
+        EXPECT_TRUE(samePoint == b.sizeOfEnablePoints());
+        EXPECT_TRUE((pairs - samePoint) % 2 == 0);
+    }
+
+    {
+        size_t calls = 0;
+        a.joinNearest(b, [&](const double* pa, const double* pb, double d)
+                         {
+                             calls++;
+                             EXPECT_TRUE(pb != nullptr);
+                             EXPECT_TRUE(d == (distanceSqr<double, double, 3>(pa, pb)));
+                             EXPECT_TRUE(d == (distanceSqr<double, double, 3>(b.nearestPointInEuclidianMetric(pa), pa)));
+                         });
+        EXPECT_TRUE(calls == a.sizeOfEnablePoints());
+
+        Tree empty;
+        calls = 0;
+        a.joinNearest(empty, [&](const double* /*pa*/, const double* pb, double d)
+                             {
+                                 calls++;
+                                 EXPECT_TRUE(pb == nullptr);
+                                 EXPECT_TRUE(d == std::numeric_limits<double>::max());
+                             });
+        EXPECT_TRUE(calls == a.sizeOfEnablePoints());
+
+        calls = 0;
+        empty.joinNearest(a, [&](const double*, const double*, double) { calls++; });
+        empty.joinWithinRadius(a, 10.0, [&](const double*, const double*, double) { calls++; });
+        a.joinWithinRadius(empty, 10.0, [&](const double*, const double*, double) { calls++; });
+        EXPECT_TRUE(calls == 0);
+    }
+}
+
+TEST(Utils, KdTreeJoinGPerf)
+{
+    const size_t kPoints = 500 * 1000;
+    const double kRadius = 8.0;
+    std::vector<double> pointsA = generateUniformPoints<double, 3>(kPoints, 33, 1000.0);
+    std::vector<double> pointsB = generateUniformPoints<double, 3>(kPoints, 34, 1000.0);
+    std::vector<const double*> ptrsA = pointersToPoints<double, 3>(pointsA);
+    std::vector<const double*> ptrsB = pointersToPoints<double, 3>(pointsB);
+    lw_index_datastructs::KDtree<double, 3> a(ptrsA, ptrsA.size());
+    lw_index_datastructs::KDtree<double, 3> b(ptrsB, ptrsB.size());
+
+    double sumByQueries = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kPoints; ++i)
+        sumByQueries += distanceSqr<double, double, 3>(b.nearestPointInEuclidianMetric(ptrsA[i]), ptrsA[i]);
+    gProxiedRecordPerf("nearest point join by separate queries", kPoints, kPoints, millisecondsSince(start));
+
+    double sumByJoin = 0.0;
+    start = std::chrono::steady_clock::now();
+    a.joinNearest(b, [&](const double*, const double*, double d) { sumByJoin += d; });
+    gProxiedRecordPerf("nearest point join by dual-tree traversal", kPoints, kPoints, millisecondsSince(start));
+    EXPECT_TRUE(fabs(sumByQueries - sumByJoin) <= 1e-9 * sumByQueries);
+
+    size_t pairsByQueries = 0;
+    start = std::chrono::steady_clock::now();
+    std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> res;
+    for (size_t i = 0; i < kPoints; ++i)
+    {
+        res.clear();
+        pairsByQueries += b.rangeSearchWithRadius(res, ptrsA[i], kRadius);
+    }
+    gProxiedRecordPerf("radius join by separate queries", kPoints, kPoints, millisecondsSince(start));
+
+    size_t pairsByJoin = 0;
+    start = std::chrono::steady_clock::now();
+    a.joinWithinRadius(b, kRadius, [&](const double*, const double*, double) { pairsByJoin++; });
+    gProxiedRecordPerf("radius join by dual-tree traversal", kPoints, kPoints, millisecondsSince(start));
+    EXPECT_TRUE(pairsByQueries == pairsByJoin);
+    gProxiedRecordProperty("number of pairs in radius join", pairsByJoin);
+}
+
+TEST(Utils, KdTreeIncrementalNearestGTest)
+{
+    const size_t kPoints = 1500;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 35, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> requests = generateUniformPoints<double, 3>(20, 36, 100.0);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+
+    // every fifth point is disabled
+    for (size_t i = 0; i < kPoints; i += 5)
+        kd.nearestPointInEuclidianMetric(ptrs[i], false);
+    size_t disabled = kd.sizeOfDisabledPoints();
+
+    for (size_t r = 0; r < 20; ++r)
+    {
+        const double* req = &requests[r * 3];
+        std::vector<double> expected;
+        for (size_t i = 0; i < kPoints; ++i)
+        {
+            if (i % 5 != 0)
+                expected.push_back(distanceSqr<double, double, 3>(ptrs[i], req));
+        }
+        std::sort(expected.begin(), expected.end());
+
+        lw_index_datastructs::KDtree<double, 3>::IncrementalNearestSearch search = kd.incrementalNearestSearch(req);
+        lw_index_datastructs::KdTreeNeighbour<double, double> neighbour;
+        std::vector<const double*> produced;
+        for (size_t k = 0; k < expected.size(); ++k)
+        {
+            EXPECT_TRUE(search.next(neighbour));
+            EXPECT_TRUE(neighbour.distanceSqr == expected[k]);
+            EXPECT_TRUE(neighbour.distanceSqr == (distanceSqr<double, double, 3>(neighbour.point, req)));
+            produced.push_back(neighbour.point);
+        }
+        EXPECT_FALSE(search.next(neighbour));
+
+        std::sort(produced.begin(), produced.end());
+        EXPECT_TRUE(std::unique(produced.begin(), produced.end()) == produced.end());
+
+        // first point agrees with nearest search
+        lw_index_datastructs::KDtree<double, 3>::IncrementalNearestSearch first = kd.incrementalNearestSearch(req);
+        EXPECT_TRUE(first.next(neighbour));
+        EXPECT_TRUE(neighbour.point == kd.nearestPointInEuclidianMetric(req));
+    }
+    EXPECT_TRUE(kd.sizeOfDisabledPoints() == disabled);
+
+    {
+        lw_index_datastructs::KDtree<int, 2, int> empty;
+        int req[] = { 1, 1 };
+        lw_index_datastructs::KdTreeNeighbour<int, int> neighbour;
+        lw_index_datastructs::KDtree<int, 2, int>::IncrementalNearestSearch search = empty.incrementalNearestSearch(req);
+        EXPECT_FALSE(search.next(neighbour));
+    }
+}
+
+TEST(Utils, KdTreeIncrementalNearestGPerf)
+{
+    const size_t kPoints = 1000 * 1000;
+    const size_t kRequests = 20 * 1000;
+    const size_t kAcceptEach = 100;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 37, 1000.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> requests = generateUniformPoints<double, 3>(kRequests, 38, 1000.0);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+
+    // application filter accepts approximately one of kAcceptEach points
+    const double* base = points.data();
+    auto isAccepted = [base, kAcceptEach](const double* p) { return (size_t(p - base) / 3) % kAcceptEach == 0; };
+
+    std::vector<const double*> byKnearest(kRequests);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> neighbours;
+    for (size_t i = 0; i < kRequests; ++i)
+    {
+        byKnearest[i] = nullptr;
+        for (size_t K = 16; !byKnearest[i]; K *= 2)
+        {
+            neighbours.resize(K);
+            size_t found = kd.findKnearestPoints(&requests[i * 3], K, neighbours.data());
+            for (size_t j = 0; j < found && !byKnearest[i]; ++j)
+            {
+                if (isAccepted(neighbours[j].point))
+                    byKnearest[i] = neighbours[j].point;
+            }
+        }
+    }
+    gProxiedRecordPerf("filtered nearest point by K nearest search with doubling K", kRequests, kPoints, millisecondsSince(start));
+
+    std::vector<const double*> byIncremental(kRequests);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; ++i)
+    {
+        lw_index_datastructs::KDtree<double, 3>::IncrementalNearestSearch search = kd.incrementalNearestSearch(&requests[i * 3]);
+        lw_index_datastructs::KdTreeNeighbour<double, double> neighbour;
+        byIncremental[i] = nullptr;
+        while (!byIncremental[i] && search.next(neighbour))
+        {
+            if (isAccepted(neighbour.point))
+                byIncremental[i] = neighbour.point;
+        }
+    }
+    gProxiedRecordPerf("filtered nearest point by incremental search", kRequests, kPoints, millisecondsSince(start));
+
+    for (size_t i = 0; i < kRequests; ++i)
+    {
+        EXPECT_TRUE(byIncremental[i] != nullptr);
+        EXPECT_TRUE((distanceSqr<double, double, 3>(byIncremental[i], &requests[i * 3])) == (distanceSqr<double, double, 3>(byKnearest[i], &requests[i * 3])));
+    }
+}
+
+TEST(Utils, KdTreeNearestWithBoundGTest)
+{
+    const size_t kPoints = 3000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 39, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> requests = generateUniformPoints<double, 3>(300, 40, 100.0);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+
+    double bounds[] = { 0.0, 1.0, 4.0, 16.0, 1e6 };
+    for (size_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]); ++b)
+    {
+        for (size_t i = 0; i < 300; ++i)
+        {
+            const double* req = &requests[i * 3];
+            const double* nearest = kd.nearestPointInEuclidianMetric(req);
+            double nearestDistance = distanceSqr<double, double, 3>(nearest, req);
+            const double* res = kd.nearestPointInEuclidianMetricWithBound(req, bounds[b]);
+            if (nearestDistance < bounds[b])
+                EXPECT_TRUE(res == nearest);
+            else
+                EXPECT_TRUE(res == nullptr);
+        }
+    }
+
+    {
+        // bound is strict and found point can be disabled
+        int points2d[][2] = { { 0, 0 }, { 3, 4 }, { 10, 10 } };
+        lw_index_datastructs::KDtree<int, 2, int> small(points2d, 3);
+        int req[] = { 0, 0 };
+        EXPECT_TRUE(small.nearestPointInEuclidianMetricWithBound(req, 0) == nullptr);
+        EXPECT_TRUE(small.nearestPointInEuclidianMetricWithBound(req, 1, false) == points2d[0]);
+        EXPECT_TRUE(small.sizeOfDisabledPoints() == 1);
+        EXPECT_TRUE(small.nearestPointInEuclidianMetricWithBound(req, 25) == nullptr);
+        EXPECT_TRUE(small.nearestPointInEuclidianMetricWithBound(req, 26) == points2d[1]);
+
+        lw_index_datastructs::KDtree<int, 2, int> empty;
+        EXPECT_TRUE(empty.nearestPointInEuclidianMetricWithBound(req, 100) == nullptr);
+    }
+}
+
+TEST(Utils, KdTreeNearestWithBoundGPerf)
+{
+    const size_t kPoints = 1000 * 1000;
+    const size_t kRequests = 100 * 1000;
+    const double kThresholdSqr = 4.0;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 41, 1000.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    std::vector<double> requests = generateUniformPoints<double, 3>(kRequests, 42, 1000.0);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+
+    size_t acceptedWithoutBound = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; ++i)
+    {
+        const double* req = &requests[i * 3];
+        if ((distanceSqr<double, double, 3>(kd.nearestPointInEuclidianMetric(req), req)) < kThresholdSqr)
+            acceptedWithoutBound++;
+    }
+    gProxiedRecordPerf("nearest point with check of threshold after search", kRequests, kPoints, millisecondsSince(start));
+
+    size_t acceptedWithBound = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; ++i)
+    {
+        if (kd.nearestPointInEuclidianMetricWithBound(&requests[i * 3], kThresholdSqr))
+            acceptedWithBound++;
+    }
+    gProxiedRecordPerf("nearest point with threshold as initial bound", kRequests, kPoints, millisecondsSince(start));
+
+    EXPECT_TRUE(acceptedWithBound == acceptedWithoutBound);
+    gProxiedRecordProperty("fraction of accepted requests", double(acceptedWithBound) / double(kRequests));
+}
+
+TEST(Utils, KdTreeNearestWithHintGTest)
+{
+    typedef lw_index_datastructs::KDtree<double, 3> Tree;
+
+    const size_t kPoints = 5000;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 43, 100.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+
+    Tree balanced(ptrs, ptrs.size());
+    Tree incremental;
+    for (size_t i = 0; i < kPoints; ++i)
+        incremental.pushInTree(ptrs[i]);
+    Tree* trees[] = { &balanced, &incremental };
+
+    for (size_t t = 0; t < 2; ++t)
+    {
+        Tree& kd = *trees[t];
+
+        // trajectory with small steps and several jumps
+        std::mt19937 gen(44);
+        std::uniform_real_distribution<double> step(-1.0, 1.0);
+        std::uniform_real_distribution<double> jump(0.0, 100.0);
+        double position[3] = { 50.0, 50.0, 50.0 };
+        Tree::NearestSearchHint hint;
+        EXPECT_TRUE(hint.empty());
+
+        for (size_t i = 0; i < 2000; ++i)
+        {
+            for (size_t c = 0; c < 3; ++c)
+                position[c] = (i % 100 == 0) ? jump(gen) : position[c] + step(gen);
+
+            const double* res = kd.nearestPointInEuclidianMetricWithHint(position, hint);
+            EXPECT_TRUE(res != nullptr);
+            EXPECT_FALSE(hint.empty());
+            EXPECT_TRUE((distanceSqr<double, double, 3>(res, position)) == (bruteForceNearestDistanceSqr<double, double, 3>(ptrs, position)));
+        }
+
+        // disabled hint falls back to search from the root
+        const double* prev = kd.nearestPointInEuclidianMetricWithHint(position, hint);
+        kd.nearestPointInEuclidianMetric(position, false);
+        const double* res = kd.nearestPointInEuclidianMetricWithHint(position, hint);
+        EXPECT_TRUE(res != nullptr && res != prev);
+        EXPECT_TRUE(res == kd.nearestPointInEuclidianMetric(position));
+        kd.makeAllPointsEnable();
+        hint.reset();
+        EXPECT_TRUE(hint.empty());
+    }
+
+    {
+        Tree empty;
+        Tree::NearestSearchHint hint;
+        double req[] = { 1.0, 1.0, 1.0 };
+        EXPECT_TRUE(empty.nearestPointInEuclidianMetricWithHint(req, hint) == nullptr);
+        EXPECT_TRUE(hint.empty());
+    }
+}
+
+TEST(Utils, KdTreeNearestWithHintGPerf)
+{
+    const size_t kPoints = 1000 * 1000;
+    const size_t kTracks = 1000;
+    const size_t kFrames = 100;
+    std::vector<double> points = generateUniformPoints<double, 3>(kPoints, 45, 1000.0);
+    std::vector<const double*> ptrs = pointersToPoints<double, 3>(points);
+    lw_index_datastructs::KDtree<double, 3> kd(ptrs, ptrs.size());
+
+    // positions of tracks in consecutive frames, each step is smaller then average distance between points
+    std::vector<double> positions = generateUniformPoints<double, 3>(kTracks, 46, 1000.0);
+    std::vector<double> frames(kTracks * kFrames * 3);
+    std::mt19937 gen(47);
+    std::uniform_real_distribution<double> step(-1.0, 1.0);
+    for (size_t f = 0; f < kFrames; ++f)
+    {
+        for (size_t i = 0; i < kTracks * 3; ++i)
+        {
+            positions[i] += step(gen);
+            frames[f * kTracks * 3 + i] = positions[i];
+        }
+    }
+
+    std::vector<const double*> withoutHint(kTracks * kFrames);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t f = 0; f < kFrames; ++f)
+    {
+        for (size_t i = 0; i < kTracks; ++i)
+            withoutHint[f * kTracks + i] = kd.nearestPointInEuclidianMetric(&frames[(f * kTracks + i) * 3]);
+    }
+    gProxiedRecordPerf("nearest point for tracks without hint", kTracks * kFrames, kPoints, millisecondsSince(start));
+
+    std::vector<lw_index_datastructs::KDtree<double, 3>::NearestSearchHint> hints(kTracks);
+    std::vector<const double*> withHint(kTracks * kFrames);
+    start = std::chrono::steady_clock::now();
+    for (size_t f = 0; f < kFrames; ++f)
+    {
+        for (size_t i = 0; i < kTracks; ++i)
+            withHint[f * kTracks + i] = kd.nearestPointInEuclidianMetricWithHint(&frames[(f * kTracks + i) * 3], hints[i]);
+    }
+    gProxiedRecordPerf("nearest point for tracks with hint", kTracks * kFrames, kPoints, millisecondsSince(start));
+
+    for (size_t i = 0; i < withHint.size(); ++i)
+    {
+        const double* req = &frames[i * 3];
+        EXPECT_TRUE((distanceSqr<double, double, 3>(withHint[i], req)) == (distanceSqr<double, double, 3>(withoutHint[i], req)));
+    }
+}
+
+namespace
+{
+    /** Compare nearest and K nearest points of the tree with brute force for all requests
+    */
+    template <class TCoord, size_t Dimension, class TNorm>
+    void checkNearestAndKnearestWithBruteForce(const std::vector<TCoord>& points, const std::vector<TCoord>& requests, size_t K)
+    {
+        std::vector<const TCoord*> ptrs = pointersToPoints<TCoord, Dimension>(points);
+        lw_index_datastructs::KDtree<TCoord, Dimension, TNorm> kd(ptrs, ptrs.size());
+
+        std::vector<lw_index_datastructs::KdTreeNeighbour<TCoord, TNorm>> neighbours(K);
+        for (size_t r = 0; r < requests.size() / Dimension; ++r)
+        {
+            const TCoord* req = &requests[r * Dimension];
+            std::vector<TNorm> expected(ptrs.size());
+            for (size_t i = 0; i < ptrs.size(); ++i)
+                expected[i] = distanceSqr<TNorm, TCoord, Dimension>(ptrs[i], req);
+            std::sort(expected.begin(), expected.end());
+
+            EXPECT_TRUE((distanceSqr<TNorm, TCoord, Dimension>(kd.nearestPointInEuclidianMetric(req), req)) == expected[0]);
+            EXPECT_TRUE(kd.findKnearestPoints(req, K, neighbours.data()) == K);
+            for (size_t k = 0; k < K; ++k)
+                EXPECT_TRUE(neighbours[k].distanceSqr == expected[k]);
+        }
+    }
+}
+
+TEST(Utils, KdTreeCellDistanceGTest)
+{
+    // points on the grid: a lot of points lie exactly on the sides of the cells
+    {
+        std::vector<double> points = generateUniformPoints<double, 3>(3000, 43, 10.0);
+        std::vector<double> requests = generateUniformPoints<double, 3>(100, 44, 10.0);
+        for (size_t i = 0; i < points.size(); ++i)
+            points[i] = floor(points[i]);
+        for (size_t i = 0; i < requests.size(); i += 2)
+            requests[i] = floor(requests[i]);
+        checkNearestAndKnearestWithBruteForce<double, 3, double>(points, requests, 10);
+    }
+
+    // cells are bounded by several axes, requests are outside of the bounding box of points
+    {
+        std::vector<float> points = generateUniformPoints<float, 8>(5000, 45, 1.0f);
+        std::vector<float> requests = generateUniformPoints<float, 8>(100, 46, 2.0f);
+        checkNearestAndKnearestWithBruteForce<float, 8, float>(points, requests, 5);
+    }
+
+    // exact distances in integers
+    {
+        std::vector<int> points = generateUniformPoints<int, 2>(3000, 47, 1000);
+        std::vector<int> requests = generateUniformPoints<int, 2>(100, 48, 1000);
+        checkNearestAndKnearestWithBruteForce<int, 2, int64_t>(points, requests, 7);
+    }
+
+    // radius search visits subtrees by the same bounds
+    {
+        std::vector<double> points = generateUniformPoints<double, 4>(3000, 49, 100.0);
+        std::vector<double> requests = generateUniformPoints<double, 4>(100, 50, 100.0);
+        std::vector<const double*> ptrs = pointersToPoints<double, 4>(points);
+        lw_index_datastructs::KDtree<double, 4> kd(ptrs, ptrs.size());
+        for (size_t r = 0; r < 100; ++r)
+        {
+            const double* req = &requests[r * 4];
+            size_t expected = 0;
+            for (size_t i = 0; i < ptrs.size(); ++i)
+            {
+                if ((distanceSqr<double, double, 4>(ptrs[i], req)) <= 20.0 * 20.0)
+                    expected++;
+            }
+            std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> inBall;
+            EXPECT_TRUE(kd.rangeSearchWithRadius(inBall, req, 20.0, true) == expected);
+        }
+    }
+}
+
+namespace
+{
+    /** Euclidean metric with pruning only by distance to the split plane of the parent. Used as baseline for distance to the cell.
+    */
+    template <class TCoord, size_t Dimension>
+    struct SplitPlaneBoundL2Metric : public lw_index_datastructs::KdTreeL2Metric<TCoord, Dimension>
+    {
+        TCoord replaceAxisDistance(TCoord /*sum*/, TCoord /*oldAxisTerm*/, TCoord newAxisTerm) const {
+            return newAxisTerm;
+        }
+    };
+
+    template <size_t Dimension, class Metric>
+    void measureNearestWithMetric(const std::string& name, const std::vector<const double*>& ptrs, const std::vector<double>& requests)
+    {
+        lw_index_datastructs::KDtree<double, Dimension, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeArenaNodeAllocator, Metric> kd(ptrs, ptrs.size());
+        size_t numRequests = requests.size() / Dimension;
+
+        double checksum = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numRequests; ++i)
+            checksum += kd.nearestPointInEuclidianMetric(&requests[i * Dimension])[0];
+        gProxiedRecordPerf("nearest point in " + gPrintNumber(Dimension) + "D " + name, numRequests, ptrs.size(), millisecondsSince(start));
+
+        std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> neighbours(10);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numRequests; ++i)
+            checksum += double(kd.findKnearestPoints(&requests[i * Dimension], neighbours.size(), neighbours.data()));
+        gProxiedRecordPerf("10 nearest points in " + gPrintNumber(Dimension) + "D " + name, numRequests, ptrs.size(), millisecondsSince(start));
+        EXPECT_TRUE(checksum > 0.0);
+    }
+
+    template <size_t Dimension>
+    void measureCellDistance(size_t numPoints, size_t numRequests)
+    {
+        std::vector<double> points = generateUniformPoints<double, Dimension>(numPoints, 51, 1000.0);
+        std::vector<const double*> ptrs = pointersToPoints<double, Dimension>(points);
+        std::vector<double> requests = generateUniformPoints<double, Dimension>(numRequests, 52, 1000.0);
+
+        measureNearestWithMetric<Dimension, SplitPlaneBoundL2Metric<double, Dimension> >("with distance to split plane", ptrs, requests);
+        measureNearestWithMetric<Dimension, lw_index_datastructs::KdTreeL2Metric<double, Dimension> >("with distance to cell", ptrs, requests);
+    }
+}
+
+TEST(Utils, KdTreeCellDistanceGPerf)
+{
+    measureCellDistance<3>(1000 * 1000, 100 * 1000);
+    measureCellDistance<8>(200 * 1000, 5 * 1000);
+}
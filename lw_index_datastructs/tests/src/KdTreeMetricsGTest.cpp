@@ -0,0 +1,561 @@
+#include "lw_index_datastructs/headers_public/KdTreeMetrics.h"
+#include "lw_index_datastructs/headers_public/KdTree.h"
+#include "GTestMacroses.h"
+
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+namespace
+{
+    std::vector<double> generatePoints(size_t num, unsigned int seed)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<double> dist(0.0, 100.0);
+        std::vector<double> points(num * 3);
+        for (size_t i = 0; i < points.size(); ++i)
+            points[i] = dist(gen);
+        return points;
+    }
+
+    /** Compare nearest, K nearest and radius searches of the tree with metric with brute force
+    */
+    template <class Metric>
+    void checkSearchesWithMetric(const Metric& metric)
+    {
+        typedef lw_index_datastructs::KDtree<double, 3, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeArenaNodeAllocator, Metric> Tree;
+
+        const size_t kPoints = 2000;
+        const size_t K = 5;
+        std::vector<double> points = generatePoints(kPoints, 51);
+        std::vector<double> requests = generatePoints(100, 52);
+        std::vector<const double*> ptrs(kPoints);
+        for (size_t i = 0; i < kPoints; ++i)
+            ptrs[i] = &points[i * 3];
+
+        Tree kd(ptrs, ptrs.size());
+        kd.setDistanceMetric(metric);
+
+        std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> neighbours(K);
+        for (size_t r = 0; r < 100; ++r)
+        {
+            const double* req = &requests[r * 3];
+            std::vector<double> expected(kPoints);
+            for (size_t i = 0; i < kPoints; ++i)
+                expected[i] = metric.distance(ptrs[i], req);
+            std::sort(expected.begin(), expected.end());
+
+            EXPECT_TRUE(metric.distance(kd.nearestPointInEuclidianMetric(req), req) == expected[0]);
+
+            EXPECT_TRUE(kd.findKnearestPoints(req, K, neighbours.data()) == K);
+            for (size_t k = 0; k < K; ++k)
+                EXPECT_TRUE(neighbours[k].distanceSqr == expected[k]);
+
+            // radius which separates 20-th and 21-th neighbours
+            double reducedRadius = (expected[19] + expected[20]) / 2.0;
+            double radius = 0.0;
+            for (double step = 1000.0; step > 1e-9; step /= 2.0)
+            {
+                if (metric.fromDistance(radius + step) <= reducedRadius)
+                    radius += step;
+            }
+            std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> inBall;
+            EXPECT_TRUE(kd.rangeSearchWithRadius(inBall, req, radius, true) == 20);
+
+            const double* approximate = kd.approximateNearestPointInEuclidianMetric(req, 0.5);
+            EXPECT_TRUE(metric.distance(approximate, req) <= expected[0] * metric.fromDistance(1.5) * (1.0 + 1e-12));
+        }
+
+        // graph and joins use box distances of the metric
+        lw_index_datastructs::KdTreeKnnGraph<double, double> graph;
+        kd.buildKnearestNeighboursGraph(K, graph, 1);
+        for (size_t v = 0; v < graph.size(); v += 97)
+        {
+            std::vector<double> expected;
+            for (size_t i = 0; i < kPoints; ++i)
+            {
+                if (ptrs[i] != graph.vertices[v])
+                    expected.push_back(metric.distance(ptrs[i], graph.vertices[v]));
+            }
+            std::sort(expected.begin(), expected.end());
+            for (size_t k = 0; k < K; ++k)
+                EXPECT_TRUE(graph.distancesSqr[graph.rowOffsets[v] + k] == expected[k]);
+        }
+    }
+}
+
+namespace
+{
+    /** Points in which scale of coordinates grows with index of the axis
+    */
+    template <class T>
+    std::vector<T> generateAnisotropicPoints(size_t num, size_t dimension, unsigned int seed)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        std::vector<T> points(num * dimension);
+        for (size_t i = 0; i < points.size(); ++i)
+            points[i] = T(dist(gen) * double(1 + i % dimension));
+        return points;
+    }
+
+    /** Check that boundedDistance() of the metric gives the same value as distance() below the bound and a value not less then the bound otherwise
+    */
+    template <class Metric, class TCoord, class TNorm>
+    void checkBoundedDistance(const Metric& metric, const std::vector<TCoord>& points, size_t dimension)
+    {
+        size_t num = points.size() / dimension;
+        for (size_t i = 0; i + 1 < num; ++i)
+        {
+            const TCoord* a = &points[i * dimension];
+            const TCoord* b = &points[(i + 1) * dimension];
+            TNorm d = metric.distance(a, b);
+            TNorm bounds[] = { TNorm(), d / TNorm(2), d, d + TNorm(1), std::numeric_limits<TNorm>::max() };
+            for (size_t j = 0; j < sizeof(bounds) / sizeof(bounds[0]); ++j)
+            {
+                TNorm bounded = lw_index_datastructs::kdTreeBoundedDistance(metric, a, b, bounds[j]);
+                if (d < bounds[j])
+                    EXPECT_TRUE(bounded == d);
+                else
+                    EXPECT_TRUE(bounded >= bounds[j]);
+            }
+        }
+    }
+
+    /** Compare nearest and K nearest searches of the tree in high dimension, where evaluation of distances is abandoned early, with brute force
+    */
+    template <class Metric>
+    void checkNearestPointInHighDimension(const Metric& metric, const std::vector<double>& points, const std::vector<double>& requests)
+    {
+        const size_t kDim = 24;
+        const size_t K = 4;
+        typedef lw_index_datastructs::KDtree<double, kDim, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeArenaNodeAllocator, Metric> Tree;
+
+        size_t num = points.size() / kDim;
+        std::vector<const double*> ptrs(num);
+        for (size_t i = 0; i < num; ++i)
+            ptrs[i] = &points[i * kDim];
+        Tree kd(ptrs, ptrs.size());
+        kd.setDistanceMetric(metric);
+
+        std::vector<lw_index_datastructs::KdTreeNeighbour<double, double>> neighbours(K);
+        for (size_t r = 0; r < requests.size() / kDim; ++r)
+        {
+            const double* req = &requests[r * kDim];
+            std::vector<double> expected(num);
+            for (size_t i = 0; i < num; ++i)
+                expected[i] = metric.distance(req, ptrs[i]);
+            std::sort(expected.begin(), expected.end());
+
+            EXPECT_TRUE(metric.distance(req, kd.nearestPointInEuclidianMetric(req)) == expected[0]);
+            EXPECT_TRUE(kd.findKnearestPoints(req, K, neighbours.data()) == K);
+            for (size_t k = 0; k < K; ++k)
+                EXPECT_TRUE(neighbours[k].distanceSqr == expected[k]);
+        }
+    }
+}
+
+namespace
+{
+    /** Check that nearest point in the tree with integer coordinates is the same as found by brute force with 64-bit arithmetic
+    */
+    template <class TInt, size_t Dimension>
+    void checkNearestPointWithIntegerCoordinates(double minValue, double maxValue)
+    {
+        const size_t kPoints = 3000;
+        std::mt19937 gen(55);
+        std::uniform_real_distribution<double> dist(minValue, maxValue);
+        std::vector<TInt> points(kPoints * Dimension);
+        std::vector<TInt> requests(50 * Dimension);
+        for (size_t i = 0; i < points.size(); ++i)
+            points[i] = TInt(dist(gen));
+        for (size_t i = 0; i < requests.size(); ++i)
+            requests[i] = TInt(dist(gen));
+        std::vector<const TInt*> ptrs(kPoints);
+        for (size_t i = 0; i < kPoints; ++i)
+            ptrs[i] = &points[i * Dimension];
+
+        lw_index_datastructs::KDtree<TInt, Dimension, double> kd(ptrs, ptrs.size());
+        for (size_t r = 0; r < 50; ++r)
+        {
+            const TInt* req = &requests[r * Dimension];
+            uint64_t best = std::numeric_limits<uint64_t>::max();
+            for (size_t i = 0; i < kPoints; ++i)
+            {
+                uint64_t d = lw_index_datastructs::integerDistanceSqr<Dimension, TInt>(ptrs[i], req);
+                if (d < best)
+                    best = d;
+            }
+            EXPECT_TRUE((lw_index_datastructs::integerDistanceSqr<Dimension, TInt>(kd.nearestPointInEuclidianMetric(req), req)) == best);
+        }
+    }
+}
+
+namespace
+{
+    /** Check nearest point for 32-bit coordinates when distances to all points are bigger then 2^64
+    */
+    void checkNearestPointForFarRequests()
+    {
+        const size_t kPoints = 3000;
+        std::mt19937 gen(57);
+        std::uniform_real_distribution<double> pointsDist(1500000000.0, 2147483647.0);
+        std::uniform_real_distribution<double> requestsDist(-2147483648.0, -1500000000.0);
+        std::vector<int32_t> points(kPoints * 3);
+        std::vector<int32_t> requests(50 * 3);
+        for (size_t i = 0; i < points.size(); ++i)
+            points[i] = int32_t(pointsDist(gen));
+        for (size_t i = 0; i < requests.size(); ++i)
+            requests[i] = int32_t(requestsDist(gen));
+        std::vector<const int32_t*> ptrs(kPoints);
+        for (size_t i = 0; i < kPoints; ++i)
+            ptrs[i] = &points[i * 3];
+
+        lw_index_datastructs::KDtree<int32_t, 3, double> kd(ptrs, ptrs.size());
+        for (size_t r = 0; r < 50; ++r)
+        {
+            const int32_t* req = &requests[r * 3];
+            double best = std::numeric_limits<double>::max();
+            for (size_t i = 0; i < kPoints; ++i)
+            {
+                uint64_t high = 0;
+                uint64_t low = lw_index_datastructs::integerDistanceSqrTwoWords<3>(ptrs[i], req, high);
+                EXPECT_TRUE(high != 0);
+                best = std::min(best, lw_index_datastructs::integerDistanceToNorm<double>(low, high));
+            }
+
+            uint64_t high = 0;
+            uint64_t low = lw_index_datastructs::integerDistanceSqrTwoWords<3>(kd.nearestPointInEuclidianMetric(req), req, high);
+            EXPECT_TRUE(lw_index_datastructs::integerDistanceToNorm<double>(low, high) == best);
+        }
+    }
+}
+
+TEST(Utils, KdTreeMetricsGTest)
+{
+    // integer coordinates are accumulated in 64-bit integers
+    {
+        const int kMin = std::numeric_limits<int>::min();
+        const int kMax = std::numeric_limits<int>::max();
+        int a[] = { kMin, 0, kMax };
+        int b[] = { kMax, 0, 0 };
+        lw_index_datastructs::KdTreeL2Metric<int, 2, double> l2;
+        EXPECT_TRUE(l2.distance(a, b) == double(uint64_t(0xFFFFFFFFull) * uint64_t(0xFFFFFFFFull)));
+        EXPECT_TRUE((lw_index_datastructs::integerDistanceSqr<3, int>(a, b)) == std::numeric_limits<uint64_t>::max());
+        EXPECT_TRUE((lw_index_datastructs::integerDistanceSqr<2, int>(a + 1, b + 1)) == uint64_t(kMax) * uint64_t(kMax));
+
+        int16_t c[16] = {};
+        int16_t d[16] = {};
+        for (size_t i = 0; i < 16; ++i)
+        {
+            c[i] = std::numeric_limits<int16_t>::min();
+            d[i] = i % 2 == 0 ? std::numeric_limits<int16_t>::max() : int16_t(i);
+        }
+        uint64_t expected = 0;
+        for (size_t i = 0; i < 16; ++i)
+            expected += uint64_t(int64_t(d[i]) - int64_t(c[i])) * uint64_t(int64_t(d[i]) - int64_t(c[i]));
+        EXPECT_TRUE((lw_index_datastructs::KdTreeL2Metric<int16_t, 16, double>().distance(c, d)) == double(expected));
+        EXPECT_TRUE((lw_index_datastructs::integerDistanceSqr<16>(c, d)) == expected);
+        EXPECT_TRUE((lw_index_datastructs::integerDistanceSqr<5, int16_t>(c, d)) == (lw_index_datastructs::integerDistanceSqr<5>(c, d)));
+
+        // distances above 2^64 are kept in the second word
+        uint64_t high = 0;
+        uint64_t low = lw_index_datastructs::integerDistanceSqrTwoWords<3>(a, b, high);
+        EXPECT_TRUE(high == 1);
+        EXPECT_TRUE(low == (uint64_t(1) << 62) - 3 * (uint64_t(1) << 32) + 2);
+        EXPECT_TRUE((lw_index_datastructs::KdTreeL2Metric<int, 3, double>().distance(a, b)) == 18446744073709551616.0 + double(low));
+
+        // integer norms get exact distances which fit into them and are saturated otherwise
+        EXPECT_TRUE((lw_index_datastructs::KdTreeL2Metric<int, 3, int64_t>().distance(a, b)) == std::numeric_limits<int64_t>::max());
+        EXPECT_TRUE((lw_index_datastructs::KdTreeL2Metric<int, 2, int64_t>().distance(a + 1, b + 1)) == int64_t(kMax) * int64_t(kMax));
+        EXPECT_TRUE((lw_index_datastructs::integerDistanceToNorm<int64_t>(uint64_t(1) << 63, 0)) == std::numeric_limits<int64_t>::max());
+        EXPECT_TRUE((lw_index_datastructs::integerDistanceToNorm<uint64_t>(5, 1)) == std::numeric_limits<uint64_t>::max());
+
+        // norms narrower then 64 bits accumulate distance in the norm itself
+        EXPECT_TRUE((lw_index_datastructs::KdTreeHasWideIntegerDistance<int, double>::value));
+        EXPECT_TRUE((lw_index_datastructs::KdTreeHasWideIntegerDistance<int, int64_t>::value));
+        EXPECT_TRUE((lw_index_datastructs::KdTreeHasWideIntegerDistance<int16_t, float>::value));
+        EXPECT_TRUE(!(lw_index_datastructs::KdTreeHasWideIntegerDistance<int, int>::value));
+        EXPECT_TRUE(!(lw_index_datastructs::KdTreeHasWideIntegerDistance<int16_t, int16_t>::value));
+        EXPECT_TRUE(!(lw_index_datastructs::KdTreeHasWideIntegerDistance<double, double>::value));
+        int smallA[] = { 3, -4 };
+        int smallB[] = { 0, 0 };
+        EXPECT_TRUE((lw_index_datastructs::KdTreeL2Metric<int, 2>().distance(smallA, smallB)) == 25);
+
+        // vectorized metric converts integer distances into the norm as KdTreeL2Metric
+        int32_t e[16] = {};
+        int32_t f[16] = {};
+        e[0] = 100000;
+        EXPECT_TRUE((lw_index_datastructs::KdTreeSimdL2Metric<int32_t, 8>().distance(e, f)) == std::numeric_limits<int32_t>::max());
+        EXPECT_TRUE((lw_index_datastructs::KdTreeSimdL2Metric<int32_t, 8, int64_t>().distance(e, f)) == int64_t(10000000000ll));
+        EXPECT_TRUE((lw_index_datastructs::KdTreeSimdL2Metric<int32_t, 8, int64_t>().boundedDistance(e, f, 1)) == int64_t(10000000000ll));
+        for (size_t i = 0; i < 16; ++i)
+        {
+            e[i] = kMin;
+            f[i] = kMax;
+        }
+        EXPECT_TRUE((lw_index_datastructs::KdTreeSimdL2Metric<int32_t, 16, int64_t>().distance(e, f)) == std::numeric_limits<int64_t>::max());
+        EXPECT_TRUE((lw_index_datastructs::KdTreeSimdL2Metric<int32_t, 16, double>().distance(e, f)) == (lw_index_datastructs::KdTreeL2Metric<int32_t, 16, double>().distance(e, f)));
+        EXPECT_TRUE((lw_index_datastructs::KdTreeSimdL2Metric<int16_t, 16, int16_t>().distance(c, d)) == std::numeric_limits<int16_t>::max());
+        EXPECT_TRUE((lw_index_datastructs::KdTreeSimdL2Metric<int16_t, 16, double>().distance(c, d)) == double(expected));
+
+        checkNearestPointForFarRequests();
+        checkNearestPointWithIntegerCoordinates<int, 2>(-1073741824.0, 1073741823.0);
+        checkNearestPointWithIntegerCoordinates<int, 12>(-268435456.0, 268435455.0);
+        checkNearestPointWithIntegerCoordinates<int16_t, 16>(-32768.0, 32767.0);
+    }
+
+    {
+        double a[] = { 1.0, 2.0, 3.0 };
+        double b[] = { 4.0, 0.0, 3.5 };
+        double weights[] = { 1.0, 4.0, 0.0 };
+
+        lw_index_datastructs::KdTreeL2Metric<double, 3> l2;
+        lw_index_datastructs::KdTreeL1Metric<double, 3> l1;
+        lw_index_datastructs::KdTreeLinfMetric<double, 3> linf;
+        lw_index_datastructs::KdTreeWeightedL2Metric<double, 3> weighted(weights);
+        lw_index_datastructs::KdTreeMinkowskiMetric<double, 3> minkowski3(3.0);
+
+        EXPECT_TRUE(l2.distance(a, b) == 9.0 + 4.0 + 0.25);
+        EXPECT_TRUE(l1.distance(a, b) == 3.0 + 2.0 + 0.5);
+        EXPECT_TRUE(linf.distance(a, b) == 3.0);
+        EXPECT_TRUE(weighted.distance(a, b) == 9.0 + 16.0);
+        EXPECT_TRUE(fabs(minkowski3.distance(a, b) - (27.0 + 8.0 + 0.125)) < 1e-12);
+
+        EXPECT_TRUE(l2.axisDistance(-2.0, 0) == 4.0);
+        EXPECT_TRUE(l1.axisDistance(-2.0, 0) == 2.0);
+        EXPECT_TRUE(linf.axisDistance(-2.0, 0) == 2.0);
+        EXPECT_TRUE(weighted.axisDistance(-2.0, 1) == 16.0);
+        EXPECT_TRUE(fabs(minkowski3.axisDistance(-2.0, 0) - 8.0) < 1e-12);
+
+        EXPECT_TRUE(lw_index_datastructs::kdTreeReplaceAxisDistance(l2, 10.0, 4.0, 9.0) == 15.0);
+        EXPECT_TRUE(lw_index_datastructs::kdTreeReplaceAxisDistance(l1, 10.0, 2.0, 3.0) == 11.0);
+        EXPECT_TRUE(lw_index_datastructs::kdTreeReplaceAxisDistance(linf, 5.0, 2.0, 3.0) == 5.0);
+        EXPECT_TRUE(lw_index_datastructs::kdTreeReplaceAxisDistance(linf, 5.0, 2.0, 7.0) == 7.0);
+        // policy without replaceAxisDistance() gets max of terms
+        struct PolicyWithoutReplace {};
+        EXPECT_TRUE(lw_index_datastructs::kdTreeReplaceAxisDistance(PolicyWithoutReplace(), 10.0, 4.0, 9.0) == 10.0);
+        EXPECT_TRUE(lw_index_datastructs::kdTreeReplaceAxisDistance(PolicyWithoutReplace(), 10.0, 4.0, 12.0) == 12.0);
+
+        // only Euclidean policies can be frozen
+        EXPECT_TRUE((lw_index_datastructs::KdTreeIsL2Metric<lw_index_datastructs::KdTreeL2Metric<double, 3> >::value));
+        EXPECT_TRUE((lw_index_datastructs::KdTreeIsL2Metric<lw_index_datastructs::KdTreeSimdL2Metric<float, 8> >::value));
+        EXPECT_TRUE((lw_index_datastructs::KdTreeIsL2Metric<lw_index_datastructs::KdTreeVarianceOrderedL2Metric<double, 3> >::value));
+        EXPECT_TRUE(!(lw_index_datastructs::KdTreeIsL2Metric<lw_index_datastructs::KdTreeL1Metric<double, 3> >::value));
+        EXPECT_TRUE(!(lw_index_datastructs::KdTreeIsL2Metric<lw_index_datastructs::KdTreeLinfMetric<double, 3> >::value));
+        EXPECT_TRUE(!(lw_index_datastructs::KdTreeIsL2Metric<lw_index_datastructs::KdTreeWeightedL2Metric<double, 3> >::value));
+
+        EXPECT_TRUE(linf.accumulate(2.0, 1.0) == 2.0);
+        EXPECT_TRUE(l1.accumulate(2.0, 1.0) == 3.0);
+        EXPECT_TRUE(l2.fromDistance(3.0) == 9.0);
+        EXPECT_TRUE(l1.fromDistance(3.0) == 3.0);
+
+        // integer coordinates
+        int ia[] = { 1, -5 };
+        int ib[] = { -2, 1 };
+        EXPECT_TRUE((lw_index_datastructs::KdTreeL1Metric<int, 2>().distance(ia, ib)) == 9);
+        EXPECT_TRUE((lw_index_datastructs::KdTreeLinfMetric<int, 2>().distance(ia, ib)) == 6);
+    }
+
+    checkSearchesWithMetric(lw_index_datastructs::KdTreeL2Metric<double, 3>());
+    checkSearchesWithMetric(lw_index_datastructs::KdTreeL1Metric<double, 3>());
+    checkSearchesWithMetric(lw_index_datastructs::KdTreeLinfMetric<double, 3>());
+    double weights[] = { 0.25, 1.0, 9.0 };
+    checkSearchesWithMetric(lw_index_datastructs::KdTreeWeightedL2Metric<double, 3>(weights));
+    checkSearchesWithMetric(lw_index_datastructs::KdTreeMinkowskiMetric<double, 3>(3.0));
+
+    // early abandonment of distance evaluation
+    {
+        const size_t kDim = 24;
+        std::vector<double> points = generateAnisotropicPoints<double>(2000, kDim, 57);
+        std::vector<double> requests = generateAnisotropicPoints<double>(50, kDim, 58);
+        std::vector<float> pointsFloat(points.begin(), points.end());
+        std::vector<int> pointsInt(points.size());
+        for (size_t i = 0; i < points.size(); ++i)
+            pointsInt[i] = int(points[i] * 1.0e7);
+        std::vector<const double*> ptrs(points.size() / kDim);
+        for (size_t i = 0; i < ptrs.size(); ++i)
+            ptrs[i] = &points[i * kDim];
+
+        double coordWeights[kDim] = {};
+        for (size_t i = 0; i < kDim; ++i)
+            coordWeights[i] = double(i % 3);
+        lw_index_datastructs::KdTreeVarianceOrderedL2Metric<double, kDim> varianceOrdered;
+        varianceOrdered.orderByVariance(ptrs, ptrs.size());
+        EXPECT_TRUE(varianceOrdered.order[0] == kDim - 1);
+        EXPECT_TRUE(varianceOrdered.order[kDim - 1] == 0);
+
+        checkBoundedDistance<lw_index_datastructs::KdTreeL2Metric<double, kDim>, double, double>(lw_index_datastructs::KdTreeL2Metric<double, kDim>(), points, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeL2Metric<float, kDim>, float, float>(lw_index_datastructs::KdTreeL2Metric<float, kDim>(), pointsFloat, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeL2Metric<float, kDim, double>, float, double>(lw_index_datastructs::KdTreeL2Metric<float, kDim, double>(), pointsFloat, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeL2Metric<int, kDim, double>, int, double>(lw_index_datastructs::KdTreeL2Metric<int, kDim, double>(), pointsInt, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeSimdL2Metric<float, kDim>, float, float>(lw_index_datastructs::KdTreeSimdL2Metric<float, kDim>(), pointsFloat, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeSimdL2Metric<double, kDim>, double, double>(lw_index_datastructs::KdTreeSimdL2Metric<double, kDim>(), points, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeSimdL2Metric<float, kDim, double>, float, double>(lw_index_datastructs::KdTreeSimdL2Metric<float, kDim, double>(), pointsFloat, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeSimdL2Metric<int, kDim, double>, int, double>(lw_index_datastructs::KdTreeSimdL2Metric<int, kDim, double>(), pointsInt, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeSimdL2Metric<int, kDim, int64_t>, int, int64_t>(lw_index_datastructs::KdTreeSimdL2Metric<int, kDim, int64_t>(), pointsInt, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeL1Metric<double, kDim>, double, double>(lw_index_datastructs::KdTreeL1Metric<double, kDim>(), points, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeLinfMetric<double, kDim>, double, double>(lw_index_datastructs::KdTreeLinfMetric<double, kDim>(), points, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeWeightedL2Metric<double, kDim>, double, double>(lw_index_datastructs::KdTreeWeightedL2Metric<double, kDim>(coordWeights), points, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeMinkowskiMetric<double, kDim>, double, double>(lw_index_datastructs::KdTreeMinkowskiMetric<double, kDim>(3.0), points, kDim);
+        checkBoundedDistance<lw_index_datastructs::KdTreeVarianceOrderedL2Metric<double, kDim>, double, double>(varianceOrdered, points, kDim);
+
+        checkNearestPointInHighDimension(lw_index_datastructs::KdTreeL2Metric<double, kDim>(), points, requests);
+        checkNearestPointInHighDimension(lw_index_datastructs::KdTreeSimdL2Metric<double, kDim>(), points, requests);
+        checkNearestPointInHighDimension(lw_index_datastructs::KdTreeL1Metric<double, kDim>(), points, requests);
+        checkNearestPointInHighDimension(lw_index_datastructs::KdTreeLinfMetric<double, kDim>(), points, requests);
+        checkNearestPointInHighDimension(lw_index_datastructs::KdTreeWeightedL2Metric<double, kDim>(coordWeights), points, requests);
+        checkNearestPointInHighDimension(varianceOrdered, points, requests);
+    }
+}
+
+namespace
+{
+    template <class Metric>
+    void measureNearestPointWithMetric(const std::string& name, const std::vector<const double*>& ptrs, const std::vector<double>& requests)
+    {
+        typedef lw_index_datastructs::KDtree<double, 3, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeArenaNodeAllocator, Metric> Tree;
+        Tree kd(ptrs, ptrs.size());
+
+        size_t numRequests = requests.size() / 3;
+        double checksum = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numRequests; ++i)
+            checksum += kd.nearestPointInEuclidianMetric(&requests[i * 3])[0];
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        gProxiedRecordPerf("nearest point with " + name + " metric", numRequests, ptrs.size(), ms);
+        EXPECT_TRUE(checksum > 0.0);
+    }
+}
+
+namespace
+{
+    /** Euclidean metric which converts coordinates into double. Used as baseline for integer coordinates.
+    */
+    template <class TCoord, size_t Dimension>
+    struct ConvertToDoubleL2Metric : public lw_index_datastructs::KdTreeL2Metric<TCoord, Dimension, double>
+    {
+        double distance(const TCoord* a, const TCoord* b) const
+        {
+            double distance = 0.0;
+            for (size_t i = 0; i < Dimension; ++i)
+            {
+                double tmp = double(a[i]) - double(b[i]);
+                distance += tmp*tmp;
+            }
+            return distance;
+        }
+
+        double boundedDistance(const TCoord* a, const TCoord* b, double /*bound*/) const {
+            return distance(a, b);
+        }
+    };
+
+    template <class TInt, size_t Dimension, class Metric>
+    double measureNearestPointWithIntegerCoordinates(const std::vector<const TInt*>& ptrs, const std::vector<TInt>& requests)
+    {
+        lw_index_datastructs::KDtree<TInt, Dimension, double, lw_index_datastructs::Comparator<TInt>, lw_index_datastructs::KdTreeArenaNodeAllocator, Metric> kd(ptrs, ptrs.size());
+        size_t numRequests = requests.size() / Dimension;
+        double checksum = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numRequests; ++i)
+            checksum += double(kd.nearestPointInEuclidianMetric(&requests[i * Dimension])[0]);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        EXPECT_TRUE(checksum != 0.0);
+        return ms;
+    }
+
+    template <class TInt, size_t Dimension>
+    void measureIntegerCoordinates(const std::string& name, size_t numPoints, size_t numRequests, double maxValue)
+    {
+        std::mt19937 gen(56);
+        std::uniform_real_distribution<double> dist(-maxValue, maxValue);
+        std::vector<TInt> points(numPoints * Dimension);
+        std::vector<TInt> requests(numRequests * Dimension);
+        for (size_t i = 0; i < points.size(); ++i)
+            points[i] = TInt(dist(gen));
+        for (size_t i = 0; i < requests.size(); ++i)
+            requests[i] = TInt(dist(gen));
+        std::vector<const TInt*> ptrs(numPoints);
+        for (size_t i = 0; i < numPoints; ++i)
+            ptrs[i] = &points[i * Dimension];
+
+        double convertMs = measureNearestPointWithIntegerCoordinates<TInt, Dimension, ConvertToDoubleL2Metric<TInt, Dimension> >(ptrs, requests);
+        gProxiedRecordPerf("nearest point for " + name + " with conversion into double", numRequests, numPoints, convertMs);
+        double wideMs = measureNearestPointWithIntegerCoordinates<TInt, Dimension, lw_index_datastructs::KdTreeL2Metric<TInt, Dimension, double> >(ptrs, requests);
+        gProxiedRecordPerf("nearest point for " + name + " with 64-bit integer accumulation", numRequests, numPoints, wideMs);
+    }
+}
+
+namespace
+{
+    /** Euclidean metric which always evaluates the full distance. Used as baseline for early abandonment.
+    */
+    template <class TCoord, size_t Dimension>
+    struct FullDistanceL2Metric : public lw_index_datastructs::KdTreeL2Metric<TCoord, Dimension>
+    {
+        TCoord boundedDistance(const TCoord* a, const TCoord* b, TCoord /*bound*/) const {
+            return this->distance(a, b);
+        }
+    };
+
+    template <size_t Dimension, class Metric>
+    void measureNearestPointInHighDimension(const std::string& name, const Metric& metric, const std::vector<const double*>& ptrs, const std::vector<double>& requests)
+    {
+        lw_index_datastructs::KDtree<double, Dimension, double, lw_index_datastructs::Comparator<double>, lw_index_datastructs::KdTreeArenaNodeAllocator, Metric> kd(ptrs, ptrs.size());
+        kd.setDistanceMetric(metric);
+
+        size_t numRequests = requests.size() / Dimension;
+        double checksum = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numRequests; ++i)
+            checksum += kd.nearestPointInEuclidianMetric(&requests[i * Dimension])[0];
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        gProxiedRecordPerf("nearest point in " + gPrintNumber(Dimension) + "D " + name, numRequests, ptrs.size(), ms);
+        EXPECT_TRUE(checksum > 0.0);
+    }
+
+    template <size_t Dimension>
+    void measureEarlyAbandonment(size_t numPoints, size_t numRequests)
+    {
+        std::vector<double> points = generateAnisotropicPoints<double>(numPoints, Dimension, 59);
+        std::vector<double> requests = generateAnisotropicPoints<double>(numRequests, Dimension, 60);
+        std::vector<const double*> ptrs(numPoints);
+        for (size_t i = 0; i < numPoints; ++i)
+            ptrs[i] = &points[i * Dimension];
+
+        lw_index_datastructs::KdTreeVarianceOrderedL2Metric<double, Dimension> varianceOrdered;
+        varianceOrdered.orderByVariance(ptrs, ptrs.size());
+
+        measureNearestPointInHighDimension<Dimension>("with full distances", FullDistanceL2Metric<double, Dimension>(), ptrs, requests);
+        measureNearestPointInHighDimension<Dimension>("with early abandonment", lw_index_datastructs::KdTreeL2Metric<double, Dimension>(), ptrs, requests);
+        measureNearestPointInHighDimension<Dimension>("with early abandonment and axes ordered by variance", varianceOrdered, ptrs, requests);
+        measureNearestPointInHighDimension<Dimension>("with vectorized early abandonment", lw_index_datastructs::KdTreeSimdL2Metric<double, Dimension>(), ptrs, requests);
+    }
+}
+
+TEST(Utils, KdTreeMetricsGPerf)
+{
+    measureEarlyAbandonment<32>(50 * 1000, 200);
+    measureEarlyAbandonment<64>(20 * 1000, 100);
+
+    measureIntegerCoordinates<int32_t, 3>("int32 in 3D", 1000 * 1000, 200 * 1000, 2.0e9);
+    measureIntegerCoordinates<int16_t, 32>("int16 in 32D", 50 * 1000, 200, 30000.0);
+    measureIntegerCoordinates<int32_t, 32>("int32 in 32D", 50 * 1000, 200, 2.0e8);
+
+    const size_t kPoints = 1000 * 1000;
+    std::vector<double> points = generatePoints(kPoints, 53);
+    std::vector<double> requests = generatePoints(100 * 1000, 54);
+    std::vector<const double*> ptrs(kPoints);
+    for (size_t i = 0; i < kPoints; ++i)
+        ptrs[i] = &points[i * 3];
+
+    measureNearestPointWithMetric<lw_index_datastructs::KdTreeL2Metric<double, 3>>("L2", ptrs, requests);
+    measureNearestPointWithMetric<lw_index_datastructs::KdTreeL1Metric<double, 3>>("L1", ptrs, requests);
+    measureNearestPointWithMetric<lw_index_datastructs::KdTreeLinfMetric<double, 3>>("Linf", ptrs, requests);
+    measureNearestPointWithMetric<lw_index_datastructs::KdTreeWeightedL2Metric<double, 3>>("weighted L2", ptrs, requests);
+    measureNearestPointWithMetric<lw_index_datastructs::KdTreeMinkowskiMetric<double, 3>>("Minkowski", ptrs, requests);
+}
@@ -0,0 +1,67 @@
+#include "lw_index_datastructs/headers_public/KdTreeNodeAllocators.h"
+#include "GTestMacroses.h"
+
+#include <stdint.h>
+
+TEST(Utils, KdTreeNodeAllocatorsGTest)
+{
+    {
+        lw_index_datastructs::KdTreeHeapNodeAllocator heap;
+        void* p = heap.allocate(32, 8);
+        EXPECT_TRUE(p != nullptr);
+        heap.deallocate(p, 32);
+    }
+
+    {
+        lw_index_datastructs::KdTreeArenaNodeAllocator arena(4096);
+        EXPECT_TRUE(arena.chunksCount() == 0);
+        EXPECT_TRUE(arena.allocatedBytes() == 0);
+
+        char* prev = nullptr;
+        for (size_t i = 0; i < 100; ++i)
+        {
+            char* p = static_cast<char*>(arena.allocate(24, 8));
+            EXPECT_TRUE(reinterpret_cast<uintptr_t>(p) % 8 == 0);
+            if (prev)
+            {
+                EXPECT_TRUE(p == prev + 24);
+            }
+            prev = p;
+        }
+        EXPECT_TRUE(arena.chunksCount() == 1);
+
+        void* aligned = arena.allocate(10, 64);
+        EXPECT_TRUE(reinterpret_cast<uintptr_t>(aligned) % 64 == 0);
+
+        // request bigger then chunk lives in own chunk and does not break current chunk
+        void* big = arena.allocate(100000, 16);
+        EXPECT_TRUE(big != nullptr);
+        EXPECT_TRUE(arena.chunksCount() == 2);
+        char* next = static_cast<char*>(arena.allocate(24, 8));
+        EXPECT_TRUE(next > prev && next < prev + 4096);
+        EXPECT_TRUE(arena.chunksCount() == 2);
+
+        lw_index_datastructs::KdTreeArenaNodeAllocator copy(arena);
+        EXPECT_TRUE(copy.chunksCount() == 0);
+
+        lw_index_datastructs::KdTreeArenaNodeAllocator other;
+        other.swap(arena);
+        EXPECT_TRUE(arena.chunksCount() == 0);
+        EXPECT_TRUE(other.chunksCount() == 2);
+
+        other.releaseAll();
+        EXPECT_TRUE(other.chunksCount() == 0);
+        EXPECT_TRUE(other.allocatedBytes() == 0);
+    }
+
+    {
+        // huge pages may be not available, but allocator should fallback to regular pages
+        lw_index_datastructs::KdTreeArenaNodeAllocator arena(4096, true);
+        char* p = static_cast<char*>(arena.allocate(64, 8));
+        EXPECT_TRUE(p != nullptr);
+        p[0] = 1;
+        p[63] = 2;
+        EXPECT_TRUE(arena.allocatedBytes() >= 2 * 1024 * 1024);
+        gProxiedRecordProperty("huge pages are used", arena.isHugePagesUsed());
+    }
+}
@@ -0,0 +1,345 @@
+#include "lw_index_datastructs/headers_public/KdTreeSimd.h"
+#include "lw_index_datastructs/headers_public/KdTreeMetrics.h"
+#include "lw_index_datastructs/headers_public/KdTree.h"
+#include "GTestMacroses.h"
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <math.h>
+
+namespace
+{
+    template <class T>
+    std::vector<T> generateSimdTestValues(size_t num, unsigned int seed, double minValue, double maxValue)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<double> dist(minValue, maxValue);
+        std::vector<T> values(num);
+        for (size_t i = 0; i < num; ++i)
+            values[i] = T(dist(gen));
+        return values;
+    }
+
+    template <class T>
+    double referenceDistanceSqr(const T* a, const T* b, size_t dimension)
+    {
+        double distance = 0.0;
+        for (size_t i = 0; i < dimension; ++i)
+        {
+            double tmp = double(a[i]) - double(b[i]);
+            distance += tmp*tmp;
+        }
+        return distance;
+    }
+
+    template <class TInt>
+    uint64_t referenceIntegerDistanceSqr(const TInt* a, const TInt* b, size_t dimension)
+    {
+        uint64_t distance = 0;
+        for (size_t i = 0; i < dimension; ++i)
+        {
+            int64_t tmp = int64_t(a[i]) - int64_t(b[i]);
+            uint64_t absTmp = uint64_t(tmp < 0 ? -tmp : tmp);
+            distance += absTmp * absTmp;
+        }
+        return distance;
+    }
+
+    uint64_t referenceDistanceSqr(const int32_t* a, const int32_t* b, size_t dimension) {
+        return referenceIntegerDistanceSqr(a, b, dimension);
+    }
+
+    uint64_t referenceDistanceSqr(const int16_t* a, const int16_t* b, size_t dimension) {
+        return referenceIntegerDistanceSqr(a, b, dimension);
+    }
+
+    /** Check kernels for float/double against reference for all dimensions up to maxDimension
+    */
+    template <class T>
+    void checkFloatingPointKernels(double relativeTolerance)
+    {
+        const size_t kMaxDimension = 70;
+        const size_t kPoints = 9;
+        std::vector<T> values = generateSimdTestValues<T>(kMaxDimension * (kPoints + 1), 71, -100.0, 100.0);
+        const T* request = &values[kMaxDimension * kPoints];
+
+        for (size_t dim = 0; dim <= kMaxDimension; ++dim)
+        {
+            std::vector<const T*> points(kPoints);
+            for (size_t j = 0; j < kPoints; ++j)
+                points[j] = &values[j * kMaxDimension];
+
+            std::vector<T> distances(kPoints);
+            lw_index_datastructs::simdDistancesSqr(request, points.data(), kPoints, dim, distances.data());
+
+            for (size_t j = 0; j < kPoints; ++j)
+            {
+                double expected = referenceDistanceSqr(points[j], request, dim);
+                T single = lw_index_datastructs::simdDistanceSqr(points[j], request, dim);
+                EXPECT_TRUE(fabs(double(single) - expected) <= relativeTolerance * expected);
+                EXPECT_TRUE(distances[j] == single);
+
+                // early abandonment gives the same value below the bound and a value not less then the bound otherwise
+                T bounds[] = { T(), single / T(2), single, single + T(1), std::numeric_limits<T>::max() };
+                for (size_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]); ++b)
+                {
+                    T bounded = lw_index_datastructs::simdDistanceSqrWithBound(points[j], request, dim, bounds[b]);
+                    if (single < bounds[b])
+                        EXPECT_TRUE(bounded == single);
+                    else
+                        EXPECT_TRUE(bounded >= bounds[b]);
+                }
+            }
+        }
+
+        // buckets give exactly the same result as the scalar loop
+        for (size_t stride = 1; stride <= 40; ++stride)
+        {
+            const size_t dim = 7;
+            std::vector<T> block(values.begin(), values.begin() + stride * dim);
+            std::vector<T> distances(stride);
+            lw_index_datastructs::simdBucketDistancesSqr(block.data(), stride, dim, request, distances.data());
+            for (size_t j = 0; j < stride; ++j)
+            {
+                T expected = T();
+                for (size_t c = 0; c < dim; ++c)
+                {
+                    T tmp = block[c * stride + j] - request[c];
+                    expected += tmp*tmp;
+                }
+                EXPECT_TRUE(distances[j] == expected);
+            }
+        }
+    }
+
+    /** Check integer kernels against reference for all dimensions up to maxDimension
+    */
+    template <class TInt>
+    void checkIntegerKernels(double maxAbsValue)
+    {
+        const size_t kMaxDimension = 37;
+        const size_t kPoints = 5;
+        std::vector<TInt> values = generateSimdTestValues<TInt>(kMaxDimension * (kPoints + 1), 72, -maxAbsValue, maxAbsValue);
+        const TInt* request = &values[kMaxDimension * kPoints];
+
+        for (size_t dim = 0; dim <= kMaxDimension; ++dim)
+        {
+            std::vector<const TInt*> points(kPoints);
+            for (size_t j = 0; j < kPoints; ++j)
+                points[j] = &values[j * kMaxDimension];
+
+            std::vector<uint64_t> distances(kPoints);
+            lw_index_datastructs::simdDistancesSqr(request, points.data(), kPoints, dim, distances.data());
+            for (size_t j = 0; j < kPoints; ++j)
+            {
+                EXPECT_TRUE(lw_index_datastructs::simdDistanceSqr(points[j], request, dim) == referenceDistanceSqr(points[j], request, dim));
+                EXPECT_TRUE(distances[j] == referenceDistanceSqr(points[j], request, dim));
+            }
+        }
+    }
+
+    void checkInt32Kernels()
+    {
+        const int32_t kMin = std::numeric_limits<int32_t>::min();
+        const int32_t kMax = std::numeric_limits<int32_t>::max();
+        const uint64_t kSaturated = std::numeric_limits<uint64_t>::max();
+
+        // full range of coordinates
+        {
+            int32_t a[] = { kMin, kMax, 0, kMin, -1 };
+            int32_t b[] = { kMax, kMin, kMin, kMin, kMax };
+            EXPECT_TRUE(lw_index_datastructs::simdDistanceSqr(a, b, 1) == uint64_t(0xFFFFFFFFull) * uint64_t(0xFFFFFFFFull));
+            EXPECT_TRUE(lw_index_datastructs::simdDistanceSqr(a + 2, b + 2, 3) == referenceDistanceSqr(a + 2, b + 2, 3));
+            // sum of squares does not fit into uint64_t
+            EXPECT_TRUE(lw_index_datastructs::simdDistanceSqr(a, b, 2) == kSaturated);
+        }
+
+        // saturation in vectorized part and in the tail
+        for (size_t dim = 1; dim <= 40; ++dim)
+        {
+            std::vector<int32_t> a(dim, 0);
+            std::vector<int32_t> b(dim, 0);
+            a[dim - 1] = kMin;
+            b[dim - 1] = kMax;
+            EXPECT_TRUE(lw_index_datastructs::simdDistanceSqr(a.data(), b.data(), dim) == uint64_t(0xFFFFFFFFull) * uint64_t(0xFFFFFFFFull));
+            a[0] = kMax;
+            b[0] = kMin + (dim == 1 ? 0 : 1);
+            EXPECT_TRUE(lw_index_datastructs::simdDistanceSqr(a.data(), b.data(), dim) == (dim == 1 ? uint64_t(0xFFFFFFFFull) * uint64_t(0xFFFFFFFFull) : kSaturated));
+
+            // large differences which still fit
+            for (size_t i = 0; i < dim; ++i)
+            {
+                a[i] = kMax / 16;
+                b[i] = kMin / 16;
+            }
+            EXPECT_TRUE(lw_index_datastructs::simdDistanceSqr(a.data(), b.data(), dim) == referenceDistanceSqr(a.data(), b.data(), dim));
+        }
+
+        checkIntegerKernels<int32_t>(double(1 << 28));
+    }
+
+    void checkInt16Kernels()
+    {
+        const int16_t kMin = std::numeric_limits<int16_t>::min();
+        const int16_t kMax = std::numeric_limits<int16_t>::max();
+
+        for (size_t dim = 1; dim <= 40; ++dim)
+        {
+            std::vector<int16_t> a(dim, kMin);
+            std::vector<int16_t> b(dim, kMax);
+            EXPECT_TRUE(lw_index_datastructs::simdDistanceSqr(a.data(), b.data(), dim) == uint64_t(dim) * 65535u * 65535u);
+            EXPECT_TRUE(lw_index_datastructs::simdDistanceSqr(b.data(), a.data(), dim) == uint64_t(dim) * 65535u * 65535u);
+        }
+
+        checkIntegerKernels<int16_t>(32767.0);
+    }
+}
+
+TEST(Utils, KdTreeSimdGTest)
+{
+    const lw_index_datastructs::KdTreeSimdLevel detected = lw_index_datastructs::detectSimdLevel();
+    EXPECT_TRUE(lw_index_datastructs::activeSimdLevel() == detected);
+
+    for (int level = int(lw_index_datastructs::KdTreeSimdLevel::eScalar); level <= int(lw_index_datastructs::KdTreeSimdLevel::eAVX512); ++level)
+    {
+        lw_index_datastructs::KdTreeSimdLevel used = lw_index_datastructs::setActiveSimdLevel(lw_index_datastructs::KdTreeSimdLevel(level));
+        EXPECT_TRUE(int(used) == (level < int(detected) ? level : int(detected)));
+        EXPECT_TRUE(lw_index_datastructs::activeSimdLevel() == used);
+        EXPECT_TRUE(lw_index_datastructs::simdLevelName(used) != nullptr);
+
+        checkFloatingPointKernels<float>(1e-5);
+        checkFloatingPointKernels<double>(1e-12);
+        checkInt32Kernels();
+        checkInt16Kernels();
+
+        // tree with vectorized metric
+        {
+            const size_t kDim = 16;
+            const size_t kPoints = 3000;
+            std::vector<float> points = generateSimdTestValues<float>(kPoints * kDim, 73, 0.0, 1.0);
+            std::vector<float> requests = generateSimdTestValues<float>(50 * kDim, 74, 0.0, 1.0);
+            std::vector<const float*> ptrs(kPoints);
+            for (size_t i = 0; i < kPoints; ++i)
+                ptrs[i] = &points[i * kDim];
+
+            lw_index_datastructs::KDtree<float, kDim, float, lw_index_datastructs::Comparator<float>,
+                                         lw_index_datastructs::KdTreeArenaNodeAllocator, lw_index_datastructs::KdTreeSimdL2Metric<float, kDim> > kd(ptrs, ptrs.size());
+
+            for (size_t r = 0; r < 50; ++r)
+            {
+                const float* req = &requests[r * kDim];
+                double best = std::numeric_limits<double>::max();
+                for (size_t i = 0; i < kPoints; ++i)
+                {
+                    double d = referenceDistanceSqr(ptrs[i], req, kDim);
+                    if (d < best)
+                        best = d;
+                }
+                EXPECT_TRUE(fabs(referenceDistanceSqr(kd.nearestPointInEuclidianMetric(req), req, kDim) - best) <= 1e-5 * best);
+            }
+        }
+
+        // tree with vectorized metric and large integer coordinates: distances do not fit into uint64_t
+        {
+            const size_t kDim = 16;
+            const size_t kPoints = 2000;
+            std::vector<int32_t> points = generateSimdTestValues<int32_t>(kPoints * kDim, 75, 5.0e8, 2147483647.0);
+            std::vector<int32_t> requests = generateSimdTestValues<int32_t>(50 * kDim, 76, -2147483648.0, -5.0e8);
+            std::vector<const int32_t*> ptrs(kPoints);
+            for (size_t i = 0; i < kPoints; ++i)
+                ptrs[i] = &points[i * kDim];
+
+            lw_index_datastructs::KDtree<int32_t, kDim, double, lw_index_datastructs::Comparator<int32_t>,
+                                         lw_index_datastructs::KdTreeArenaNodeAllocator, lw_index_datastructs::KdTreeSimdL2Metric<int32_t, kDim, double> > kd(ptrs, ptrs.size());
+
+            lw_index_datastructs::KdTreeL2Metric<int32_t, kDim, double> reference;
+            for (size_t r = 0; r < 50; ++r)
+            {
+                const int32_t* req = &requests[r * kDim];
+                double best = std::numeric_limits<double>::max();
+                for (size_t i = 0; i < kPoints; ++i)
+                    best = std::min(best, reference.distance(ptrs[i], req));
+                EXPECT_TRUE(best > 18446744073709551616.0);
+                EXPECT_TRUE(reference.distance(kd.nearestPointInEuclidianMetric(req), req) == best);
+            }
+        }
+    }
+
+    lw_index_datastructs::setActiveSimdLevel(detected);
+}
+
+namespace
+{
+    template <class T>
+    void measureSimdKernels(size_t dimension)
+    {
+        const size_t kPoints = 4096;
+        const size_t kRepeats = 1000;
+        std::vector<T> values = generateSimdTestValues<T>((kPoints + 1) * dimension, 75, 0.0, 100.0);
+        std::vector<const T*> points(kPoints);
+        for (size_t j = 0; j < kPoints; ++j)
+            points[j] = &values[j * dimension];
+        const T* request = &values[kPoints * dimension];
+        std::vector<T> distances(kPoints);
+
+        const lw_index_datastructs::KdTreeSimdLevel detected = lw_index_datastructs::detectSimdLevel();
+        for (int level = 0; level <= int(detected); ++level)
+        {
+            lw_index_datastructs::setActiveSimdLevel(lw_index_datastructs::KdTreeSimdLevel(level));
+            double checksum = 0.0;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t r = 0; r < kRepeats; ++r)
+            {
+                lw_index_datastructs::simdDistancesSqr(request, points.data(), kPoints, dimension, distances.data());
+                checksum += double(distances[r % kPoints]);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            gProxiedRecordPerf(std::string("one vs many distances ") + (sizeof(T) == 4 ? "float" : "double") + " in " + gPrintNumber(dimension) +
+                               "D with " + lw_index_datastructs::simdLevelName(lw_index_datastructs::KdTreeSimdLevel(level)), kRepeats, kPoints, ms);
+            EXPECT_TRUE(checksum > 0.0);
+        }
+        lw_index_datastructs::setActiveSimdLevel(detected);
+    }
+
+    template <class Metric>
+    double measureNearestPointInHighDimension(const std::vector<const float*>& ptrs, const std::vector<float>& requests)
+    {
+        const size_t kDim = 64;
+        lw_index_datastructs::KDtree<float, kDim, float, lw_index_datastructs::Comparator<float>, lw_index_datastructs::KdTreeArenaNodeAllocator, Metric> kd(ptrs, ptrs.size());
+        size_t numRequests = requests.size() / kDim;
+        double checksum = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numRequests; ++i)
+            checksum += kd.nearestPointInEuclidianMetric(&requests[i * kDim])[0];
+        EXPECT_TRUE(checksum > 0.0);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+TEST(Utils, KdTreeSimdGPerf)
+{
+    gProxiedRecordProperty("detected_simd_level", lw_index_datastructs::simdLevelName(lw_index_datastructs::detectSimdLevel()));
+
+    measureSimdKernels<float>(16);
+    measureSimdKernels<float>(64);
+    measureSimdKernels<double>(16);
+    measureSimdKernels<double>(64);
+
+    const size_t kDim = 64;
+    const size_t kPoints = 100 * 1000;
+    const size_t kRequests = 200;
+    std::vector<float> points = generateSimdTestValues<float>(kPoints * kDim, 76, 0.0, 1.0);
+    std::vector<float> requests = generateSimdTestValues<float>(kRequests * kDim, 77, 0.0, 1.0);
+    std::vector<const float*> ptrs(kPoints);
+    for (size_t i = 0; i < kPoints; ++i)
+        ptrs[i] = &points[i * kDim];
+
+    double scalarMs = measureNearestPointInHighDimension<lw_index_datastructs::KdTreeL2Metric<float, kDim> >(ptrs, requests);
+    gProxiedRecordPerf("nearest point in 64D with scalar L2 metric", kRequests, kPoints, scalarMs);
+    double simdMs = measureNearestPointInHighDimension<lw_index_datastructs::KdTreeSimdL2Metric<float, kDim> >(ptrs, requests);
+    gProxiedRecordPerf("nearest point in 64D with vectorized L2 metric", kRequests, kPoints, simdMs);
+}
@@ -0,0 +1,34 @@
+#include "lw_index_datastructs/headers_public/SmallStack.h"
+#include "GTestMacroses.h"
+
+TEST(Utils, SmallStackGTest)
+{
+    lw_index_datastructs::SmallStack<size_t, 4> stack;
+    EXPECT_TRUE(stack.empty());
+    EXPECT_TRUE(stack.size() == 0);
+
+    // items go through inline storage into overflow storage and back
+    for (size_t i = 0; i < 100; ++i)
+    {
+        stack.push(i);
+        EXPECT_TRUE(stack.top() == i);
+        EXPECT_TRUE(stack.size() == i + 1);
+    }
+
+    stack.top() = 1000;
+    EXPECT_TRUE(stack.pop() == 1000);
+    for (size_t i = 99; i > 0; --i)
+        EXPECT_TRUE(stack.pop() == i - 1);
+    EXPECT_TRUE(stack.empty());
+
+    stack.push(1);
+    stack.push(2);
+    stack.push(3);
+    stack.push(4);
+    stack.push(5);
+    stack.clear();
+    EXPECT_TRUE(stack.empty());
+    stack.push(7);
+    EXPECT_TRUE(stack.top() == 7);
+    EXPECT_TRUE(stack.pop() == 7);
+}
@@ -0,0 +1,51 @@
+#include "lw_index_datastructs/headers_public/WorkStealingTaskPool.h"
+#include "GTestMacroses.h"
+
+#include <atomic>
+#include <vector>
+
+namespace
+{
+    void spawnRecursive(lw_index_datastructs::TaskGroup& group, std::atomic<size_t>& counter, size_t depth)
+    {
+        counter++;
+        if (depth == 0)
+            return;
+        group.run([&group, &counter, depth]() { spawnRecursive(group, counter, depth - 1); });
+        spawnRecursive(group, counter, depth - 1);
+    }
+}
+
+TEST(Utils, WorkStealingTaskPoolGTest)
+{
+    for (size_t threads = 1; threads <= 4; ++threads)
+    {
+        lw_index_datastructs::WorkStealingTaskPool pool(threads);
+        EXPECT_TRUE(pool.threadsCount() == threads);
+
+        {
+            std::vector<int> marks(1000, 0);
+            lw_index_datastructs::TaskGroup group(pool);
+            for (size_t i = 0; i < marks.size(); ++i)
+                group.run([&marks, i]() { marks[i] = int(i); });
+            group.wait();
+
+            for (size_t i = 0; i < marks.size(); ++i)
+                EXPECT_TRUE(marks[i] == int(i));
+        }
+
+        {
+            // tasks spawn tasks into the same group, full binary tree of calls
+            std::atomic<size_t> counter(0);
+            lw_index_datastructs::TaskGroup group(pool);
+            spawnRecursive(group, counter, 10);
+            group.wait();
+            EXPECT_TRUE(counter.load() == (size_t(1) << 11) - 1);
+        }
+
+        EXPECT_FALSE(pool.tryRunPendingTask());
+    }
+
+    lw_index_datastructs::WorkStealingTaskPool defaultPool;
+    EXPECT_TRUE(defaultPool.threadsCount() >= 1);
+}